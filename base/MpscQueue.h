@@ -0,0 +1,134 @@
+#pragma once
+
+#include "noncopyable.h"
+#include <stddef.h> // size_t
+#include <atomic>   // atomic
+#include <utility>  // move()
+
+/**
+ * MpscQueue: 多生产者单消费者的无锁队列(Dmitry Vyukov的intrusive MPSC node-based queue)
+ *
+ * push: 任意线程调用, 一次原子exchange + 一次store, 不需要加锁
+ * pop/drain: 只能由唯一的消费者线程(比如loop所在线程)调用
+ *
+ * NOTE: 生产者在exchange和链接next之间被挂起时, 消费者会暂时看到队列"断开",
+ * pop返回false, 这时该生产者的元素还没有完全入队, 留给下一次消费即可
+ */
+
+namespace zfwmuduo
+{
+  template <typename T>
+  class MpscQueue : noncopyable
+  {
+  public:
+    MpscQueue() : head_(&stub_), pad_(), tail_(&stub_) {}
+    ~MpscQueue()
+    {
+      T value;
+      while (pop(&value))
+      {
+      }
+    }
+
+    void push(T value)
+    {
+      pushNode(new Node(std::move(value)));
+    }
+
+    // 取出一个元素, 队列为空(或者暂时断开)时返回false
+    bool pop(T *value)
+    {
+      Node *node = popNode();
+      if (node == nullptr)
+        return false;
+      *value = std::move(node->value);
+      delete node;
+      return true;
+    }
+
+    // 依次处理调用时刻之前已经入队的元素, 处理期间新入队的元素留到下一次
+    // 返回处理的元素个数
+    template <typename Func>
+    size_t drain(Func func)
+    {
+      // NOTE: head_ == &stub_并不代表队列为空: popNode重新放入stub时可能有生产者同时入队,
+      // 这时队列是 tail_ -> ... -> stub_, stub前面的元素都要取出来, 否则再也没有wakeup通知消费者
+      Node *last = head_.load(std::memory_order_acquire);
+      size_t count = 0;
+      while (true)
+      {
+        if (last == &stub_ && tail_ == &stub_)
+          break; // 已经处理到调用时刻的stub, 后面的都是新入队的
+        Node *node = popNode();
+        if (node == nullptr)
+          break; // 队列为空, 或者生产者还没链接上(它入队之后会自己wakeup)
+        bool isLast = node == last;
+        func(node->value);
+        delete node;
+        ++count;
+        if (isLast)
+          break;
+      }
+      return count;
+    }
+
+  private:
+    struct Node
+    {
+      Node() : next(nullptr), value() {}
+      explicit Node(T &&v) : next(nullptr), value(std::move(v)) {}
+
+      std::atomic<Node *> next;
+      T value;
+    };
+
+    void pushNode(Node *node)
+    {
+      node->next.store(nullptr, std::memory_order_relaxed);
+      Node *prev = head_.exchange(node, std::memory_order_acq_rel);
+      prev->next.store(node, std::memory_order_release);
+    }
+
+    Node *popNode()
+    {
+      Node *tail = tail_;
+      Node *next = tail->next.load(std::memory_order_acquire);
+      if (tail == &stub_)
+      { // 跳过stub
+        if (next == nullptr)
+          return nullptr;
+        tail_ = next;
+        tail = next;
+        next = next->next.load(std::memory_order_acquire);
+      }
+      if (next != nullptr)
+      {
+        tail_ = next;
+        return tail;
+      }
+
+      Node *head = head_.load(std::memory_order_acquire);
+      if (tail != head)
+        return nullptr; // 有生产者正在入队, 还没链接上
+
+      // tail是最后一个元素, 重新放入stub, 这样才能把tail取出来
+      pushNode(&stub_);
+      next = tail->next.load(std::memory_order_acquire);
+      if (next != nullptr)
+      {
+        tail_ = next;
+        return tail;
+      }
+      return nullptr;
+    }
+
+    static const size_t kCacheLineSize = 64;
+
+    // NOTE: head_被所有生产者竞争, 用填充把它和消费者独占的tail_分开在不同的cache line上
+    std::atomic<Node *> head_;
+    char pad_[kCacheLineSize - sizeof(std::atomic<Node *>)];
+    Node *tail_;
+    Node stub_;
+  };
+
+} // namespace zfwmuduo
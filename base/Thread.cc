@@ -1,7 +1,13 @@
 #include "Thread.h"
 #include <memory>
 #include "CurrentThread.h" // currentThread::tid()
+#include "Logger.h"         // LOG_ERROR
 #include <semaphore.h>     //信号量的处理 sem_t、sem_init()、sem_wait()、sem_post()
+#include <pthread.h>       // pthread_setname_np(), pthread_setaffinity_np()
+#include <sched.h>         // cpu_set_t
+#include <errno.h>
+#include <sys/syscall.h>     // SYS_set_mempolicy
+#include <linux/mempolicy.h> // MPOL_LOCAL
 
 namespace zfwmuduo
 {
@@ -12,7 +18,9 @@ namespace zfwmuduo
                                                              joined_(false),
                                                              tid_(0),
                                                              func_(std::move(func)),
-                                                             name_(name) { setDefaultName(); }
+                                                             name_(name),
+                                                             cpu_(-1),
+                                                             localAlloc_(false) { setDefaultName(); }
   Thread::~Thread()
   {
     if (started_ && !joined_)
@@ -34,6 +42,14 @@ namespace zfwmuduo
     thread_ = std::shared_ptr<std::thread>(new std::thread([&]() { // 启动新线程, 获取线程的tid值
       tid_ = zfwmuduo::currentThread::tid();
 
+      // 内核里的线程名最长15个字符, perf/htop/top -H 显示的就是它
+      zfwmuduo::currentThread::t_threadName = name_.c_str();
+      ::pthread_setname_np(::pthread_self(), name_.substr(0, 15).c_str());
+      if (cpu_ >= 0)
+      {
+        bindToCpu();
+      }
+
       sem_post(&sem); // 信号量通知：释放一个信号量，通知主线程线程ID已经准备好
 
       // 专门执行该线程函数(用户传入的线程任务)
@@ -58,6 +74,26 @@ namespace zfwmuduo
     { // 线程还未设置名字
       char buf[32] = {0};
       snprintf(buf, sizeof buf, "Thread%d", num);
+      name_ = buf; // NOTE: 原来格式化完就丢掉了, 线程一直没有名字
+    }
+  }
+
+  // 在新线程中调用, 绑核失败只记录错误, 线程照常运行
+  void Thread::bindToCpu()
+  {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu_, &cpuset);
+    int ret = ::pthread_setaffinity_np(::pthread_self(), sizeof cpuset, &cpuset);
+    if (ret != 0)
+    {
+      LOG_ERROR("%s:%s:%d thread %s bind to cpu %d error:%d \n", __FILE__, __FUNCTION__, __LINE__, name_.c_str(), cpu_, ret);
+      return;
+    }
+    // 已经绑在一个cpu上了, MPOL_LOCAL即从这个cpu所在的节点分配; 进程设置了interleave等策略时也能覆盖掉
+    if (localAlloc_ && ::syscall(SYS_set_mempolicy, MPOL_LOCAL, NULL, 0) != 0)
+    {
+      LOG_ERROR("%s:%s:%d thread %s set_mempolicy errno:%d \n", __FILE__, __FUNCTION__, __LINE__, name_.c_str(), errno);
     }
   }
 } // namespace zfwmuduo
\ No newline at end of file
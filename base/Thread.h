@@ -21,6 +21,15 @@ namespace zfwmuduo
     explicit Thread(ThreadFunc, const std::string &name = std::string());
     ~Thread();
 
+    // 把线程绑定到cpu上运行, 需在start()之前设置; localAlloc为true时, 该线程之后分配的内存只从本地NUMA节点取
+    // TAG: 绑核发生在线程函数执行之前, 线程函数里创建的对象(EventLoop/epoll事件数组)会首次触碰在本地节点上
+    void setCpuAffinity(int cpu, bool localAlloc = false)
+    {
+      cpu_ = cpu;
+      localAlloc_ = localAlloc;
+    }
+    int cpu() const { return cpu_; }
+
     void start(); // 调用它才开始创建子线程
     void join();
 
@@ -32,6 +41,7 @@ namespace zfwmuduo
 
   private:
     void setDefaultName(); // 给线程设置默认名称
+    void bindToCpu();      // 在新线程中执行绑核
 
     bool started_;
     bool joined_; // 表示线程是否已经被“join”（即等待线程结束）
@@ -42,6 +52,8 @@ namespace zfwmuduo
     pid_t tid_;
     ThreadFunc func_; // 存储线程函数
     std::string name_;
+    int cpu_;         // 绑定的cpu, -1表示不绑定
+    bool localAlloc_; // 是否设置MPOL_LOCAL内存策略
     static std::atomic_int numCreated_;
   };
 
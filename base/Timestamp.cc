@@ -1,15 +1,23 @@
 #include "Timestamp.h"
-#include <time.h> //time localtime
+#include <time.h>     //time localtime
+#include <sys/time.h> // gettimeofday()
 
 namespace zfwmuduo
 {
   Timestamp::Timestamp() : microSecondsSinceEpoch_(0) {}
   Timestamp::Timestamp(int64_t microSecondsSinceEpoch) : microSecondsSinceEpoch_(microSecondsSinceEpoch) {}
-  Timestamp Timestamp::now() { return Timestamp(time(NULL)); /*隐式构造*/ }
+  Timestamp Timestamp::now()
+  {
+    // NOTE: 定时器需要微秒精度, time(NULL)只能精确到秒
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return Timestamp(static_cast<int64_t>(tv.tv_sec) * kMicroSecondsPerSecond + tv.tv_usec);
+  }
   std::string Timestamp::toString() const
   {
     char buf[128] = {0};
-    tm *tm_time = localtime(&microSecondsSinceEpoch_);
+    time_t seconds = static_cast<time_t>(microSecondsSinceEpoch_ / kMicroSecondsPerSecond);
+    tm *tm_time = localtime(&seconds);
     // NOTE: snprintf 是一个更安全的函数(主要目的是避免缓冲区溢出)，用于将格式化的字符串写入一个指定大小的缓冲区
     snprintf(buf, 128, "%04d-%02d-%02d %02d:%02d:%02d",
              tm_time->tm_year + 1900,
@@ -19,6 +19,38 @@ namespace zfwmuduo
     explicit Timestamp(int64_t microSecondsSinceEpoch); // explicit避免隐式转换
     static Timestamp now();
     std::string toString() const; // const只读方法
+
+    int64_t microSecondsSinceEpoch() const { return microSecondsSinceEpoch_; }
+    bool valid() const { return microSecondsSinceEpoch_ > 0; }
+
+    static Timestamp invalid() { return Timestamp(); }
+
+    static const int kMicroSecondsPerSecond = 1000 * 1000;
   };
 
-} // namespace zfwmuduo
\ No newline at end of file
+  // 定时器按到期时间排序需要用到比较运算
+  inline bool operator<(Timestamp lhs, Timestamp rhs)
+  {
+    return lhs.microSecondsSinceEpoch() < rhs.microSecondsSinceEpoch();
+  }
+
+  inline bool operator==(Timestamp lhs, Timestamp rhs)
+  {
+    return lhs.microSecondsSinceEpoch() == rhs.microSecondsSinceEpoch();
+  }
+
+  // 两个时间戳的差值, 单位秒
+  inline double timeDifference(Timestamp high, Timestamp low)
+  {
+    int64_t diff = high.microSecondsSinceEpoch() - low.microSecondsSinceEpoch();
+    return static_cast<double>(diff) / Timestamp::kMicroSecondsPerSecond;
+  }
+
+  // 在timestamp的基础上增加seconds秒
+  inline Timestamp addTime(Timestamp timestamp, double seconds)
+  {
+    int64_t delta = static_cast<int64_t>(seconds * Timestamp::kMicroSecondsPerSecond);
+    return Timestamp(timestamp.microSecondsSinceEpoch() + delta);
+  }
+
+} // namespace zfwmuduo
@@ -2,12 +2,17 @@
 #include <sys/socket.h>
 #include <errno.h>
 #include <unistd.h> // close()
+#include <fcntl.h>  // open()
 #include "Acceptor.h"
 #include "../base/Logger.h" // LOG_FATAL, LOG_ERROR
 #include "InetAddress.h"
+#include "EventLoop.h"
 
 namespace zfwmuduo
-{ // 为防止与其他文件中变量名重名而产生的重复定义, 在这里将其定义为静态函数static
+{
+  static const double kPauseOnEmfileSeconds = 0.1; // 拿不到预留fd时暂停accept的时长
+
+  // 为防止与其他文件中变量名重名而产生的重复定义, 在这里将其定义为静态函数static
   static int createNonblocking()
   {
     int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
@@ -21,10 +26,16 @@ namespace zfwmuduo
                      bool reuseport) : loop_(loop),
                                        acceptSocket_(createNonblocking()), // 1-创建socket套接字
                                        acceptChannel_(loop, acceptSocket_.fd()),
-                                       listenning_(false)
+                                       listenning_(false),
+                                       maxAcceptsPerWakeup_(64),
+                                       idleFd_(::open("/dev/null", O_RDONLY | O_CLOEXEC)),
+                                       paused_(false),
+                                       acceptedCount_(0),
+                                       failedCount_(0),
+                                       shedCount_(0)
   {
     acceptSocket_.setReuseAddr(true);
-    acceptSocket_.setReusePort(true);
+    acceptSocket_.setReusePort(reuseport); // 之前这里写死了true, TcpServer的Option形同虚设
     acceptSocket_.bindAddress(listenAddr); // 2-bind绑定socket
 
     //  baseloop --> acceptChannel_(listenfd) -->
@@ -32,35 +43,104 @@ namespace zfwmuduo
   }
 
   // listenfd有事件发生了, 就是有新用户连接了
+  // NOTE: listenfd是LT的, 一次只accept一个的话, 连接风暴时每个连接都要多走一轮epoll_wait;
+  // 这里一直accept到EAGAIN或者达到上限为止, 剩下的留给下一轮, 不会饿死其他channel
   void Acceptor::handleRead()
   {
-    InetAddress peerAddr; // 客户端的address, 客户端发起了连接
-    int connfd = acceptSocket_.accept(&peerAddr);
-    if (connfd >= 0)
-    { // TcpServer::start() Acceptor.listen() 有新用户的连接 要执行一个回调(connfd--> channel --> subloop)
-      if (newConnectionCallback_)
-      { // 轮询找到subloop, 唤醒, 分发当前的新客户端的cannel
-        newConnectionCallback_(connfd, peerAddr);
+    for (int i = 0; i < maxAcceptsPerWakeup_; ++i)
+    {
+      InetAddress peerAddr; // 客户端的address, 客户端发起了连接
+      int connfd = acceptSocket_.accept(&peerAddr);
+      if (connfd >= 0)
+      { // TcpServer::start() Acceptor.listen() 有新用户的连接 要执行一个回调(connfd--> channel --> subloop)
+        ++acceptedCount_;
+        if (newConnectionCallback_)
+        { // 轮询找到subloop, 唤醒, 分发当前的新客户端的cannel
+          newConnectionCallback_(connfd, peerAddr);
+        }
+        else // 如果新客户端来了却没有相应的回调, 说明根本没有办法服务客户端, 因此直接close()
+        {
+          ::close(connfd);
+        }
+        continue;
+      }
+
+      int savedErrno = errno;
+      if (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK)
+      { // 全连接队列已经取空了
+        break;
       }
-      else // 如果新客户端来了却没有相应的回调, 说明根本没有办法服务客户端, 因此直接close()
-      {
-        ::close(connfd);
+      ++failedCount_;
+      if (savedErrno == EINTR || savedErrno == ECONNABORTED || savedErrno == EPROTO)
+      { // 对端在accept之前就断开了之类的瞬时错误, 继续取下一个
+        continue;
       }
-    }
-    else // 出错
-    {
-      LOG_ERROR("%s:%s:%d accept errno:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
-      if (errno == EMFILE)
-      { // 警告调整当前进程文件描述符的上限
+      if (savedErrno == EMFILE || savedErrno == ENFILE)
+      { // TAG: 描述符耗尽时连接会一直留在队列里, LT下listenfd会一直可读, loop就会空转100%CPU;
+        // 先关掉预留的idleFd_腾出一个位置, 把连接accept下来立即关闭(客户端能立刻感知), 再把idleFd_占回来
         LOG_ERROR("%s:%s:%d sockfd reached limit \n", __FILE__, __FUNCTION__, __LINE__);
+        if (idleFd_ < 0)
+        { // 上一次没能把预留fd占回来, 再试一次
+          idleFd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+        }
+        if (idleFd_ < 0)
+        { // 腾不出位置就没法把连接接下来关掉, listenfd会一直可读; 暂停一会儿, 等其他连接释放描述符
+          pauseAccepting();
+          break;
+        }
+        ::close(idleFd_);
+        idleFd_ = ::accept(acceptSocket_.fd(), NULL, NULL);
+        if (idleFd_ >= 0)
+        {
+          ::close(idleFd_);
+          ++shedCount_;
+        }
+        idleFd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+        continue;
       }
+      LOG_ERROR("%s:%s:%d accept errno:%d \n", __FILE__, __FUNCTION__, __LINE__, savedErrno);
+      break;
     }
   }
 
+  void Acceptor::pauseAccepting()
+  {
+    LOG_ERROR("%s:%s:%d no reserve fd, pause accepting for %.1fs \n", __FILE__, __FUNCTION__, __LINE__, kPauseOnEmfileSeconds);
+    paused_ = true;
+    acceptChannel_.disableReading();
+    resumeTimer_ = loop_->runAfter(kPauseOnEmfileSeconds, std::bind(&Acceptor::resumeAccepting, this));
+  }
+
+  void Acceptor::resumeAccepting()
+  {
+    paused_ = false;
+    if (listenning_)
+    {
+      acceptChannel_.enableReading();
+    }
+  }
+
+  Acceptor::Stats Acceptor::stats() const
+  {
+    Stats stats;
+    stats.accepted = acceptedCount_;
+    stats.failed = failedCount_;
+    stats.shed = shedCount_;
+    return stats;
+  }
+
   Acceptor::~Acceptor()
   {
+    if (paused_)
+    {
+      loop_->cancel(resumeTimer_);
+    }
     acceptChannel_.disableAll();
     acceptChannel_.remove();
+    if (idleFd_ >= 0)
+    {
+      ::close(idleFd_);
+    }
   }
 
   void Acceptor::listen()
@@ -1,9 +1,12 @@
 #pragma once
 
 #include <functional> // function
+#include <atomic>
+#include <stdint.h>
 #include "../base/noncopyable.h"
 #include "Socket.h"
 #include "Channel.h"
+#include "TimerId.h"
 
 /**
  * Acceptor
@@ -19,6 +22,14 @@ namespace zfwmuduo
   public:
     typedef std::function<void(int sockfd, const InetAddress &)> NewConnectionCallback;
 
+    // accept相关的计数, 可以在任意线程读取
+    struct Stats
+    {
+      uint64_t accepted; // 成功accept并交给上层的连接数
+      uint64_t failed;   // accept失败的次数(EAGAIN不算)
+      uint64_t shed;     // 描述符耗尽时, 借用预留fd接受后立刻关闭的连接数
+    };
+
     Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reuseport);
     ~Acceptor();
 
@@ -26,17 +37,33 @@ namespace zfwmuduo
     // void setNewConnectionCallback(const NewConnectionCallback &cb) { newConnectionCallback_ = cb; }
     void setNewConnectionCallback(NewConnectionCallback &&cb) { newConnectionCallback_ = std::move(cb); }
 
+    EventLoop *getLoop() const { return loop_; }
     bool listenning() const { return listenning_; }
     void listen();
 
+    // 每次listenfd可读时最多连续accept多少个连接, 防止连接风暴时饿死其他事件; 默认64
+    void setMaxAcceptsPerWakeup(int n) { maxAcceptsPerWakeup_ = n > 0 ? n : 1; }
+    Stats stats() const;
+
   private:
     void handleRead();
+    void pauseAccepting();
+    void resumeAccepting();
 
     EventLoop *loop_;       // 相当于mainloop/baseloop
     Socket acceptSocket_;   // listenfd的封装
     Channel acceptChannel_; // 提供相关Poller操作
     NewConnectionCallback newConnectionCallback_;
     bool listenning_;
+
+    int maxAcceptsPerWakeup_;
+    int idleFd_; // 预留的空闲fd(/dev/null), EMFILE时用它腾出一个位置把连接接下来再关掉
+    bool paused_;         // 预留fd也拿不到时暂时停止监听listenfd的可读事件
+    TimerId resumeTimer_; // 到时重新监听
+
+    std::atomic<uint64_t> acceptedCount_;
+    std::atomic<uint64_t> failedCount_;
+    std::atomic<uint64_t> shedCount_;
   };
 
 } // namespace zfwmuduo
\ No newline at end of file
@@ -2,16 +2,35 @@
 #include <errno.h>
 #include <sys/uio.h> // ::readv()
 #include <unistd.h>  // ::write()
+#include <sys/ioctl.h> // ::ioctl() FIONREAD
 
 namespace zfwmuduo
 {
+  // NOTE: 每个线程(即每个loop)一块复用的暂存区; 原来每次readFd都在栈上 = {0} 一个64K数组, 每次读都要memset 64K
+  static __thread char t_extrabuf[65536];
+
   /**
    * 从fd上读取数据  Poller工作在LT模式
    * Buffer缓冲区是有大小的！！但从fd上读数据时，却不知道tcp数据最终的大小
    */
   ssize_t Buffer::readFd(int fd, int *saveErrno)
   {
-    char extrabuf[65536] = {0}; // 64K 栈上的内存空间!!注意为什么！！栈分配空间快且编译器自动回收！
+    // 先按预测(或者FIONREAD查到)的大小预留空间, 数据尽量直接读进Buffer, 省掉从暂存区再拷贝一次
+    size_t expected = recvSize_.nextReadSize();
+    if (probeReadable_)
+    {
+      int available = 0;
+      if (::ioctl(fd, FIONREAD, &available) == 0 && available > 0)
+        expected = available;
+    }
+    // NOTE: 预留量要落在预测值对应的规格里: 直接ensureWritableBytes(64K)会申请kCheapPrepend + 64K,
+    // 被内存池取整成128K的块, 忙碌连接的接收缓冲区平白翻倍; 超出规格的部分由t_extrabuf兜底
+    const size_t target = BufferPool::roundUp(expected);
+    const size_t used = kCheapPrepend + readableBytes();
+    if (target > used)
+      ensureWritableBytes(target - used);
+
+    char *extrabuf = t_extrabuf;
     // NOTE: iovec 是一个在 POSIX 标准中定义的结构体，用于表示分散/聚合（scatter/gather）I/O 操作中的内存区域。
     /**
      * 它通常用于高效的 I/O 操作，比如 readv() 和 writev()，
@@ -26,29 +45,91 @@ namespace zfwmuduo
 
     // 第二块缓冲区(如果上面填满, 会将余下的自动填入当中)
     vec[1].iov_base = extrabuf;
-    vec[0].iov_len = sizeof extrabuf;
+    vec[1].iov_len = sizeof t_extrabuf;
 
-    const int iovcnt = (writable < sizeof extrabuf) ? 2 : 1;
+    const int iovcnt = (writable < sizeof t_extrabuf) ? 2 : 1;
     const ssize_t n = ::readv(fd, vec, iovcnt);
     if (n < 0)
     {
       *saveErrno = errno;
+      return n;
     }
-    else if (n <= writable) // Buffer的科协缓冲区已经够存储读出来的数据了
+    recvSize_.record(n);
+    if (n <= writable) // Buffer的科协缓冲区已经够存储读出来的数据了
     {
       writeIndex_ += n;
     }
     else // extrabuf里面也写入了数据
     {
-      writeIndex_ = buffer_.size();
+      writeIndex_ = capacity_;
       append(extrabuf, n - writable); // writeIndex_开始写 n-writable大小的数据
     }
     return n;
   }
 
-  ssize_t Buffer::writeFd(int fd, int *saveErrno)
+  /**
+   * 从fd上读取数据  Poller工作在ET模式
+   * 一次通知之后内核不会再提醒剩余的数据, 所以必须一直读到EAGAIN
+   */
+  ssize_t Buffer::readFdUntilEagain(int fd, int *saveErrno, bool *peerClosed)
+  {
+    ssize_t total = 0;
+    *peerClosed = false;
+    for (;;)
+    {
+      int err = 0;
+      ssize_t n = readFd(fd, &err);
+      if (n > 0)
+      {
+        total += n;
+      }
+      else if (n == 0)
+      {
+        *peerClosed = true;
+        break;
+      }
+      else if (err == EINTR)
+      {
+        continue;
+      }
+      else
+      {
+        if (err != EAGAIN && err != EWOULDBLOCK)
+        { // NOTE: 前面读到过数据也要把错误报上去, ET模式下这个连接不会再有下一次通知了
+          *saveErrno = err;
+          if (total == 0)
+            return -1;
+        }
+        break;
+      }
+    }
+    return total;
+  }
+
+  void Buffer::shrink(size_t reserve)
+  {
+    size_t readable = readableBytes();
+    if (readable == 0 && reserve == 0)
+    {
+      release();
+      return;
+    }
+    if (!hasStorage() || BufferPool::roundUp(kCheapPrepend + readable + reserve) >= capacity_)
+      return;
+
+    size_t capacity = 0;
+    char *block = BufferPool::allocate(kCheapPrepend + readable + reserve, &capacity);
+    std::copy(peek(), peek() + readable, block + kCheapPrepend);
+    BufferPool::deallocate(buffer_, capacity_);
+    buffer_ = block;
+    capacity_ = capacity;
+    readerIndex_ = kCheapPrepend;
+    writeIndex_ = readerIndex_ + readable;
+  }
+
+  ssize_t Buffer::writeFd(int fd, int *saveErrno, size_t maxBytes)
   {
-    ssize_t n = ::write(fd, peek(), readableBytes());
+    ssize_t n = ::write(fd, peek(), std::min(maxBytes, readableBytes()));
     if (n < 0)
     {
       *saveErrno = errno;
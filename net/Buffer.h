@@ -1,9 +1,12 @@
 #pragma once
 
-#include <vector>
 #include <string>
 #include <algorithm> // copy()
+#include <utility>   // swap()
+#include <sys/types.h> // ssize_t
 #include "../base/noncopyable.h"
+#include "BufferPool.h"
+#include "RecvSizePredictor.h"
 
 /**
  * 网络库底层的缓冲区类型定义
@@ -27,15 +30,33 @@ namespace zfwmuduo
 
   public:
     static const size_t kCheapPrepend = 8;   // 前面记录数据包的长度 prependable bytes
-    static const size_t kInitialSize = 1024; // 后边缓冲区的大小
+    static const size_t kInitialSize = 1016; // 后边缓冲区的大小, 加上kCheapPrepend正好是内存池的最小规格1KB
 
-    explicit Buffer(size_t initialSize = kInitialSize) : buffer_(kCheapPrepend + initialSize),
+    // NOTE: 底层存储是懒分配的: 构造时不分配, 第一次需要保存数据时才从BufferPool取,
+    // 至少kCheapPrepend + initialSize(按规格取整); 大量空闲连接的收发缓冲区不占内存
+    explicit Buffer(size_t initialSize = kInitialSize) : capacity_(kCheapPrepend),
+                                                         buffer_(emptyStorage()),
+                                                         initialSize_(initialSize),
                                                          readerIndex_(kCheapPrepend),
-                                                         writeIndex_(kCheapPrepend) {}
+                                                         writeIndex_(kCheapPrepend),
+                                                         probeReadable_(false) {}
+    ~Buffer() { release(); }
+
+    // 交换两个Buffer的存储和读写位置, 不拷贝数据; 接收大小的预测等属于连接的状态不交换
+    void swap(Buffer &rhs)
+    {
+      std::swap(capacity_, rhs.capacity_);
+      std::swap(buffer_, rhs.buffer_);
+      std::swap(initialSize_, rhs.initialSize_);
+      std::swap(readerIndex_, rhs.readerIndex_);
+      std::swap(writeIndex_, rhs.writeIndex_);
+    }
 
     size_t readableBytes() const { return writeIndex_ - readerIndex_; }
-    size_t writeableBytes() const { return buffer_.size() - writeIndex_; }
+    size_t writeableBytes() const { return capacity_ - writeIndex_; }
     size_t prependableBytes() const { return readerIndex_; }
+    size_t internalCapacity() const { return hasStorage() ? capacity_ : 0; } // 底层存储实际占用的字节数
+    bool hasStorage() const { return buffer_ != emptyStorage(); }
 
     // 返回缓冲区中, 可读数据的其实地址
     const char *peek() const { return begin() + readerIndex_; }
@@ -69,7 +90,7 @@ namespace zfwmuduo
       return result;
     }
 
-    // buffer_.size() - writeIndex_    len
+    // capacity_ - writeIndex_    len
     // 确保读缓冲区空间足够
     void ensureWritableBytes(size_t len)
     {
@@ -96,20 +117,50 @@ namespace zfwmuduo
       return begin() + writeIndex_;
     }
 
+    // 把底层存储缩小到刚好容纳可读数据 + reserve字节可写空间的规格, 多出来的还给内存池; 规格不变小则什么也不做
+    // 没有可读数据且reserve为0时, 整块存储都还回去
+    void shrink(size_t reserve);
+    // 没有可读数据时把存储还给内存池, 回到构造时未分配的状态
+    void releaseIfEmpty()
+    {
+      if (readableBytes() == 0)
+        release();
+    }
+
     // TAG: [值得借鉴] 从fd上读取数据
+    // 按最近几次读到的大小预留可写空间, 多出来的部分先落到线程私有的暂存区再追加进来
     ssize_t readFd(int fd, int *saveErrno);
+    // 读之前先用ioctl(FIONREAD)查询socket中可读的字节数, 按它预留空间; 多一次系统调用, 适合消息大小变化剧烈的连接
+    void setProbeReadable(bool on) { probeReadable_ = on; }
+    // 预测的下一次读的大小, 收缩接收缓冲区时作为预留量, 避免下一次读又立刻扩容
+    size_t nextReadSize() const { return recvSize_.nextReadSize(); }
+    // ET模式: 反复readFd直到EAGAIN, 返回读到的总字节数(出错且一个字节都没读到时返回-1), 对端关闭时*peerClosed=true
+    // 读到数据之后才出错(比如ECONNRESET)时返回读到的字节数, 同时*saveErrno记录错误, 调用者要检查; EAGAIN不算错误
+    ssize_t readFdUntilEagain(int fd, int *saveErrno, bool *peerClosed);
 
     // 通过fd发送数据
-    ssize_t writeFd(int fd, int *saveErrno);
+    ssize_t writeFd(int fd, int *saveErrno) { return writeFd(fd, saveErrno, readableBytes()); }
+    // 最多发送maxBytes字节
+    ssize_t writeFd(int fd, int *saveErrno, size_t maxBytes);
 
   private:
-    char *begin()
+    char *begin() { return buffer_; }
+    const char *begin() const { return buffer_; }
+
+    // 未分配存储时buffer_指向的占位区, 只有kCheapPrepend字节, 永远不会被写入
+    static char *emptyStorage()
     {
-      // vector底层数组首元素的地址, 即数组的起始地址
-      //  1. it.operator*()取值   2.operator&()取地址
-      return &*buffer_.begin();
+      static char storage[kCheapPrepend];
+      return storage;
+    }
+    void release()
+    {
+      if (hasStorage())
+        BufferPool::deallocate(buffer_, capacity_);
+      buffer_ = emptyStorage();
+      capacity_ = kCheapPrepend;
+      readerIndex_ = writeIndex_ = kCheapPrepend;
     }
-    const char *begin() const { return &*buffer_.begin(); }
     char *beginWrite() { return begin() + writeIndex_; }
     const char *beginWrite() const { return begin() + writeIndex_; }
 
@@ -124,8 +175,22 @@ namespace zfwmuduo
        * kCheapPrepend  |                   len                        |
        */
       if (writeableBytes() + prependableBytes() < len + kCheapPrepend) // 可写部分 + 空闲部分 < 期待长度len + 首部长
-      {
-        buffer_.resize(writeIndex_ + len);
+      { // 从内存池换一块更大的, 只搬运可读数据(已读部分顺便腾掉), 旧块还给内存池; 不像vector::resize那样清零
+        size_t readable = readableBytes();
+        size_t capacity = 0;
+        // NOTE: 至少按可读数据的两倍扩容; 超过kMaxBlockSize的块不再按规格取整, 只按需要的大小分配的话,
+        // 持续追加的大缓冲区每次append都要整体拷贝一遍, 退化成O(n^2)
+        size_t size = std::max(kCheapPrepend + readable + len, kCheapPrepend + 2 * readable);
+        char *block = BufferPool::allocate(std::max(size, kCheapPrepend + initialSize_), &capacity);
+        std::copy(begin() + readerIndex_,
+                  begin() + writeIndex_,
+                  block + kCheapPrepend);
+        if (hasStorage())
+          BufferPool::deallocate(buffer_, capacity_);
+        buffer_ = block;
+        capacity_ = capacity;
+        readerIndex_ = kCheapPrepend;
+        writeIndex_ = readerIndex_ + readable;
       }
       else
       { // 将剩余读缓冲区(还未读部分)的数据区域挪到空闲部分(已读部分), 给写缓冲区腾位置 (也就是将已读部分区域腾掉)
@@ -138,9 +203,14 @@ namespace zfwmuduo
       }
     }
 
-    std::vector<char> buffer_;
+    size_t capacity_;    // buffer_的实际大小
+    char *buffer_;       // 从BufferPool分配的存储, 未分配时指向emptyStorage()
+    size_t initialSize_; // 第一次分配时至少预留的可写空间
     size_t readerIndex_; // 数据可读下标
     size_t writeIndex_;  // 数据可写下标
+
+    RecvSizePredictor recvSize_; // 作为接收缓冲区时, 预测下一次读的大小
+    bool probeReadable_;
   };
 
 } // namespace zfwmuduo
\ No newline at end of file
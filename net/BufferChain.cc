@@ -0,0 +1,149 @@
+#include "BufferChain.h"
+#include <errno.h>
+#include <limits.h>  // IOV_MAX
+#include <string.h>  // memcpy()
+#include <sys/uio.h> // ::writev()
+#include <sys/socket.h> // ::sendmsg()
+#include <algorithm> // min()
+
+namespace zfwmuduo
+{
+  BufferChain::BufferChain() : readableBytes_(0),
+                               tailUsed_(kBlockSize),
+                               bytesCopied_(0),
+                               liveBlocks_(std::make_shared<std::atomic<size_t>>(0))
+  {
+  }
+
+  void BufferChain::append(const char *data, size_t len)
+  {
+    bytesCopied_ += len;
+    while (len > 0)
+    {
+      if (tailUsed_ == kBlockSize) // 当前块写满了(或者还没有块), 分配一块新的
+      {
+        std::shared_ptr<std::atomic<size_t>> liveBlocks = liveBlocks_;
+        tail_.reset(new char[kBlockSize], [liveBlocks](char *block)
+                    {
+                      delete[] block;
+                      --*liveBlocks; });
+        ++*liveBlocks_;
+        tailUsed_ = 0;
+      }
+      size_t n = std::min(len, kBlockSize - tailUsed_);
+      char *dest = tail_.get() + tailUsed_;
+      ::memcpy(dest, data, n);
+
+      // NOTE: 紧接在最后一段后面写入时直接延长该段, 连续的小块append不会产生大量的段
+      if (!segments_.empty() &&
+          segments_.back().data.get() == tail_.get() &&
+          segments_.back().begin + segments_.back().len == dest)
+      {
+        segments_.back().len += n;
+      }
+      else
+      {
+        Segment segment = {tail_, dest, n};
+        segments_.push_back(segment);
+      }
+
+      tailUsed_ += n;
+      readableBytes_ += n;
+      data += n;
+      len -= n;
+    }
+  }
+
+  void BufferChain::append(const std::shared_ptr<const char> &data, size_t len)
+  {
+    if (len == 0)
+      return;
+    Segment segment = {data, data.get(), len};
+    segments_.push_back(segment);
+    readableBytes_ += len;
+  }
+
+  void BufferChain::append(std::string &&data)
+  {
+    if (data.empty())
+      return;
+    std::shared_ptr<std::string> owner = std::make_shared<std::string>(std::move(data));
+    // NOTE: 别名构造, 共享owner的引用计数, 但指向string内部的字符数组
+    append(std::shared_ptr<const char>(owner, owner->data()), owner->size());
+  }
+
+  void BufferChain::retrieve(size_t len, std::vector<std::shared_ptr<const char>> *pinned)
+  {
+    while (len > 0 && !segments_.empty())
+    {
+      Segment &front = segments_.front();
+      if (pinned)
+        pinned->push_back(front.data);
+      if (len < front.len)
+      {
+        front.begin += len;
+        front.len -= len;
+        readableBytes_ -= len;
+        return;
+      }
+      len -= front.len;
+      readableBytes_ -= front.len;
+      segments_.pop_front(); // 最后一个引用被释放时, 块/用户内存随之释放
+    }
+  }
+
+  void BufferChain::retrieveAll()
+  {
+    segments_.clear();
+    readableBytes_ = 0;
+  }
+
+  void BufferChain::releaseTail()
+  {
+    tail_.reset();
+    tailUsed_ = kBlockSize;
+  }
+
+  int BufferChain::fillIovec(struct iovec *vec, size_t maxBytes) const
+  {
+    int iovcnt = 0;
+    for (std::deque<Segment>::const_iterator it = segments_.begin();
+         it != segments_.end() && iovcnt < IOV_MAX && maxBytes > 0; ++it, ++iovcnt)
+    {
+      vec[iovcnt].iov_base = const_cast<char *>(it->begin);
+      vec[iovcnt].iov_len = std::min(it->len, maxBytes);
+      maxBytes -= vec[iovcnt].iov_len;
+    }
+    return iovcnt;
+  }
+
+  ssize_t BufferChain::writeFd(int fd, int *saveErrno, size_t maxBytes) const
+  {
+    struct iovec vec[IOV_MAX];
+    int iovcnt = fillIovec(vec, maxBytes);
+
+    ssize_t n = ::writev(fd, vec, iovcnt);
+    if (n < 0)
+    {
+      *saveErrno = errno;
+    }
+    return n;
+  }
+
+  ssize_t BufferChain::sendZeroCopy(int fd, int *saveErrno, size_t maxBytes) const
+  {
+    struct iovec vec[IOV_MAX];
+    struct msghdr msg;
+    ::memset(&msg, 0, sizeof msg);
+    msg.msg_iov = vec;
+    msg.msg_iovlen = fillIovec(vec, maxBytes);
+
+    ssize_t n = ::sendmsg(fd, &msg, MSG_ZEROCOPY | MSG_NOSIGNAL);
+    if (n < 0)
+    {
+      *saveErrno = errno;
+    }
+    return n;
+  }
+
+} // namespace zfwmuduo
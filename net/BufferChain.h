@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <memory> // shared_ptr
+#include <string>
+#include <vector>
+#include <sys/types.h> // ssize_t
+#include <sys/uio.h>   // iovec
+#include "../base/noncopyable.h"
+
+/**
+ * BufferChain: 分段的发送缓冲区, 由一串引用计数的内存块组成
+ *
+ * Buffer是一整块连续的vector, 大响应写不完时要整体拷贝进去, 扩容时还要resize/memmove;
+ * BufferChain中的每一段只是某块内存的一个[begin, begin+len)视图:
+ * - append(data, len)拷贝到固定大小(kBlockSize)的内部块中, 写满了就再分配一块, 已有数据永远不会被挪动
+ * - append(shared_ptr, len)直接引用用户的内存, 不拷贝; 用户内存在该段发送完之前由shared_ptr保持存活
+ * - writeFd一次writev最多IOV_MAX段
+ *
+ * 只在连接所属的loop线程中使用
+ */
+
+namespace zfwmuduo
+{
+  class BufferChain : noncopyable
+  {
+  public:
+    static const size_t kBlockSize = 16 * 1024; // 内部块的大小
+
+    BufferChain();
+
+    size_t readableBytes() const { return readableBytes_; }
+    size_t segmentCount() const { return segments_.size(); }
+    // 内部块占用的内存, 零拷贝引用的用户内存不计入; 还有段(或者等待MSG_ZEROCOPY确认的发送)引用的块都算在内
+    size_t internalCapacity() const { return *liveBlocks_ * kBlockSize; }
+
+    // 拷贝data到内部块
+    void append(const char *data, size_t len);
+    // 零拷贝: 引用[data.get(), data.get()+len), 可以用shared_ptr的别名构造指向任意对象内部的数据
+    void append(const std::shared_ptr<const char> &data, size_t len);
+    // 零拷贝: 接管string的所有权
+    void append(std::string &&data);
+
+    // 丢弃最前面的len字节(已发送)
+    void retrieve(size_t len) { retrieve(len, nullptr); }
+    // 同上, 并把这len字节所在内存的引用追加到pinned中; MSG_ZEROCOPY发送的数据要等内核确认之后才能释放
+    void retrieve(size_t len, std::vector<std::shared_ptr<const char>> *pinned);
+    void retrieveAll();
+    // 释放还在写入的内部块(没有段引用它时才真正释放内存)
+    void releaseTail();
+
+    // 用writev把尽可能多的段发送出去, 不会retrieve, 与Buffer::writeFd的约定一致
+    ssize_t writeFd(int fd, int *saveErrno) const { return writeFd(fd, saveErrno, readableBytes_); }
+    // 最多发送maxBytes字节
+    ssize_t writeFd(int fd, int *saveErrno, size_t maxBytes) const;
+    // 同writeFd, 但用sendmsg(MSG_ZEROCOPY)发送, 内核直接引用段的内存而不拷贝; socket需要先设置SO_ZEROCOPY
+    // NOTE: 已经追加的数据永远不会被挪动或覆盖, 所以任何段都可以零拷贝发送, 只要在内核确认之前保持引用
+    ssize_t sendZeroCopy(int fd, int *saveErrno, size_t maxBytes) const;
+
+    // 累计拷贝进内部块的字节数, 用于衡量每发送一个字节的拷贝开销
+    size_t bytesCopied() const { return bytesCopied_; }
+
+  private:
+    // 从头开始用最多maxBytes字节的段填充vec, 返回段数
+    int fillIovec(struct iovec *vec, size_t maxBytes) const;
+
+    struct Segment
+    {
+      std::shared_ptr<const char> data; // 引用整块内存, 或通过别名构造引用其中一部分
+      const char *begin;                // 未发送数据的起始地址
+      size_t len;                       // 未发送数据的长度
+    };
+
+    std::deque<Segment> segments_;
+    size_t readableBytes_;
+
+    std::shared_ptr<char> tail_; // 正在写入的内部块, 它的前tailUsed_字节已经被某个段引用
+    size_t tailUsed_;
+    size_t bytesCopied_;
+    // 还没释放的内部块数: 分配时加1, 块的最后一个引用释放时(由删除器)减1;
+    // 块可能比BufferChain活得久(retrieve到pinned中的块), 所以计数也用shared_ptr
+    std::shared_ptr<std::atomic<size_t>> liveBlocks_;
+  };
+
+} // namespace zfwmuduo
@@ -0,0 +1,299 @@
+#include "BufferPool.h"
+#include <stdlib.h> // malloc(), free()
+#include <atomic>
+#include <new> // bad_alloc
+#include <mutex>
+#include <set>
+
+namespace zfwmuduo
+{
+  namespace
+  {
+    const size_t kThreadCacheBytesPerClass = 256 * 1024;  // 每个线程每种规格最多缓存的字节数
+    const size_t kGlobalBytesPerClass = 8 * 1024 * 1024;  // 全局每种规格最多缓存的字节数
+    const size_t kMaxBatch = 32;                          // 线程缓存和全局链表之间一次最多搬多少块
+
+    size_t classSize(int index) { return BufferPool::kMinBlockSize << index; }
+
+    int classIndex(size_t size)
+    {
+      int index = 0;
+      while (classSize(index) < size)
+        ++index;
+      return index;
+    }
+
+    // 和原来std::vector<char>扩容一样, 内存耗尽时抛std::bad_alloc, 不能把空指针交给Buffer去拷贝
+    char *systemAlloc(size_t size)
+    {
+      char *block = static_cast<char *>(::malloc(size));
+      if (!block)
+        throw std::bad_alloc();
+      return block;
+    }
+
+    size_t threadLimit(int index)
+    {
+      size_t n = kThreadCacheBytesPerClass / classSize(index);
+      return n < 2 ? 2 : n;
+    }
+
+    size_t globalLimit(int index)
+    {
+      size_t n = kGlobalBytesPerClass / classSize(index);
+      return n < 8 ? 8 : n;
+    }
+
+    // 侵入式单链表, next指针存放在空闲块的开头
+    struct FreeList
+    {
+      char *head;
+      size_t count;
+
+      void push(char *block)
+      {
+        *reinterpret_cast<char **>(block) = head;
+        head = block;
+        ++count;
+      }
+      char *pop()
+      {
+        char *block = head;
+        head = *reinterpret_cast<char **>(block);
+        --count;
+        return block;
+      }
+    };
+
+    // NOTE: 只有所属线程写, 其他线程只在stats()时读; 用relaxed的load+store代替fetch_add, 不需要lock前缀
+    void bump(std::atomic<uint64_t> &counter)
+    {
+      counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    struct ThreadCache;
+
+    struct GlobalPool
+    {
+      std::mutex mutex;
+      FreeList lists[BufferPool::kNumClasses];
+      std::set<ThreadCache *> caches; // 用于汇总统计
+      BufferPool::Stats retired;      // 已退出线程的统计
+      std::atomic_bool enabled;
+
+      GlobalPool() : enabled(true)
+      {
+        for (int i = 0; i < BufferPool::kNumClasses; ++i)
+        {
+          lists[i].head = nullptr;
+          lists[i].count = 0;
+        }
+        retired = BufferPool::Stats();
+      }
+    };
+
+    // TAG: 故意不析构, 其他静态对象/线程退出时归还的块仍然可以安全地放回来
+    GlobalPool &global()
+    {
+      static GlobalPool *pool = new GlobalPool;
+      return *pool;
+    }
+
+    // 把多余的块还给全局链表, 全局链表也满了的直接free; 调用方持有global().mutex
+    void releaseToGlobal(int index, FreeList &from, size_t n, std::atomic<uint64_t> *systemFrees)
+    {
+      FreeList &to = global().lists[index];
+      for (size_t i = 0; i < n && from.head; ++i)
+      {
+        char *block = from.pop();
+        if (to.count < globalLimit(index))
+        {
+          to.push(block);
+        }
+        else
+        {
+          ::free(block);
+          if (systemFrees)
+            bump(*systemFrees);
+        }
+      }
+    }
+
+    __thread bool t_cacheDestroyed = false;
+
+    struct ThreadCache
+    {
+      FreeList lists[BufferPool::kNumClasses];
+      std::atomic<uint64_t> allocations;
+      std::atomic<uint64_t> threadCacheHits;
+      std::atomic<uint64_t> globalHits;
+      std::atomic<uint64_t> systemAllocs;
+      std::atomic<uint64_t> frees;
+      std::atomic<uint64_t> systemFrees;
+
+      ThreadCache() : allocations(0), threadCacheHits(0), globalHits(0),
+                      systemAllocs(0), frees(0), systemFrees(0)
+      {
+        for (int i = 0; i < BufferPool::kNumClasses; ++i)
+        {
+          lists[i].head = nullptr;
+          lists[i].count = 0;
+        }
+        std::lock_guard<std::mutex> lock(global().mutex);
+        global().caches.insert(this);
+      }
+
+      // 线程退出: 缓存的块全部还给全局链表, 统计并入retired
+      ~ThreadCache()
+      {
+        std::lock_guard<std::mutex> lock(global().mutex);
+        for (int i = 0; i < BufferPool::kNumClasses; ++i)
+        {
+          releaseToGlobal(i, lists[i], lists[i].count, &systemFrees);
+        }
+        BufferPool::Stats &retired = global().retired;
+        retired.allocations += allocations;
+        retired.threadCacheHits += threadCacheHits;
+        retired.globalHits += globalHits;
+        retired.systemAllocs += systemAllocs;
+        retired.frees += frees;
+        retired.systemFrees += systemFrees;
+        global().caches.erase(this);
+        t_cacheDestroyed = true;
+      }
+    };
+
+    thread_local ThreadCache t_cache;
+  } // namespace
+
+  char *BufferPool::allocate(size_t size, size_t *capacity)
+  {
+    if (size > kMaxBlockSize)
+    { // 超大的块不缓存
+      *capacity = size;
+      if (!t_cacheDestroyed)
+      {
+        bump(t_cache.allocations);
+        bump(t_cache.systemAllocs);
+      }
+      return systemAlloc(size);
+    }
+
+    int index = classIndex(size);
+    *capacity = classSize(index);
+    if (t_cacheDestroyed || !global().enabled.load(std::memory_order_relaxed))
+    {
+      if (!t_cacheDestroyed)
+      {
+        bump(t_cache.allocations);
+        bump(t_cache.systemAllocs);
+      }
+      return systemAlloc(*capacity);
+    }
+
+    ThreadCache &cache = t_cache;
+    bump(cache.allocations);
+    FreeList &list = cache.lists[index];
+    if (list.head)
+    {
+      bump(cache.threadCacheHits);
+      return list.pop();
+    }
+
+    { // 线程缓存空了, 从全局链表批量补充
+      std::lock_guard<std::mutex> lock(global().mutex);
+      FreeList &shared = global().lists[index];
+      size_t batch = threadLimit(index) / 2;
+      if (batch > kMaxBatch)
+        batch = kMaxBatch;
+      for (size_t i = 0; i < batch && shared.head; ++i)
+      {
+        list.push(shared.pop());
+      }
+    }
+    if (list.head)
+    {
+      bump(cache.globalHits);
+      return list.pop();
+    }
+
+    bump(cache.systemAllocs);
+    return systemAlloc(*capacity);
+  }
+
+  void BufferPool::deallocate(char *block, size_t capacity)
+  {
+    if (!block)
+      return;
+
+    if (capacity > kMaxBlockSize || !global().enabled.load(std::memory_order_relaxed))
+    {
+      if (!t_cacheDestroyed)
+      {
+        bump(t_cache.frees);
+        bump(t_cache.systemFrees);
+      }
+      ::free(block);
+      return;
+    }
+
+    int index = classIndex(capacity);
+    if (t_cacheDestroyed)
+    { // 线程的缓存已经析构(线程退出阶段), 直接还给全局链表
+      std::lock_guard<std::mutex> lock(global().mutex);
+      FreeList single = {nullptr, 0};
+      single.push(block);
+      releaseToGlobal(index, single, 1, nullptr);
+      return;
+    }
+
+    ThreadCache &cache = t_cache;
+    bump(cache.frees);
+    FreeList &list = cache.lists[index];
+    list.push(block);
+    if (list.count > threadLimit(index))
+    { // 线程缓存超过上限, 还一半给全局链表
+      std::lock_guard<std::mutex> lock(global().mutex);
+      releaseToGlobal(index, list, list.count / 2, &cache.systemFrees);
+    }
+  }
+
+  size_t BufferPool::roundUp(size_t size)
+  {
+    return size > kMaxBlockSize ? size : classSize(classIndex(size));
+  }
+
+  void BufferPool::setEnabled(bool on)
+  {
+    global().enabled = on;
+  }
+
+  bool BufferPool::enabled()
+  {
+    return global().enabled;
+  }
+
+  BufferPool::Stats BufferPool::stats()
+  {
+    std::lock_guard<std::mutex> lock(global().mutex);
+    Stats total = global().retired;
+    for (ThreadCache *cache : global().caches)
+    {
+      total.allocations += cache->allocations.load(std::memory_order_relaxed);
+      total.threadCacheHits += cache->threadCacheHits.load(std::memory_order_relaxed);
+      total.globalHits += cache->globalHits.load(std::memory_order_relaxed);
+      total.systemAllocs += cache->systemAllocs.load(std::memory_order_relaxed);
+      total.frees += cache->frees.load(std::memory_order_relaxed);
+      total.systemFrees += cache->systemFrees.load(std::memory_order_relaxed);
+    }
+    total.globalBlocks = 0;
+    total.globalBytes = 0;
+    for (int i = 0; i < kNumClasses; ++i)
+    {
+      total.globalBlocks += global().lists[i].count;
+      total.globalBytes += global().lists[i].count * classSize(i);
+    }
+    return total;
+  }
+
+} // namespace zfwmuduo
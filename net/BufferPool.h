@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stddef.h> // size_t
+#include <stdint.h>
+#include "../base/noncopyable.h"
+
+/**
+ * BufferPool: Buffer底层存储的内存池
+ *
+ * 按2的幂分成若干规格(1KB ~ 1MB), 申请的大小向上取整到规格大小, 更大的直接走malloc
+ * - 每个线程(one loop per thread, 即每个loop)有自己的空闲链表, 分配/回收不加锁
+ * - 线程缓存超过上限时, 把一半还给全局链表(加锁); 线程缓存为空时, 从全局链表批量取一些
+ * - 全局链表也超过上限时才真正free给系统
+ *
+ * 空闲块的前8个字节用来存放链表的next指针
+ */
+
+namespace zfwmuduo
+{
+  class BufferPool : noncopyable
+  {
+  public:
+    static const size_t kMinBlockSize = 1024;
+    static const size_t kMaxBlockSize = 1024 * 1024;
+    static const int kNumClasses = 11; // 1KB, 2KB, ... , 1MB
+
+    struct Stats
+    {
+      uint64_t allocations;     // 分配次数
+      uint64_t threadCacheHits; // 直接从线程缓存拿到
+      uint64_t globalHits;      // 从全局链表补充到线程缓存后拿到
+      uint64_t systemAllocs;    // 走了malloc(包括超过kMaxBlockSize的)
+      uint64_t frees;           // 回收次数
+      uint64_t systemFrees;     // 真正free给系统的次数
+      uint64_t globalBlocks;    // 全局链表中缓存的块数
+      uint64_t globalBytes;     // 全局链表中缓存的字节数
+    };
+
+    // 分配至少size字节, *capacity返回实际的块大小, 释放时必须原样传回
+    static char *allocate(size_t size, size_t *capacity);
+    static void deallocate(char *block, size_t capacity);
+    // allocate(size)实际会分配的块大小
+    static size_t roundUp(size_t size);
+
+    // 关闭后不再使用任何缓存, 每次都直接malloc/free(仍然按规格取整), 用于和glibc malloc对比; 可以随时切换
+    static void setEnabled(bool on);
+    static bool enabled();
+
+    // 所有线程的统计之和, 线程缓存中的块数不计入global*
+    static Stats stats();
+
+  private:
+    BufferPool();
+  };
+
+} // namespace zfwmuduo
@@ -23,4 +23,6 @@ namespace zfwmuduo
                              Timestamp)>
       MessageCallback;
   typedef std::function<void(const TcpConnectionPtr &, size_t)> HighWaterMarkCallback;
+
+  typedef std::function<void()> TimerCallback; // 定时器回调
 } // namespace zfwmuduo
\ No newline at end of file
@@ -10,7 +10,7 @@ namespace zfwmuduo
   const int Channel::kWriteEvent = EPOLLOUT;          // 写事件
 
   // EventLoop：ChannelList + Poller ("孩子之间无法直接访问, 需要通过父亲间接沟通")
-  Channel::Channel(EventLoop *loop, int fd) : loop_(loop), fd_(fd), events_(0), revents_(0), index_(-1), tied_(false) {}
+  Channel::Channel(EventLoop *loop, int fd) : loop_(loop), fd_(fd), events_(0), revents_(0), index_(-1), edgeTriggered_(false), tied_(false) {}
 
   Channel::~Channel()
   {
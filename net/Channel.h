@@ -65,6 +65,21 @@ namespace zfwmuduo
       events_ = kNoneEvent;
       update();
     }
+    // 一次epoll_ctl同时注册读写事件, ET模式下写事件是常驻的
+    void enableReadingAndWriting()
+    {
+      events_ |= kReadEvent | kWriteEvent;
+      update();
+    }
+
+    // 边沿触发(EPOLLET), 默认是水平触发; 已注册的channel修改后会立即更新到poller
+    void setEdgeTriggered(bool on)
+    {
+      edgeTriggered_ = on;
+      if (!isNoneEvent())
+        update();
+    }
+    bool isEdgeTriggered() const { return edgeTriggered_; }
 
     // 返回fd当前的事件状态
     bool isNoneEvent() const { return events_ == kNoneEvent; }
@@ -92,6 +107,7 @@ namespace zfwmuduo
     int events_;      // 注册fd感兴趣的事件
     int revents_;     // poller返回的具体发生的事件
     int index_;
+    bool edgeTriggered_; // 是否以EPOLLET方式注册
 
     // NOTE：weak_ptr 解决循环引用问题
     std::weak_ptr<void> tie_;
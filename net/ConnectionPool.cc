@@ -0,0 +1,312 @@
+#include "ConnectionPool.h"
+#include <stdio.h> // snprintf()
+#include <deque>
+#include <future> // promise
+#include <unordered_set>
+#include <utility> // pair
+#include <vector>
+
+#include "EventLoop.h"
+#include "EventLoopThreadPool.h"
+#include "TcpClient.h"
+#include "TcpConnection.h"
+#include "../base/Logger.h"
+
+namespace zfwmuduo
+{
+  namespace
+  {
+    // NOTE: 每个计数器可能被多个loop线程同时累加, 这里用fetch_add
+    void bump(std::atomic<uint64_t> &counter)
+    {
+      counter.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void discardMessage(const TcpConnectionPtr &, Buffer *buf, Timestamp)
+    {
+      buf->retrieveAll();
+    }
+  } // namespace
+
+  // 一个loop的子池, 只在该loop线程中访问
+  class ConnectionPool::SubPool : noncopyable
+  {
+  public:
+    SubPool(ConnectionPool *owner, EventLoop *loop) : owner_(owner),
+                                                      loop_(loop),
+                                                      connecting_(0),
+                                                      nextId_(1),
+                                                      evictTimerArmed_(false)
+    {
+    }
+
+    ~SubPool()
+    {
+      if (evictTimerArmed_)
+        loop_->cancel(evictTimer_);
+      idle_.clear();
+      waiters_.clear();
+      // NOTE: 还活着的连接(包括借出去的)的回调绑定了this, 换成不依赖子池的版本, 再析构TcpClient
+      for (auto &item : clients_)
+      {
+        TcpConnectionPtr conn = item.second->connection();
+        if (conn)
+        {
+          conn->setConnectionCallback([](const TcpConnectionPtr &) {});
+          conn->setMessageCallback(discardMessage);
+        }
+      }
+      clients_.clear();
+    }
+
+    void start()
+    {
+      for (int i = 0; i < owner_->minSize_; ++i)
+        grow();
+      if (owner_->idleTimeout_ > 0)
+      {
+        evictTimerArmed_ = true;
+        evictTimer_ = loop_->runEvery(owner_->idleTimeout_ / 2, std::bind(&SubPool::evictIdle, this));
+      }
+    }
+
+    TcpConnectionPtr tryAcquire()
+    {
+      TcpConnectionPtr conn = popIdle();
+      if (conn)
+      {
+        bump(owner_->acquires_);
+      }
+      else if (connecting_ == 0 && static_cast<int>(clients_.size()) < owner_->maxSize_)
+      {
+        grow(); // 连上之后放进空闲列表, 下一次再来取
+      }
+      return conn;
+    }
+
+    void acquire(AcquireCallback cb)
+    {
+      TcpConnectionPtr conn = popIdle();
+      if (conn)
+      {
+        bump(owner_->acquires_);
+        cb(conn);
+        return;
+      }
+      bump(owner_->waits_);
+      waiters_.push_back(std::move(cb));
+      // 正在建立的连接不够分给排队的请求时才新建
+      if (static_cast<int>(waiters_.size()) > connecting_ && static_cast<int>(clients_.size()) < owner_->maxSize_)
+        grow();
+    }
+
+    void release(const TcpConnectionPtr &conn)
+    {
+      if (conn->connected())
+        handOut(conn);
+      // 已经断开的连接在onConnection中处理过了
+    }
+
+  private:
+    TcpConnectionPtr popIdle()
+    {
+      // 后进先出: 最近用过的连接最热, 最久没用的留在前面等着被回收
+      while (!idle_.empty())
+      {
+        TcpConnectionPtr conn = idle_.back().first;
+        idle_.pop_back();
+        if (conn->connected())
+          return conn;
+      }
+      return TcpConnectionPtr();
+    }
+
+    // 新连上的或者归还的连接: 先给排队的请求, 没有的话放进空闲列表
+    void handOut(const TcpConnectionPtr &conn)
+    {
+      if (!waiters_.empty())
+      {
+        AcquireCallback cb = std::move(waiters_.front());
+        waiters_.pop_front();
+        bump(owner_->acquires_);
+        cb(conn);
+        return;
+      }
+      idle_.push_back(std::make_pair(conn, Timestamp::now().microSecondsSinceEpoch()));
+    }
+
+    void grow()
+    {
+      char buf[32];
+      snprintf(buf, sizeof buf, "-pool#%d", nextId_++);
+      TcpClient *client = new TcpClient(loop_, owner_->serverAddr_, owner_->name_ + buf);
+      clients_[client].reset(client);
+      client->setRetryDelay(owner_->initRetryDelay_, owner_->maxRetryDelay_);
+      client->setConnectionCallback(std::bind(&SubPool::onConnection, this, client, std::placeholders::_1));
+      client->setMessageCallback(owner_->messageCallback_ ? owner_->messageCallback_ : MessageCallback(discardMessage));
+      ++connecting_;
+      client->connect();
+    }
+
+    void onConnection(TcpClient *client, const TcpConnectionPtr &conn)
+    {
+      if (conn->connected())
+      {
+        --connecting_;
+        bump(owner_->connects_);
+        handOut(conn);
+        return;
+      }
+
+      // 断开: 空闲列表中的直接移除, 借出去的由使用者归还时丢弃
+      for (size_t i = 0; i < idle_.size(); ++i)
+      {
+        if (idle_[i].first == conn)
+        {
+          idle_.erase(idle_.begin() + i);
+          break;
+        }
+      }
+      if (evicting_.erase(conn.get()) == 0)
+        bump(owner_->failures_);
+
+      // NOTE: 现在处于TcpConnection::handleClose中, 之后还要回调TcpClient::removeConnection, 推迟析构TcpClient
+      std::unordered_map<TcpClient *, std::unique_ptr<TcpClient>>::iterator it = clients_.find(client);
+      if (it != clients_.end())
+      {
+        TcpClient *dead = it->second.release();
+        clients_.erase(it);
+        loop_->queueInLoop([dead]()
+                           { delete dead; });
+      }
+
+      // 补足最小连接数, 或者还有排队的请求
+      int size = static_cast<int>(clients_.size());
+      if (size < owner_->minSize_ || (static_cast<int>(waiters_.size()) > connecting_ && size < owner_->maxSize_))
+        grow();
+    }
+
+    void evictIdle()
+    {
+      int64_t deadline = Timestamp::now().microSecondsSinceEpoch() -
+                         static_cast<int64_t>(owner_->idleTimeout_ * Timestamp::kMicroSecondsPerSecond);
+      // 空闲列表按归还时间从旧到新排列
+      while (!idle_.empty() && idle_.front().second < deadline &&
+             static_cast<int>(clients_.size() - evicting_.size()) > owner_->minSize_)
+      {
+        TcpConnectionPtr conn = idle_.front().first;
+        idle_.erase(idle_.begin());
+        evicting_.insert(conn.get());
+        bump(owner_->evictions_);
+        conn->forceClose(); // 关闭完成后走onConnection
+      }
+    }
+
+    ConnectionPool *owner_;
+    EventLoop *loop_;
+    std::unordered_map<TcpClient *, std::unique_ptr<TcpClient>> clients_; // 包括还在连接中的
+    std::vector<std::pair<TcpConnectionPtr, int64_t>> idle_;               // (连接, 归还时间us)
+    std::unordered_set<TcpConnection *> evicting_; // 因空闲被关闭, 还没走到onConnection的连接
+    std::deque<AcquireCallback> waiters_;
+    int connecting_; // clients_中还没有连上的个数
+    int nextId_;
+    bool evictTimerArmed_;
+    TimerId evictTimer_;
+  };
+
+  ConnectionPool::ConnectionPool(EventLoopThreadPool *threadPool,
+                                 const InetAddress &serverAddr,
+                                 const std::string &nameArg) : threadPool_(threadPool),
+                                                               serverAddr_(serverAddr),
+                                                               name_(nameArg),
+                                                               minSize_(1),
+                                                               maxSize_(8),
+                                                               idleTimeout_(60.0),
+                                                               initRetryDelay_(0.5),
+                                                               maxRetryDelay_(30.0),
+                                                               connects_(0),
+                                                               acquires_(0),
+                                                               waits_(0),
+                                                               evictions_(0),
+                                                               failures_(0)
+  {
+  }
+
+  // 和TcpServer::stopLoopAcceptors一样, 子池必须在自己的loop线程中销毁, 同步等待每一个完成
+  ConnectionPool::~ConnectionPool()
+  {
+    for (auto &item : subPools_)
+    {
+      SubPool *raw = item.second.release();
+      EventLoop *loop = item.first;
+      if (loop->isInLoopThread())
+      {
+        delete raw;
+        continue;
+      }
+      std::promise<void> done;
+      std::future<void> finished = done.get_future();
+      loop->runInLoop([raw, &done]()
+                      {
+                        delete raw;
+                        done.set_value(); });
+      finished.wait();
+    }
+  }
+
+  void ConnectionPool::start()
+  {
+    std::vector<EventLoop *> loops = threadPool_->getAllLoops();
+    for (EventLoop *loop : loops)
+    {
+      subPools_[loop].reset(new SubPool(this, loop));
+    }
+    for (auto &item : subPools_)
+    {
+      item.first->runInLoop(std::bind(&SubPool::start, item.second.get()));
+    }
+  }
+
+  ConnectionPool::SubPool *ConnectionPool::subPool(EventLoop *loop) const
+  {
+    std::unordered_map<EventLoop *, std::unique_ptr<SubPool>>::const_iterator it = subPools_.find(loop);
+    if (it == subPools_.end())
+    {
+      LOG_ERROR("ConnectionPool [%s] has no sub pool for loop %p \n", name_.c_str(), loop);
+      return nullptr;
+    }
+    return it->second.get();
+  }
+
+  TcpConnectionPtr ConnectionPool::tryAcquire(EventLoop *loop)
+  {
+    SubPool *pool = subPool(loop);
+    return pool ? pool->tryAcquire() : TcpConnectionPtr();
+  }
+
+  void ConnectionPool::acquire(EventLoop *loop, AcquireCallback cb)
+  {
+    SubPool *pool = subPool(loop);
+    if (pool)
+      pool->acquire(std::move(cb));
+  }
+
+  void ConnectionPool::release(const TcpConnectionPtr &conn)
+  {
+    SubPool *pool = subPool(conn->getLoop());
+    if (pool)
+      pool->release(conn);
+  }
+
+  ConnectionPool::Stats ConnectionPool::stats() const
+  {
+    Stats stats;
+    stats.connects = connects_.load(std::memory_order_relaxed);
+    stats.acquires = acquires_.load(std::memory_order_relaxed);
+    stats.waits = waits_.load(std::memory_order_relaxed);
+    stats.evictions = evictions_.load(std::memory_order_relaxed);
+    stats.failures = failures_.load(std::memory_order_relaxed);
+    return stats;
+  }
+
+} // namespace zfwmuduo
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <functional> // function
+#include <string>
+#include <memory> // unique_ptr
+#include <atomic>
+#include <unordered_map>
+#include <stdint.h>
+#include "../base/noncopyable.h"
+#include "InetAddress.h"
+#include "Callbacks.h"
+
+/**
+ * ConnectionPool: 到同一个后端的持久连接池, 每个EventLoop一个子池
+ *
+ * 在loop N上处理的请求只会拿到属于loop N的连接, 借出/归还都在loop线程内完成, 不需要runInLoop跨线程
+ * - 每个子池的连接数在[minSize, maxSize]之间: start()时建好minSize个, 断开后补上; 不够用时按需新建, 最多maxSize个
+ * - 空闲超过idleTimeout的连接(超出minSize的部分)会被关闭
+ * - 健康检查: 空闲连接被对端关闭/出错时立即从池中移除(TcpConnection开启了keepalive), 借出时只会拿到已连接的连接
+ * - 连接由TcpClient建立, 后端不可用时按Connector的退避重试, 期间acquire的请求排队等待
+ *
+ * 池中连接收到的数据交给setMessageCallback设置的回调, 请求和响应如何对应由使用者决定
+ */
+
+namespace zfwmuduo
+{
+  class EventLoop;
+  class EventLoopThreadPool;
+
+  class ConnectionPool : noncopyable
+  {
+  public:
+    typedef std::function<void(const TcpConnectionPtr &)> AcquireCallback;
+
+    // 计数, 可以在任意线程读取
+    struct Stats
+    {
+      uint64_t connects;  // 建立的连接数
+      uint64_t acquires;  // 借出的次数
+      uint64_t waits;     // 其中没有空闲连接, 需要排队等待的次数
+      uint64_t evictions; // 因空闲超时被关闭的连接数
+      uint64_t failures;  // 在池中(空闲或借出时)被对端关闭或出错的连接数
+    };
+
+    // 每个子池对应threadPool中的一个loop(没有subloop时就是baseloop)
+    ConnectionPool(EventLoopThreadPool *threadPool, const InetAddress &serverAddr, const std::string &nameArg);
+    // NOTE: 子池要在各自的loop线程中销毁, 析构时这些loop必须还在运行(或者就是当前线程的loop)
+    ~ConnectionPool();
+
+    // 以下需在start()之前设置
+    void setPoolSize(int minSize, int maxSize)
+    {
+      minSize_ = minSize;
+      maxSize_ = maxSize > minSize ? maxSize : minSize;
+    }
+    void setIdleTimeout(double seconds) { idleTimeout_ = seconds; } // <=0表示不回收空闲连接
+    void setRetryDelay(double initial, double max)
+    {
+      initRetryDelay_ = initial;
+      maxRetryDelay_ = max;
+    }
+    void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
+
+    // threadPool启动之后调用, 在每个loop中建立minSize个连接
+    void start();
+
+    // 以下只能在loop线程中调用, 操作的是该loop的子池
+    // 有空闲连接就借出, 否则返回空(没到maxSize时会新建一个, 之后再来取)
+    TcpConnectionPtr tryAcquire(EventLoop *loop);
+    // 有空闲连接时立即回调, 否则排队, 等有新建的或者归还的连接时按顺序回调
+    void acquire(EventLoop *loop, AcquireCallback cb);
+    // 归还借出的连接, 在conn所属的loop线程中调用; 已经断开的连接直接丢弃
+    void release(const TcpConnectionPtr &conn);
+
+    Stats stats() const;
+    const std::string &name() const { return name_; }
+
+  private:
+    class SubPool;
+    friend class SubPool;
+
+    SubPool *subPool(EventLoop *loop) const;
+
+    EventLoopThreadPool *threadPool_;
+    const InetAddress serverAddr_;
+    const std::string name_;
+
+    int minSize_;
+    int maxSize_;
+    double idleTimeout_;
+    double initRetryDelay_;
+    double maxRetryDelay_;
+    MessageCallback messageCallback_;
+
+    // start()之后只读, 各个loop线程可以并发查找
+    std::unordered_map<EventLoop *, std::unique_ptr<SubPool>> subPools_;
+
+    std::atomic<uint64_t> connects_;
+    std::atomic<uint64_t> acquires_;
+    std::atomic<uint64_t> waits_;
+    std::atomic<uint64_t> evictions_;
+    std::atomic<uint64_t> failures_;
+  };
+
+} // namespace zfwmuduo
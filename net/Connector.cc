@@ -0,0 +1,237 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <errno.h>
+#include <string.h> // memset()
+#include <unistd.h> // close()
+#include <algorithm> // min()
+#include "Connector.h"
+#include "Channel.h"
+#include "EventLoop.h"
+#include "../base/Logger.h"
+
+namespace zfwmuduo
+{
+  static int createNonblockingSocket()
+  {
+    int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sockfd < 0)
+      LOG_ERROR("%s:%s:%d connect socket create errno:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+    return sockfd;
+  }
+
+  static int getSocketError(int sockfd)
+  {
+    int optval;
+    socklen_t optlen = sizeof optval;
+    if (::getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
+      return errno;
+    return optval;
+  }
+
+  // 连本机时, 内核分配的临时端口恰好等于目标端口且目标没有在监听, 会"自己连上自己"(TCP同时打开)
+  static bool isSelfConnect(int sockfd)
+  {
+    sockaddr_in local, peer;
+    socklen_t len = sizeof local;
+    ::memset(&local, 0, sizeof local);
+    ::memset(&peer, 0, sizeof peer);
+    if (::getsockname(sockfd, (sockaddr *)&local, &len) < 0)
+      return false;
+    len = sizeof peer;
+    if (::getpeername(sockfd, (sockaddr *)&peer, &len) < 0)
+      return false;
+    return local.sin_port == peer.sin_port && local.sin_addr.s_addr == peer.sin_addr.s_addr;
+  }
+
+  Connector::Connector(EventLoop *loop, const InetAddress &serverAddr) : loop_(loop),
+                                                                         serverAddr_(serverAddr),
+                                                                         connect_(false),
+                                                                         state_(kDisconnected),
+                                                                         initRetryDelay_(0.5),
+                                                                         maxRetryDelay_(30.0),
+                                                                         retryDelay_(0.5),
+                                                                         retryTimerArmed_(false),
+                                                                         retries_(0)
+  {
+  }
+
+  Connector::~Connector()
+  {
+    // NOTE: start/stop投递的回调都持有shared_ptr, 析构时一定不在连接过程中
+    if (channel_)
+      LOG_ERROR("Connector::dtor [%s] still connecting \n", serverAddr_.toIpPort().c_str());
+  }
+
+  void Connector::start()
+  {
+    connect_ = true;
+    retryDelay_ = initRetryDelay_;
+    loop_->runInLoop(std::bind(&Connector::startInLoop, shared_from_this()));
+  }
+
+  void Connector::restart()
+  {
+    setState(kDisconnected);
+    retryDelay_ = initRetryDelay_;
+    connect_ = true;
+    startInLoop();
+  }
+
+  void Connector::stop()
+  {
+    connect_ = false;
+    loop_->runInLoop(std::bind(&Connector::stopInLoop, shared_from_this()));
+  }
+
+  void Connector::startInLoop()
+  {
+    if (state_ != kDisconnected)
+      return; // 已经在连接中或者已经连上了
+    if (connect_)
+      connect();
+  }
+
+  void Connector::stopInLoop()
+  {
+    if (retryTimerArmed_)
+    {
+      loop_->cancel(retryTimer_);
+      retryTimerArmed_ = false;
+    }
+    if (state_ == kConnecting)
+    {
+      setState(kDisconnected);
+      int sockfd = removeAndResetChannel();
+      ::close(sockfd);
+    }
+  }
+
+  void Connector::connect()
+  {
+    int sockfd = createNonblockingSocket();
+    if (sockfd < 0)
+    { // 一般是描述符耗尽, 过一会儿再试
+      setState(kConnecting);
+      retry(-1);
+      return;
+    }
+    int ret = ::connect(sockfd, (const sockaddr *)serverAddr_.getSockAddr(), sizeof(sockaddr_in));
+    int savedErrno = (ret == 0) ? 0 : errno;
+    switch (savedErrno)
+    {
+    case 0:
+    case EINPROGRESS: // 非阻塞connect正在进行, 可写时再判断结果
+    case EINTR:
+    case EISCONN:
+      connecting(sockfd);
+      break;
+
+    case EAGAIN: // 本地临时端口用完了
+    case EADDRINUSE:
+    case EADDRNOTAVAIL:
+    case ECONNREFUSED:
+    case ENETUNREACH:
+      setState(kConnecting);
+      retry(sockfd);
+      break;
+
+    default: // EACCES EPERM EAFNOSUPPORT EBADF ENOTSOCK...: 重试也没用
+      LOG_ERROR("Connector::connect [%s] errno=%d \n", serverAddr_.toIpPort().c_str(), savedErrno);
+      ::close(sockfd);
+      setState(kDisconnected);
+      break;
+    }
+  }
+
+  void Connector::connecting(int sockfd)
+  {
+    setState(kConnecting);
+    channel_.reset(new Channel(loop_, sockfd));
+    channel_->setWriteCallback(std::bind(&Connector::handleWrite, this));
+    channel_->setErrorCallback(std::bind(&Connector::handleError, this));
+    // NOTE: channel_的回调绑定的是this, 回调执行期间的生命周期由tie保证
+    channel_->tie(shared_from_this());
+    channel_->enableWriting(); // 连接完成(成功或失败)时socket变为可写
+  }
+
+  void Connector::handleWrite()
+  {
+    if (state_ != kConnecting)
+      return;
+
+    int sockfd = removeAndResetChannel();
+    int err = getSocketError(sockfd);
+    if (err)
+    {
+      LOG_INFO("Connector::handleWrite [%s] SO_ERROR=%d \n", serverAddr_.toIpPort().c_str(), err);
+      retry(sockfd);
+    }
+    else if (isSelfConnect(sockfd))
+    {
+      LOG_INFO("Connector::handleWrite [%s] self connect \n", serverAddr_.toIpPort().c_str());
+      retry(sockfd);
+    }
+    else
+    {
+      setState(kConnected);
+      if (connect_ && newConnectionCallback_)
+      {
+        newConnectionCallback_(sockfd); // sockfd交给上层
+      }
+      else
+      {
+        ::close(sockfd);
+      }
+    }
+  }
+
+  void Connector::handleError()
+  {
+    if (state_ != kConnecting)
+      return;
+    int sockfd = removeAndResetChannel();
+    LOG_INFO("Connector::handleError [%s] SO_ERROR=%d \n", serverAddr_.toIpPort().c_str(), getSocketError(sockfd));
+    retry(sockfd);
+  }
+
+  // 关闭这次失败的socket, 按指数退避安排下一次connect
+  void Connector::retry(int sockfd)
+  {
+    if (sockfd >= 0)
+      ::close(sockfd);
+    setState(kDisconnected);
+    ++retries_;
+    if (!connect_)
+      return;
+
+    LOG_INFO("Connector::retry connecting to %s in %.3f seconds \n", serverAddr_.toIpPort().c_str(), retryDelay_);
+    std::weak_ptr<Connector> weakSelf(shared_from_this());
+    retryTimerArmed_ = true;
+    retryTimer_ = loop_->runAfter(retryDelay_, [weakSelf]()
+                                  {
+                                    ConnectorPtr self = weakSelf.lock();
+                                    if (self)
+                                    {
+                                      self->retryTimerArmed_ = false;
+                                      self->startInLoop();
+                                    } });
+    retryDelay_ = std::min(retryDelay_ * 2, maxRetryDelay_);
+  }
+
+  int Connector::removeAndResetChannel()
+  {
+    channel_->disableAll();
+    channel_->remove();
+    int sockfd = channel_->fd();
+    // NOTE: 现在可能正处于Channel::handleEvent中, 不能在这里析构channel_
+    loop_->queueInLoop(std::bind(&Connector::resetChannel, shared_from_this()));
+    return sockfd;
+  }
+
+  void Connector::resetChannel()
+  {
+    if (state_ != kConnecting) // 期间已经开始了新一次连接的话, 旧的channel已经在connecting()中析构了
+      channel_.reset();
+  }
+
+} // namespace zfwmuduo
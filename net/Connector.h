@@ -0,0 +1,84 @@
+#pragma once
+
+#include <functional> // function
+#include <memory>     // enable_shared_from_this unique_ptr
+#include <atomic>
+#include "../base/noncopyable.h"
+#include "InetAddress.h"
+#include "TimerId.h"
+
+/**
+ * Connector: 主动发起连接, 和Acceptor对应
+ * 1-非阻塞connect, 返回EINPROGRESS时注册EPOLLOUT, 可写时用SO_ERROR判断连接是否成功
+ * 2-失败后按指数退避重试(initRetryDelay, 2*initRetryDelay, ..., 最多maxRetryDelay)
+ * 3-连接成功后把sockfd交给上层(TcpClient), 自己不再管理这个fd
+ *
+ * 通过shared_ptr管理, 投递给loop的回调持有它, 重试定时器只持有weak_ptr
+ */
+
+namespace zfwmuduo
+{
+  class Channel;
+  class EventLoop;
+
+  class Connector : noncopyable, public std::enable_shared_from_this<Connector>
+  {
+  public:
+    typedef std::function<void(int sockfd)> NewConnectionCallback;
+
+    Connector(EventLoop *loop, const InetAddress &serverAddr);
+    ~Connector();
+
+    void setNewConnectionCallback(NewConnectionCallback cb) { newConnectionCallback_ = std::move(cb); }
+    // 重试间隔(秒): 从initial开始每次翻倍, 不超过max; 需在start()之前设置
+    void setRetryDelay(double initial, double max)
+    {
+      initRetryDelay_ = initial;
+      maxRetryDelay_ = max;
+    }
+
+    const InetAddress &serverAddress() const { return serverAddr_; }
+    // 连接失败/被拒绝的累计次数, 可以跨线程读取
+    int retries() const { return retries_; }
+
+    void start();   // 可跨线程调用
+    void restart(); // 连接断开后重新开始, 重试间隔恢复初始值; 只能在loop线程中调用
+    void stop();    // 可跨线程调用
+
+  private:
+    enum StateE
+    {
+      kDisconnected,
+      kConnecting,
+      kConnected
+    };
+    void setState(StateE state) { state_ = state; }
+
+    void startInLoop();
+    void stopInLoop();
+    void connect();
+    void connecting(int sockfd);
+    void handleWrite();
+    void handleError();
+    void retry(int sockfd);
+    int removeAndResetChannel();
+    void resetChannel();
+
+    EventLoop *loop_;
+    InetAddress serverAddr_;
+    std::atomic_bool connect_; // 用户是否希望连接, stop()之后为false
+    std::atomic_int state_;
+    std::unique_ptr<Channel> channel_; // 连接进行中(kConnecting)时非空
+    NewConnectionCallback newConnectionCallback_;
+
+    double initRetryDelay_;
+    double maxRetryDelay_;
+    double retryDelay_; // 下一次重试的等待时间
+    bool retryTimerArmed_;
+    TimerId retryTimer_;
+    std::atomic_int retries_;
+  };
+
+  typedef std::shared_ptr<Connector> ConnectorPtr;
+
+} // namespace zfwmuduo
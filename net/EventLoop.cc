@@ -2,12 +2,12 @@
 #include <errno.h>       // errno
 #include <unistd.h>      //read()
 #include <fcntl.h>
-#include <memory> // unique_lock智能锁
-#include <mutex>  // mutex
 #include "EventLoop.h"
 #include "Logger.h" // LOG_FATAL, LOG_DEBUG, LOG_ERROR, LOG_INFO
 #include "Poller.h"
 #include "Channel.h"
+#include "TimerQueue.h"
+#include "TimingWheel.h"
 #include "../base/CurrentThread.h" // currentThread::tid()
 
 namespace zfwmuduo
@@ -32,8 +32,13 @@ namespace zfwmuduo
   EventLoop::EventLoop() : looping_(false),
                            quit_(false),
                            callingPendingFunctors_(false),
+                           wakeupPending_(false),
+                           callingIterationEndFunctors_(false),
+                           connectionCount_(0),
+                           busyMicroSeconds_(0),
                            threadId_(zfwmuduo::currentThread::tid()),
                            poller_(Poller::newDefaultPoller(this)),
+                           timerQueue_(new TimerQueue(this)),
                            wakeupFd_(createEventfd()),
                            wakeupChannel_(new Channel(this, wakeupFd_))
   {
@@ -99,6 +104,11 @@ namespace zfwmuduo
        * mainLoop事先会注册一个回调cb(需要subLoop来执行), wakeup subLoop后, 执行下面的方法(也就之前mainLoop注册的cb操作)
        */
       doPendingFunctors();
+      doIterationEndFunctors();
+
+      // 本轮从poll返回到处理完所有事件和回调的耗时, 平滑系数1/8; 只有loop线程写, 所以不需要CAS
+      int64_t busy = Timestamp::now().microSecondsSinceEpoch() - pollReturnTime_.microSecondsSinceEpoch();
+      busyMicroSeconds_ = busyMicroSeconds_ + (busy - busyMicroSeconds_) / 8;
     }
     LOG_INFO("EventLoop %p stop looping. \n", this);
     looping_ = false;
@@ -117,22 +127,44 @@ namespace zfwmuduo
   // 执行回调
   void EventLoop::doPendingFunctors()
   {
-    std::vector<Functor> functors;
     callingPendingFunctors_ = true;
+    // NOTE: 必须在取回调之前清除标记: 之后入队的生产者会看到false并重新唤醒loop, 不会丢失唤醒
+    wakeupPending_ = false;
 
-    {
-      std::unique_lock<std::mutex> lock(mutex_);
-      // TAG：[好手法学习]swap 相当于解放pendingFunctors_, 由于多线程下会不断有回调操作push进pendingFunctors_, 这就很容易导致它延长执行时间
-      // 通过swap将当前pendingFunctors_容器中的所有回调操作转移到临时容器中进行操作. 这也不会妨碍到pendingFunctors_继续有新回调操作添加 是一种比较高效的手法
-      functors.swap(pendingFunctors_);
-    }
-
-    for (const Functor &functor : functors)
+    // TAG: 只执行本次调用之前入队的回调, 执行期间新加入的回调留到下一轮, 和原来swap出vector的语义一致
+    pendingFunctors_.drain([](const Functor &functor) {
       functor(); // 执行当前loop需要执行的回调操作
+    });
 
     callingPendingFunctors_ = false;
   }
 
+  void EventLoop::doIterationEndFunctors()
+  {
+    if (iterationEndFunctors_.empty())
+      return;
+    // NOTE: 这时已经过了doPendingFunctors, 这里queueInLoop的回调必须唤醒loop, 否则要等到下一次poll超时才会执行
+    callingPendingFunctors_ = true;
+    callingIterationEndFunctors_ = true;
+    std::vector<Functor> functors;
+    functors.swap(iterationEndFunctors_);
+    for (const Functor &functor : functors)
+    {
+      functor();
+    }
+    callingIterationEndFunctors_ = false;
+    callingPendingFunctors_ = false;
+  }
+
+  void EventLoop::runAtIterationEnd(Functor cb)
+  {
+    iterationEndFunctors_.push_back(std::move(cb));
+    // NOTE: 本轮的iteration end回调已经swap出去了, 新加的要等下一轮; 不唤醒的话loop会一直阻塞在poll上,
+    // 比如在这些回调里send的数据会一直留在cork缓冲区中, 直到别的事件或者poll超时
+    if (callingIterationEndFunctors_ && !wakeupPending_.exchange(true))
+      wakeup();
+  }
+
   void EventLoop::runInLoop(Functor cb)
   {
     if (isInLoopThread())
@@ -146,16 +178,14 @@ namespace zfwmuduo
   }
   void EventLoop::queueInLoop(Functor cb)
   {
-    {
-      std::unique_lock<std::mutex> lock(mutex_);
-      pendingFunctors_.push_back(std::move(cb));
-    }
+    pendingFunctors_.push(std::move(cb)); // 无锁入队
 
     // wakeup相应的需要执行上面回调操作的loop的线程了
     // TAG: callingPendingFunctors_=true在这里表示:
     //[callingPendingFunctors_] 正在执行这个回调操作(doPendingFunctors), 没有阻塞在loop上, 这时又有新的回调操作添加(push_back(std::move(cb)))
     //[callingPendingFunctors_]当这个回调操作执行完之后, 又会循环回poll函数的地方阻塞起来，所以也需要wakeup
-    if (!isInLoopThread() || callingPendingFunctors_)
+    // wakeupPending_保证loop处理回调之前, 多次跨线程调用只写一次eventfd
+    if ((!isInLoopThread() || callingPendingFunctors_) && !wakeupPending_.exchange(true))
       wakeup(); // 唤醒loop所在线程
   }
 
@@ -168,6 +198,37 @@ namespace zfwmuduo
       LOG_ERROR("EventLoop::wakeup() writes %ld bytes instead of 8", n);
   }
 
+  TimerId EventLoop::runAt(Timestamp time, TimerCallback cb)
+  {
+    return timerQueue_->addTimer(std::move(cb), time, 0.0);
+  }
+
+  TimerId EventLoop::runAfter(double delay, TimerCallback cb)
+  {
+    Timestamp time(addTime(Timestamp::now(), delay));
+    return runAt(time, std::move(cb));
+  }
+
+  TimerId EventLoop::runEvery(double interval, TimerCallback cb)
+  {
+    Timestamp time(addTime(Timestamp::now(), interval));
+    return timerQueue_->addTimer(std::move(cb), time, interval);
+  }
+
+  void EventLoop::cancel(TimerId timerId)
+  {
+    timerQueue_->cancel(timerId);
+  }
+
+  TimingWheel *EventLoop::timingWheel()
+  {
+    if (!timingWheel_)
+    {
+      timingWheel_.reset(new TimingWheel(this));
+    }
+    return timingWheel_.get();
+  }
+
   // EventLoop的方法 ==> Poller的方法
   void EventLoop::updateChannel(Channel *channel)
   {
@@ -4,10 +4,12 @@
 #include <vector>
 #include <atomic> // atomic_bool
 #include <memory> // unique_ptr
-#include <mutex>  // mutex
 #include "../base/noncopyable.h"
+#include "../base/MpscQueue.h"
 #include "../base/Timestamp.h"
 #include "../base/CurrentThread.h" // currentThread::tid()
+#include "Callbacks.h"                // TimerCallback
+#include "TimerId.h"
 
 /**
  * EventLoop：事件循环  <-- Reactor模型上对应Demultiplex(多路事件分发器)
@@ -21,6 +23,8 @@ namespace zfwmuduo
 {
   class Channel;
   class Poller;
+  class TimerQueue;
+  class TimingWheel;
   class EventLoop : noncopyable
   {
   public:
@@ -40,17 +44,38 @@ namespace zfwmuduo
 
     void wakeup(); // 唤醒loop所在线程
 
+    // 在本轮循环的最后(处理完所有事件和doPendingFunctors之后)执行cb, 只执行一次; 只能在loop线程中调用
+    // 用于把一轮中产生的多次操作合并成一次, 比如TcpConnection的自动cork
+    // 在本轮的iteration end回调里再调用时, cb留到下一轮的最后执行(会唤醒loop, 不用等别的事件)
+    void runAtIterationEnd(Functor cb);
+
+    // 定时器, 以下接口都可以跨线程调用, 回调总是在loop所在线程中执行
+    TimerId runAt(Timestamp time, TimerCallback cb);     // 在time时刻执行cb
+    TimerId runAfter(double delay, TimerCallback cb);    // delay秒之后执行cb
+    TimerId runEvery(double interval, TimerCallback cb); // 每隔interval秒执行一次cb
+    void cancel(TimerId timerId);                        // 取消定时器
+
+    // 本loop的时间轮, 第一次使用时创建, 由上面的定时器驱动; 只能在loop线程中调用
+    TimingWheel *timingWheel();
+
     // EventLoop的方法 ==> Poller的方法
     void updateChannel(Channel *channel);
     void removeChannel(Channel *channel);
     bool hasChannel(Channel *channel);
 
+    // 负载统计, 供EventLoopThreadPool选择subloop, 可以跨线程读取
+    int connectionCount() const { return connectionCount_; }    // 属于本loop的存活连接数
+    void incConnectionCount() { ++connectionCount_; }            // TcpConnection构造时调用
+    void decConnectionCount() { --connectionCount_; }            // TcpConnection析构时调用
+    int64_t busyMicroSeconds() const { return busyMicroSeconds_; } // 每轮处理事件耗时的指数滑动平均(us)
+
     // 判断EventLoop对象是否在自己线程中
     bool isInLoopThread() const { return threadId_ == zfwmuduo::currentThread::tid(); }
 
   private:
     void handleRead();        // wakeup()
     void doPendingFunctors(); // 执行回调
+    void doIterationEndFunctors();
 
     typedef std::vector<Channel *> ChannelList;
 
@@ -63,6 +88,8 @@ namespace zfwmuduo
 
     Timestamp pollReturnTime_; // poller返回发生事件的channels的时间点
     std::unique_ptr<Poller> poller_;
+    std::unique_ptr<TimerQueue> timerQueue_; // NOTE: 必须在poller_之后构造, 它的timerfd要注册到poller_上
+    std::unique_ptr<TimingWheel> timingWheel_; // 依赖timerQueue_, 必须在它之后声明
 
     // 当mainloop获取一个新用户的channel, 通过轮询算法选择一个subloop, 通过该成员唤醒subloop处理channel
     // NOTE： wakeupFd_和线程安全队列的设计可以参考《Linux高性能服务器编程(游双)》-半同步/半反应堆模式！！！
@@ -73,8 +100,14 @@ namespace zfwmuduo
     // Channel *currentActiveChannel_;
 
     std::atomic_bool callingPendingFunctors_; // 标识当前loop是否有需要执行的回调操作
-    std::vector<Functor> pendingFunctors_;    // 存储loop需要执行的所有的回调操作
-    std::mutex mutex_;                        // 互斥锁, 用来保护上面vector容器的线程安全操作
+    // TAG: 无锁的多生产者单消费者队列, 替代原来mutex保护的vector; 只有loop线程会消费
+    MpscQueue<Functor> pendingFunctors_; // 存储loop需要执行的所有的回调操作
+    std::atomic_bool wakeupPending_;     // 已经写过wakeupFd_, loop还没来得及处理回调, 不需要重复写
+    std::vector<Functor> iterationEndFunctors_; // 只有loop线程访问
+    bool callingIterationEndFunctors_;          // 正在执行iterationEndFunctors_, 只有loop线程访问
+
+    std::atomic_int connectionCount_;
+    std::atomic<int64_t> busyMicroSeconds_;
   };
 
 } // namespace zfwmuduo
\ No newline at end of file
@@ -23,6 +23,8 @@ namespace zfwmuduo
     EventLoopThread(const ThreadInitCallback &cb = ThreadInitCallback(),
                     const std::string &name = std::string());
     ~EventLoopThread();
+    // 需在startLoop()之前调用, 见Thread::setCpuAffinity
+    void setCpuAffinity(int cpu, bool localAlloc = false) { thread_.setCpuAffinity(cpu, localAlloc); }
     EventLoop *startLoop();
 
   private:
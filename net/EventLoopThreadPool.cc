@@ -1,6 +1,12 @@
 #include <memory> // unique_ptr
 #include "EventLoopThreadPool.h"
 #include "EventLoopThread.h"
+#include "EventLoop.h"
+#include "InetAddress.h"
+#include <sched.h> // sched_getaffinity()
+#include <stdio.h> // fopen()
+#include <set>
+#include <utility> // pair
 #include "../base/noncopyable.h"
 
 namespace zfwmuduo
@@ -10,7 +16,11 @@ namespace zfwmuduo
                                                                          name_(nameArg),
                                                                          started_(false),
                                                                          numThreads_(0),
-                                                                         next_(0) {}
+                                                                         next_(0),
+                                                                         policy_(kRoundRobin),
+                                                                         oneLoopPerPhysicalCore_(false),
+                                                                         numaLocalAlloc_(false),
+                                                                         randomState_(2463534242u) {}
   EventLoopThreadPool::~EventLoopThreadPool()
   { /* Don't delete loop, it's stack variable*/
   }
@@ -19,11 +29,20 @@ namespace zfwmuduo
   {
     started_ = true;
 
+    if (oneLoopPerPhysicalCore_)
+    {
+      cpus_ = physicalCores();
+      if (numThreads_ == 0)
+        numThreads_ = static_cast<int>(cpus_.size());
+    }
+
     for (int i = 0; i < numThreads_; ++i)
     {
       char buf[name_.size() + 32];
       snprintf(buf, sizeof buf, "%s%d", name_.c_str(), i); // 用线程池名字+循环下标, 作为底层县城名字
       EventLoopThread *t = new EventLoopThread(cb, buf);
+      if (!cpus_.empty())
+        t->setCpuAffinity(cpus_[i % cpus_.size()], numaLocalAlloc_);
       threads_.push_back(std::unique_ptr<EventLoopThread>(t));
       loops_.push_back(t->startLoop()); // startLoop底层创建线程, 绑定一个新EventLoop, 并返回该loop的地址
     }
@@ -33,22 +52,130 @@ namespace zfwmuduo
       cb(baseLoop_);
   }
 
-  // 轮询方式
+  void EventLoopThreadPool::stop()
+  {
+    loops_.clear();
+    next_ = 0;
+    threads_.clear(); // EventLoopThread析构时quit并join
+  }
+
   EventLoop *EventLoopThreadPool::getNextLoop()
   {
-    EventLoop *loop = baseLoop_;
+    if (loops_.empty())
+      return baseLoop_;
 
-    if (!loops_.empty()) // loops_不为空则 round-robin
+    switch (policy_)
     {
-      loop = loops_[next_];
-      ++next_;
-      if (next_ >= loops_.size())
-        next_ = 0;
+    case kLeastConnections:
+      return leastConnectionsLoop();
+    case kLeastLatency:
+      return leastLatencyLoop();
+    case kPowerOfTwoChoices:
+      return powerOfTwoChoicesLoop();
+    default:
+      return roundRobinLoop();
     }
+  }
 
+  EventLoop *EventLoopThreadPool::getNextLoop(const InetAddress &peerAddr)
+  {
+    if (policy_ != kPeerHash || loops_.empty())
+      return getNextLoop();
+
+    // 只用ip不用端口: 同一个客户端的多个连接落在同一个loop; 乘法哈希把相邻的地址打散
+    uint32_t ip = peerAddr.getSockAddr()->sin_addr.s_addr;
+    return loops_[(ip * 2654435761u) % loops_.size()];
+  }
+
+  // 轮询方式
+  EventLoop *EventLoopThreadPool::roundRobinLoop()
+  {
+    EventLoop *loop = loops_[next_];
+    ++next_;
+    if (next_ >= loops_.size())
+      next_ = 0;
     return loop;
   }
 
+  // NOTE: 从next_开始扫描, 连接数相同时依次轮换, 否则总是挑中第一个loop
+  EventLoop *EventLoopThreadPool::leastConnectionsLoop()
+  {
+    size_t n = loops_.size();
+    size_t best = next_;
+    for (size_t i = 1; i < n; ++i)
+    {
+      size_t index = (next_ + i) % n;
+      if (loops_[index]->connectionCount() < loops_[best]->connectionCount())
+        best = index;
+    }
+    next_ = (next_ + 1) % n;
+    return loops_[best];
+  }
+
+  EventLoop *EventLoopThreadPool::leastLatencyLoop()
+  {
+    size_t n = loops_.size();
+    size_t best = next_;
+    for (size_t i = 1; i < n; ++i)
+    {
+      size_t index = (next_ + i) % n;
+      if (loops_[index]->busyMicroSeconds() < loops_[best]->busyMicroSeconds())
+        best = index;
+    }
+    next_ = (next_ + 1) % n;
+    return loops_[best];
+  }
+
+  EventLoop *EventLoopThreadPool::powerOfTwoChoicesLoop()
+  {
+    randomState_ ^= randomState_ << 13;
+    randomState_ ^= randomState_ >> 17;
+    randomState_ ^= randomState_ << 5;
+    size_t n = loops_.size();
+    if (n == 1)
+      return loops_[0];
+    size_t first = randomState_ % n;
+    size_t second = (first + 1 + (randomState_ >> 16) % (n - 1)) % n; // 保证和first不同
+    EventLoop *a = loops_[first];
+    EventLoop *b = loops_[second];
+    return b->connectionCount() < a->connectionCount() ? b : a;
+  }
+
+  // 从sysfs读取拓扑, (physical_package_id, core_id)相同的逻辑cpu是同一个物理核心的超线程
+  static int readTopology(int cpu, const char *item)
+  {
+    char path[128];
+    snprintf(path, sizeof path, "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, item);
+    FILE *fp = ::fopen(path, "r");
+    if (!fp)
+      return -1;
+    int value = -1;
+    if (fscanf(fp, "%d", &value) != 1)
+      value = -1;
+    ::fclose(fp);
+    return value;
+  }
+
+  std::vector<int> EventLoopThreadPool::physicalCores()
+  {
+    std::vector<int> cores;
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (::sched_getaffinity(0, sizeof allowed, &allowed) != 0)
+      return cores;
+
+    std::set<std::pair<int, int>> seen;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+      if (!CPU_ISSET(cpu, &allowed))
+        continue;
+      std::pair<int, int> core(readTopology(cpu, "physical_package_id"), readTopology(cpu, "core_id"));
+      if (core.second < 0 || seen.insert(core).second) // 读不到拓扑时每个逻辑cpu单独算一个核心
+        cores.push_back(cpu);
+    }
+    return cores;
+  }
+
   std::vector<EventLoop *> EventLoopThreadPool::getAllLoops()
   {
     if (loops_.empty())
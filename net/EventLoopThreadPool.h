@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 #include <memory> // unique_ptr
+#include <stdint.h>
 #include "../base/noncopyable.h"
 
 /**
@@ -14,11 +15,22 @@ namespace zfwmuduo
 {
   class EventLoop;
   class EventLoopThread;
+  class InetAddress;
   class EventLoopThreadPool : noncopyable
   {
   public:
     typedef std::function<void(EventLoop *)> ThreadInitCallback;
 
+    // 新连接分配给哪个subloop
+    enum SelectPolicy
+    {
+      kRoundRobin,        // 轮询(默认)
+      kLeastConnections,  // 存活连接数最少的loop
+      kLeastLatency,      // 最近每轮处理耗时最短的loop
+      kPowerOfTwoChoices, // 随机挑两个, 取连接数少的那个; 比全量扫描便宜, 也不会让一批连接同时涌向同一个loop
+      kPeerHash,          // 按对端ip哈希, 同一个客户端总是落在同一个loop上
+    };
+
     EventLoopThreadPool(EventLoop *baseLoop, const std::string &nameArg);
     ~EventLoopThreadPool();
 
@@ -26,9 +38,25 @@ namespace zfwmuduo
     void setThreadNum(int numThreads) { numThreads_ = numThreads; }
 
     void start(const ThreadInitCallback &cb = ThreadInitCallback());
+    // 退出并join所有subloop线程, 之后getNextLoop()只返回baseloop; 调用前这些loop上的连接要已经全部销毁
+    void stop();
+
+    // 绑核, 以下均需在start()之前设置; 第i个subloop线程绑定到cpus[i % cpus.size()]
+    void setCpuList(const std::vector<int> &cpus) { cpus_ = cpus; }
+    // 每个物理核心(忽略超线程)一个subloop并绑定在上面; setThreadNum为0时线程数取物理核心数
+    void setOneLoopPerPhysicalCore(bool on) { oneLoopPerPhysicalCore_ = on; }
+    // 绑核的同时把subloop线程的内存策略设为MPOL_LOCAL, loop自己分配的内存落在本地NUMA节点
+    void setNumaLocalAlloc(bool on) { numaLocalAlloc_ = on; }
+    // 当前进程可用的cpu中, 每个物理核心的第一个逻辑cpu
+    static std::vector<int> physicalCores();
 
-    // 若在多线程中, baseloop_默认以轮询的方式分配channel给subloop
+    // 需在start()之前设置
+    void setSelectPolicy(SelectPolicy policy) { policy_ = policy; }
+    SelectPolicy selectPolicy() const { return policy_; }
+
+    // 若在多线程中, baseloop_按照policy_分配channel给subloop; 没有对端地址时kPeerHash退化为轮询
     EventLoop *getNextLoop();
+    EventLoop *getNextLoop(const InetAddress &peerAddr);
 
     // 提供了一个接口返回池子里的所有loops
     std::vector<EventLoop *> getAllLoops();
@@ -37,11 +65,21 @@ namespace zfwmuduo
     const std::string &name() const { return name_; }
 
   private:
+    EventLoop *roundRobinLoop();
+    EventLoop *leastConnectionsLoop();
+    EventLoop *leastLatencyLoop();
+    EventLoop *powerOfTwoChoicesLoop();
+
     EventLoop *baseLoop_; // EventLoop loop
     std::string name_;
     bool started_;
     int numThreads_;
     int next_;
+    SelectPolicy policy_;
+    std::vector<int> cpus_;
+    bool oneLoopPerPhysicalCore_;
+    bool numaLocalAlloc_;
+    uint32_t randomState_; // kPowerOfTwoChoices用的xorshift随机数状态, 只在baseloop线程中使用
     std::vector<std::unique_ptr<EventLoopThread>> threads_; // 包含了所有创建的事件线程
     std::vector<EventLoop *> loops_;                        // 包含了事件线程中的EventLoop的指针
   };
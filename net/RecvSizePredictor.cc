@@ -0,0 +1,76 @@
+#include "RecvSizePredictor.h"
+#include <vector>
+
+namespace zfwmuduo
+{
+  namespace
+  {
+    const int kIndexIncrement = 4;
+    const int kIndexDecrement = 1;
+
+    std::vector<size_t> buildSizeTable()
+    {
+      std::vector<size_t> table;
+      for (size_t size = 16; size < 512; size += 16)
+        table.push_back(size);
+      for (size_t size = 512; size <= RecvSizePredictor::kMaximum; size <<= 1)
+        table.push_back(size);
+      return table;
+    }
+
+    const std::vector<size_t> &sizeTable()
+    {
+      static const std::vector<size_t> table = buildSizeTable();
+      return table;
+    }
+
+    // 第一个不小于size的规格的下标
+    int sizeIndex(size_t size)
+    {
+      const std::vector<size_t> &table = sizeTable();
+      int index = 0;
+      while (index + 1 < static_cast<int>(table.size()) && table[index] < size)
+        ++index;
+      return index;
+    }
+  } // namespace
+
+  RecvSizePredictor::RecvSizePredictor() : index_(sizeIndex(kInitial)),
+                                           nextReadSize_(kInitial),
+                                           decreaseNow_(false)
+  {
+  }
+
+  void RecvSizePredictor::record(size_t actualBytes)
+  {
+    static const int minIndex = sizeIndex(kMinimum);
+    static const int maxIndex = sizeIndex(kMaximum);
+    const std::vector<size_t> &table = sizeTable();
+
+    int lower = index_ - kIndexDecrement;
+    if (lower < minIndex)
+      lower = minIndex;
+    if (actualBytes <= table[lower])
+    {
+      if (decreaseNow_)
+      {
+        index_ = lower;
+        nextReadSize_ = table[index_];
+        decreaseNow_ = false;
+      }
+      else
+      {
+        decreaseNow_ = true;
+      }
+    }
+    else if (actualBytes >= nextReadSize_)
+    {
+      index_ += kIndexIncrement;
+      if (index_ > maxIndex)
+        index_ = maxIndex;
+      nextReadSize_ = table[index_];
+      decreaseNow_ = false;
+    }
+  }
+
+} // namespace zfwmuduo
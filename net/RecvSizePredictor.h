@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stddef.h> // size_t
+
+/**
+ * RecvSizePredictor: 根据最近几次实际读到的字节数, 预测下一次读需要多大的空间
+ * 参考Netty的AdaptiveRecvByteBufAllocator:
+ * - 规格表: 16~496按16递增, 512起按2倍递增直到kMaximum
+ * - 一次读满了预测值, 立即上调4档
+ * - 连续两次读到的都不超过低一档的大小, 才下调1档(快升慢降, 避免抖动)
+ */
+
+namespace zfwmuduo
+{
+  class RecvSizePredictor
+  {
+  public:
+    static const size_t kMinimum = 64;
+    static const size_t kInitial = 512; // 比Buffer的初始可写空间小, 小消息的连接不会因为预测而扩容
+    static const size_t kMaximum = 65536;
+
+    RecvSizePredictor();
+
+    size_t nextReadSize() const { return nextReadSize_; }
+    void record(size_t actualBytes);
+
+  private:
+    int index_;
+    size_t nextReadSize_;
+    bool decreaseNow_;
+  };
+
+} // namespace zfwmuduo
@@ -49,7 +49,8 @@ namespace zfwmuduo
     socklen_t len = sizeof(addr);
     bzero(&addr, sizeof addr); // 将 addr 初始化为零
     // accept 函数通过返回 -1 和设置 errno 来表示失败
-    int connfd = ::accept(sockfd_, (sockaddr *)&addr, &len);
+    // NOTE: accept4直接把connfd设置成非阻塞, ET模式下要一直读写到EAGAIN, 阻塞的fd会把loop卡死
+    int connfd = ::accept4(sockfd_, (sockaddr *)&addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
     if (connfd >= 0)
     {
       peeraddr->setSockAddr(addr);
@@ -91,4 +92,18 @@ namespace zfwmuduo
     int optval = on ? 1 : 0;
     ::setsockopt(sockfd_, SOL_SOCKET, SO_KEEPALIVE, &optval, static_cast<socklen_t>(sizeof optval));
   }
+
+  bool Socket::setZeroCopy(bool on) // socket级别(SQL_SOCKET)
+  {
+    int optval = on ? 1 : 0;
+    return ::setsockopt(sockfd_, SOL_SOCKET, SO_ZEROCOPY, &optval, static_cast<socklen_t>(sizeof optval)) == 0;
+  }
+
+  void Socket::setAbortOnClose() // socket级别(SQL_SOCKET)
+  {
+    struct linger optval;
+    optval.l_onoff = 1;
+    optval.l_linger = 0;
+    ::setsockopt(sockfd_, SOL_SOCKET, SO_LINGER, &optval, static_cast<socklen_t>(sizeof optval));
+  }
 } // namespace zfwmuduo
\ No newline at end of file
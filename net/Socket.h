@@ -26,6 +26,10 @@ namespace zfwmuduo
     void setReuseAddr(bool on);
     void setReusePort(bool on);
     void setKeepAlive(bool on);
+    // SO_ZEROCOPY, 之后才能用MSG_ZEROCOPY发送; 内核不支持(4.14之前)时返回false
+    bool setZeroCopy(bool on);
+    // SO_LINGER{1, 0}: close时直接发RST, 丢掉发送队列中还没发出去的数据
+    void setAbortOnClose();
 
   private:
     const int sockfd_;
@@ -0,0 +1,128 @@
+#include "TcpClient.h"
+#include "../base/Logger.h" // LOG_FATAL
+#include <functional>       // bind()
+#include <strings.h>        // bzero()
+#include <stdio.h>          // snprintf()
+#include <sys/socket.h>     // getsockname() getpeername()
+
+namespace zfwmuduo
+{
+  // 不接受用户传一个空指针给loop_
+  static EventLoop *CheckLoopNotNull(EventLoop *loop)
+  {
+    if (!loop)
+    {
+      LOG_FATAL("%s:%s:%d client loop is null! \n", __FILE__, __FUNCTION__, __LINE__);
+    }
+    return loop;
+  }
+
+  // TcpClient已经析构, 但连接还活着: 连接关闭时只需要自己销毁
+  static void removeDetachedConnection(EventLoop *loop, const TcpConnectionPtr &conn)
+  {
+    loop->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+  }
+
+  TcpClient::TcpClient(EventLoop *loop,
+                       const InetAddress &serverAddr,
+                       const std::string &nameArg) : loop_(CheckLoopNotNull(loop)),
+                                                     connector_(new Connector(loop, serverAddr)),
+                                                     name_(nameArg),
+                                                     retry_(false),
+                                                     connect_(false),
+                                                     nextConnId_(1)
+  {
+    connector_->setNewConnectionCallback(std::bind(&TcpClient::newConnection, this, std::placeholders::_1));
+    LOG_INFO("TcpClient::TcpClient [%s] - connector to %s \n", name_.c_str(), serverAddr.toIpPort().c_str());
+  }
+
+  TcpClient::~TcpClient()
+  {
+    LOG_INFO("TcpClient::~TcpClient [%s] destructing \n", name_.c_str());
+    TcpConnectionPtr conn;
+    bool unique = false;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      unique = connection_.unique();
+      conn = connection_;
+    }
+    if (conn)
+    { // NOTE: 连接的关闭回调原本绑定的是this, 换成不依赖TcpClient的版本
+      CloseCallback cb = std::bind(&removeDetachedConnection, loop_, std::placeholders::_1);
+      loop_->runInLoop(std::bind(&TcpConnection::setCloseCallback, conn, cb));
+      if (unique) // 用户没有持有这个连接, 没人会再关闭它了
+        conn->forceClose();
+    }
+    else
+    {
+      connector_->stop();
+    }
+  }
+
+  void TcpClient::connect()
+  {
+    LOG_INFO("TcpClient::connect [%s] - connecting to %s \n", name_.c_str(), connector_->serverAddress().toIpPort().c_str());
+    connect_ = true;
+    connector_->start();
+  }
+
+  void TcpClient::disconnect()
+  {
+    connect_ = false;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (connection_)
+      connection_->shutdown();
+  }
+
+  void TcpClient::stop()
+  {
+    connect_ = false;
+    connector_->stop();
+  }
+
+  void TcpClient::newConnection(int sockfd)
+  {
+    sockaddr_in local, peer;
+    ::bzero(&local, sizeof local);
+    ::bzero(&peer, sizeof peer);
+    socklen_t addrlen = sizeof local;
+    if (::getsockname(sockfd, (sockaddr *)&local, &addrlen) < 0)
+      LOG_ERROR("TcpClient::newConnection getsockname");
+    addrlen = sizeof peer;
+    if (::getpeername(sockfd, (sockaddr *)&peer, &addrlen) < 0)
+      LOG_ERROR("TcpClient::newConnection getpeername");
+    InetAddress localAddr(local);
+    InetAddress peerAddr(peer);
+
+    char buf[64] = {0};
+    snprintf(buf, sizeof buf, ":%s#%d", peerAddr.toIpPort().c_str(), nextConnId_++);
+    std::string connName = name_ + buf;
+
+    TcpConnectionPtr conn(new TcpConnection(loop_, connName, sockfd, localAddr, peerAddr));
+    conn->setConnectionCallback(connectionCallback_);
+    conn->setMessageCallback(messageCallback_);
+    conn->setWriteCompleteCallback(writeCompleteCallback_);
+    conn->setCloseCallback(std::bind(&TcpClient::removeConnection, this, std::placeholders::_1));
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      connection_ = conn;
+    }
+    conn->connectEstablished();
+  }
+
+  void TcpClient::removeConnection(const TcpConnectionPtr &conn)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      connection_.reset();
+    }
+    loop_->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+    if (retry_ && connect_)
+    {
+      LOG_INFO("TcpClient::removeConnection [%s] - reconnecting to %s \n", name_.c_str(),
+               connector_->serverAddress().toIpPort().c_str());
+      connector_->restart();
+    }
+  }
+
+} // namespace zfwmuduo
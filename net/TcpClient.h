@@ -0,0 +1,78 @@
+#pragma once
+/**
+ * 和TcpServer一样, 用户只需要包含TcpClient.h
+ */
+#include <string>
+#include <atomic>
+#include <mutex>
+#include "../base/noncopyable.h"
+#include "EventLoop.h"
+#include "InetAddress.h"
+#include "Callbacks.h"
+#include "Connector.h"
+#include "TcpConnection.h"
+#include "Buffer.h"
+
+/**
+ * TcpClient: 客户端编程使用的类, 管理到serverAddr的一个连接
+ * Connector负责(带退避重试的)非阻塞connect, 连上之后和服务端一样用TcpConnection收发
+ * 所有的连接都属于构造时给定的loop; 成千上万的出站连接可以分给EventLoopThreadPool中的多个loop
+ */
+
+namespace zfwmuduo
+{
+  class TcpClient : noncopyable
+  {
+  public:
+    TcpClient(EventLoop *loop, const InetAddress &serverAddr, const std::string &nameArg);
+    // NOTE: 要在loop线程中析构, 或者loop已经停止之后析构
+    ~TcpClient();
+
+    void connect();    // 开始连接, 可跨线程调用
+    void disconnect(); // 已连上时半关闭(shutdown), 不再重连
+    void stop();       // 还在连接中时放弃
+
+    // 当前的连接, 没有连上时为空
+    TcpConnectionPtr connection() const
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return connection_;
+    }
+
+    EventLoop *getLoop() const { return loop_; }
+    const std::string &name() const { return name_; }
+
+    // 连接断开后自动重连(重新走Connector的退避), 默认关闭
+    bool retry() const { return retry_; }
+    void enableRetry() { retry_ = true; }
+    // 连接失败时的重试间隔(秒), 见Connector::setRetryDelay; 需在connect()之前设置
+    void setRetryDelay(double initial, double max) { connector_->setRetryDelay(initial, max); }
+    // 连接失败的累计次数
+    int connectRetries() const { return connector_->retries(); }
+
+    // 以下回调不是线程安全的, 需在connect()之前设置
+    void setConnectionCallback(ConnectionCallback cb) { connectionCallback_ = std::move(cb); }
+    void setMessageCallback(MessageCallback cb) { messageCallback_ = std::move(cb); }
+    void setWriteCompleteCallback(WriteCompleteCallback cb) { writeCompleteCallback_ = std::move(cb); }
+
+  private:
+    void newConnection(int sockfd); // 在loop线程中由Connector回调
+    void removeConnection(const TcpConnectionPtr &conn);
+
+    EventLoop *loop_;
+    ConnectorPtr connector_;
+    const std::string name_;
+
+    ConnectionCallback connectionCallback_;
+    MessageCallback messageCallback_;
+    WriteCompleteCallback writeCompleteCallback_;
+
+    std::atomic_bool retry_;
+    std::atomic_bool connect_;
+    int nextConnId_; // 只在loop线程中使用
+
+    mutable std::mutex mutex_;
+    TcpConnectionPtr connection_; // 由mutex_保护
+  };
+
+} // namespace zfwmuduo
@@ -3,15 +3,24 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <string.h>
+#include <stdio.h> // snprintf()
 #include <netinet/tcp.h>
+#include <netinet/in.h>         // IPPROTO_IP IP_RECVERR
+#include <linux/errqueue.h>     // sock_extended_err SO_EE_ORIGIN_ZEROCOPY
+#include <sys/sendfile.h> // ::sendfile()
+#include <sys/uio.h>      // ::writev()
+#include <limits.h>       // IOV_MAX
+#include <unistd.h>       // ::dup() ::close()
 #include <memory> // shared_from_this()
 #include <string>
+#include <algorithm> // min()
 
 #include "TcpConnection.h"
 #include "Logger.h"
 #include "Socket.h"
 #include "Channel.h"
 #include "EventLoop.h"
+#include "TcpRelay.h"
 
 namespace zfwmuduo
 {
@@ -25,19 +34,54 @@ namespace zfwmuduo
     return loop;
   }
 
+  static TcpConnection::CallbackTablePtr makeCallbackTable(const std::string &name)
+  {
+    TcpConnection::CallbackTablePtr callbacks = std::make_shared<TcpConnection::CallbackTable>();
+    callbacks->namePrefix = name;
+    return callbacks;
+  }
+
   TcpConnection::TcpConnection(EventLoop *loop,
                                const std::string &name,
                                int sockfd,
                                const InetAddress &localAddr,
+                               const InetAddress &peerAddr) : TcpConnection(loop, makeCallbackTable(name), sockfd, localAddr, peerAddr)
+  {
+  }
+
+  TcpConnection::TcpConnection(EventLoop *loop,
+                               const CallbackTablePtr &callbacks,
+                               int sockfd,
+                               const InetAddress &localAddr,
                                const InetAddress &peerAddr) : loop_(CheckLoopNotNull(loop)),
-                                                              name_(name),
+                                                              id_(0),
                                                               state_(kConnecting),
                                                               reading_(true),
                                                               socket_(new Socket(sockfd)),
                                                               channel_(new Channel(loop, sockfd)),
                                                               localAddr_(localAddr),
                                                               peerAddr_(peerAddr),
-                                                              highWaterMark_(64 * 1024 * 1024)
+                                                              callbacks_(callbacks),
+                                                              highWaterMark_(64 * 1024 * 1024),
+                                                              backpressureHigh_(0),
+                                                              backpressureLow_(0),
+                                                              backpressureActive_(false),
+                                                              backpressurePauses_(0),
+                                                              readHolds_(0),
+                                                              chainedOutput_(false),
+                                                              autoCork_(false),
+                                                              corkScheduled_(false),
+                                                              fileBytes_(0),
+                                                              outputFlushed_(0),
+                                                              zeroCopyThreshold_(0),
+                                                              zeroCopyNextSeq_(0),
+                                                              zeroCopyCompletions_(0),
+                                                              zeroCopyCopied_(0),
+                                                              shrinkThreshold_(256 * 1024),
+                                                              memoryUsage_(0),
+                                                              lastActive_(Timestamp::now().microSecondsSinceEpoch()),
+                                                              idleTimeout_(0.0),
+                                                              idleTimerArmed_(false)
   {
     // 事件循环通过 Poller（如 epoll）检测套接字的状态变化，并在适当的时机调用这些回调函数
     // 下面给channel设置相应的回调函数, poller给channel通知感兴趣的事件发生了, channel会回调相应的操作函数
@@ -46,22 +90,68 @@ namespace zfwmuduo
     channel_->setCloseCallback(std::bind(&TcpConnection::handleClose, this));
     channel_->setErrorCallback(std::bind(&TcpConnection::handleError, this));
 
-    LOG_INFO("TcpConnection::ctor[%s] at fd=%d\n", name_.c_str(), sockfd);
+    LOG_INFO("TcpConnection::ctor[%s] at fd=%d\n", callbacks_->namePrefix.c_str(), sockfd);
     socket_->setKeepAlive(true); // 启动tcp socket的保活机制
+    loop_->incConnectionCount(); // 在选择subloop的线程中立刻计数, 连续到来的连接才能看到彼此
+    updateMemoryUsage();
   }
   TcpConnection::~TcpConnection()
   {
-    LOG_INFO("TcpConnection::dtor[%s] at fd=%d state=%d \n", name_.c_str(), channel_->fd(), (int)state_);
+    LOG_INFO("TcpConnection::dtor[%s] id=%llu at fd=%d state=%d \n", callbacks_->namePrefix.c_str(),
+             static_cast<unsigned long long>(id_), channel_->fd(), (int)state_);
+    for (size_t i = 0; i < files_.size(); ++i)
+    { // 连接断开时还没发完的文件
+      ::close(files_[i].fd);
+    }
+    if (!zeroCopyPending_.empty())
+      handleZeroCopyCompletions();
+    if (!zeroCopyPending_.empty())
+    { // TAG: forceClose/空闲超时/stop的deadline都可能在内核确认之前销毁连接, 普通的close之后内核还会继续发送队列里的数据,
+      // 而它们引用的内存马上就要随zeroCopyPending_释放, 被复用之后对端就会收到错乱的数据; 所以直接RST, 让内核丢掉这些数据
+      LOG_INFO("TcpConnection::dtor[%s] %zu zero-copy sends not acknowledged, aborting connection \n",
+               callbacks_->namePrefix.c_str(), zeroCopyPending_.size());
+      socket_->setAbortOnClose();
+    }
+    loop_->decConnectionCount();
+  }
+
+  const std::string &TcpConnection::name() const
+  {
+    if (id_ == 0)
+      return callbacks_->namePrefix;
+    std::call_once(nameOnce_, [this]()
+                   {
+                     char buf[32]; // 十六进制能直接看出id的各个字段
+                     snprintf(buf, sizeof buf, "#%llx", static_cast<unsigned long long>(id_));
+                     name_ = callbacks_->namePrefix + buf; });
+    return name_;
   }
 
   void TcpConnection::handleRead(Timestamp receiveTime)
   {
+    if (relay_)
+    {
+      relay_->handleReadable(this);
+      return;
+    }
+    if (channel_->isEdgeTriggered())
+    {
+      handleReadEdgeTriggered(receiveTime);
+      return;
+    }
+
     int savedErrno = 0;
     ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
     if (n > 0)
     {
+      if (idleTimerArmed_) // 收到数据, 重新开始计算空闲时间
+      {
+        loop_->timingWheel()->refresh(idleTimer_, idleTimeout_);
+      }
       // 已建立连接的用户, 有可读事件发生了, 调用用户传入的回调操作onMessage
-      messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+      callbacks_->messageCallback(shared_from_this(), &inputBuffer_, receiveTime);
+      lastActive_ = receiveTime.microSecondsSinceEpoch();
+      shrinkInputIfIdle();
     }
     else if (n == 0)
     {
@@ -75,34 +165,85 @@ namespace zfwmuduo
     }
   }
 
+  // ET模式: 一次把socket接收缓冲区读空, 再统一回调onMessage
+  void TcpConnection::handleReadEdgeTriggered(Timestamp receiveTime)
+  {
+    int savedErrno = 0;
+    bool peerClosed = false;
+    ssize_t n = inputBuffer_.readFdUntilEagain(channel_->fd(), &savedErrno, &peerClosed);
+    if (n > 0)
+    {
+      if (idleTimerArmed_)
+      {
+        loop_->timingWheel()->refresh(idleTimer_, idleTimeout_);
+      }
+      callbacks_->messageCallback(shared_from_this(), &inputBuffer_, receiveTime);
+      lastActive_ = receiveTime.microSecondsSinceEpoch();
+      shrinkInputIfIdle();
+    }
+
+    if (peerClosed)
+    { // 对端关闭之前发来的数据上面已经交给用户了
+      if (state_ != kDisconnected)
+        handleClose();
+    }
+    else if (savedErrno != 0)
+    { // TAG: 硬错误(比如ECONNRESET)时EPOLLHUP是和EPOLLIN一起来的, Channel不会回调closeCallback, ET下也不会再有通知;
+      // 这里不关闭的话连接和fd就一直泄漏; 出错之前读到的数据上面已经交给用户了
+      errno = savedErrno;
+      LOG_ERROR("TcpConnection::handleReadEdgeTriggered");
+      handleError();
+      if (state_ != kDisconnected)
+        handleClose();
+    }
+  }
+
   void TcpConnection::handleWrite()
   {
+    if (relay_)
+    {
+      relay_->handleWritable(this);
+      return;
+    }
     if (channel_->isWriting())
     {
+      // ET模式下写事件是常驻的, 可写通知到来时不一定有待发送的数据
+      if (channel_->isEdgeTriggered() && outputBytes() == 0)
+        return;
+
       int savedErrno = 0;
-      ssize_t n = outputBuffer_.writeFd(channel_->fd(), &savedErrno);
-      if (n > 0)
+      ssize_t n = 0;
+      do
       {
-        outputBuffer_.retrieve(n);
-        if (outputBuffer_.readableBytes() == 0) // 表示发送完成
-        {
+        n = flushOutput(&savedErrno);
+        // ET模式下要一直写到EAGAIN或者写完为止, 否则不会再有可写通知
+      } while (n > 0 && channel_->isEdgeTriggered() && outputBytes() > 0);
+
+      lastActive_ = loop_->pollReturnTime().microSecondsSinceEpoch();
+      updateBackpressure();
+      if (outputBytes() == 0) // 表示发送完成
+      {
+        shrinkOutputIfIdle();
+        if (!channel_->isEdgeTriggered())
+        { // LT模式下不关闭写事件的话, poller会一直通知EPOLLOUT
           channel_->disableWriting();
-          if (writeCompleteCallback_)
-          { // 唤醒loop_对应的thread线程, 执行回调
-            loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
-          }
-          if (state_ == kDisconnecting)
-          { // 正在关闭状态
-            shutdownInLoop();
-          }
         }
-        else
-        {
-          LOG_ERROR("TcpConnection::handleWrite");
+        if (callbacks_->writeCompleteCallback)
+        { // 唤醒loop_对应的thread线程, 执行回调
+          loop_->queueInLoop(std::bind(callbacks_->writeCompleteCallback, shared_from_this()));
+        }
+        if (state_ == kDisconnecting)
+        { // 正在关闭状态
+          shutdownInLoop();
         }
       }
+      else if (n < 0 && savedErrno != EAGAIN && savedErrno != EWOULDBLOCK)
+      {
+        errno = savedErrno;
+        LOG_ERROR("TcpConnection::handleWrite");
+      }
     }
-    else
+    else if (!channel_->isEdgeTriggered()) // ET模式下连接关闭时仍可能带着EPOLLOUT, 属于正常情况
     {
       LOG_ERROR("TcpConnection fd=%d is down, no more writing \n", channel_->fd());
     }
@@ -114,15 +255,30 @@ namespace zfwmuduo
     LOG_INFO("TcpConnection::handleClose fd=%d state=%d \n", channel_->fd(), (int)state_);
     setState(kDisconnected);
     channel_->disableAll();
+    cancelIdleTimer();
+    updateBackpressure();
+    if (relay_)
+    { // 转发的另一端也要关闭
+      std::shared_ptr<TcpRelay> relay;
+      relay.swap(relay_);
+      relay->handleClose(this);
+    }
 
     // NOTE: std::shared_from_this()：这是 std::enable_shared_from_this 类的成员函数，用于生成一个指向当前对象的 std::shared_ptr
     TcpConnectionPtr connPtr(shared_from_this()); // 注意! 这里不是创建对象, 而是通过智能指针指向当前对象!
-    connectionCallback_(connPtr);                 // 执行连接关闭的回调
-    closeCallback_(connPtr);                      // 关闭连接的回调 执行的是TcpServer::removeConnection回调方法
+    callbacks_->connectionCallback(connPtr);                 // 执行连接关闭的回调
+    callbacks_->closeCallback(connPtr);                      // 关闭连接的回调 执行的是TcpServer::removeConnection回调方法
   }
 
   void TcpConnection::handleError()
   {
+    // NOTE: 零拷贝发送的完成通知也是通过EPOLLERR报告的, 这不是真正的错误
+    if (!zeroCopyPending_.empty() && handleZeroCopyCompletions())
+    { // 确认的发送引用的内部块这时才释放
+      updateMemoryUsage();
+      return;
+    }
+
     int optval;
     socklen_t optlen = sizeof optval;
     int err = 0;
@@ -135,7 +291,52 @@ namespace zfwmuduo
     {
       err = optval;
     }
-    LOG_ERROR("TcpConnection::handleError name:%s - SO_ERROR:%d \n", name_.c_str(), err);
+    LOG_ERROR("TcpConnection::handleError name:%s - SO_ERROR:%d \n", name().c_str(), err);
+  }
+
+  bool TcpConnection::handleZeroCopyCompletions()
+  {
+    bool handled = false;
+    while (true)
+    {
+      char control[128];
+      struct msghdr msg;
+      ::memset(&msg, 0, sizeof msg);
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof control;
+      if (::recvmsg(channel_->fd(), &msg, MSG_ERRQUEUE) < 0)
+        break; // EAGAIN: 错误队列读空了
+      for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm))
+      {
+        if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+              (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)))
+          continue;
+        const struct sock_extended_err *err = reinterpret_cast<const struct sock_extended_err *>(CMSG_DATA(cm));
+        if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+          continue;
+        // 一条通知确认[ee_info, ee_data]范围内的多次发送, 按序号顺序释放对它们内存的引用
+        uint32_t last = err->ee_data;
+        while (!zeroCopyPending_.empty() && static_cast<int32_t>(zeroCopyPending_.front().seq - last) <= 0)
+        {
+          zeroCopyPending_.pop_front();
+          ++zeroCopyCompletions_;
+        }
+        if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+          zeroCopyCopied_ += last - err->ee_info + 1;
+        handled = true;
+      }
+    }
+    return handled;
+  }
+
+  TcpConnection::ZeroCopyStats TcpConnection::zeroCopyStats() const
+  {
+    ZeroCopyStats stats;
+    stats.sends = zeroCopyNextSeq_;
+    stats.completions = zeroCopyCompletions_;
+    stats.copied = zeroCopyCopied_;
+    stats.pendingSends = zeroCopyPending_.size();
+    return stats;
   }
 
   void TcpConnection::send(const std::string &buf)
@@ -144,21 +345,198 @@ namespace zfwmuduo
     { // 发送数据必须是已建立连接的状态
       if (loop_->isInLoopThread())
       {
-        sendInLoop(buf.c_str(), buf.size());
+        sendInLoop(buf.data(), buf.size());
       }
       else
+      { // NOTE: 不能只绑定buf.c_str(), 调用方的string可能在回调执行之前就析构了; 拷贝一份由回调持有
+        loop_->runInLoop(std::bind(&TcpConnection::sendStringInLoop, shared_from_this(), buf));
+      }
+    }
+  }
+
+  void TcpConnection::send(std::string &&buf)
+  {
+    if (state_ == kConnected)
+    {
+      if (zeroCopyThreshold_ > 0 && buf.size() >= zeroCopyThreshold_)
+      { // 零拷贝: 接管string的所有权, 发送完成(内核确认)之前一直由shared_ptr引用
+        std::shared_ptr<std::string> owner = std::make_shared<std::string>(std::move(buf));
+        send(std::shared_ptr<const char>(owner, owner->data()), owner->size());
+      }
+      else if (loop_->isInLoopThread())
       {
-        loop_->runInLoop(std::bind(
-            &TcpConnection::sendInLoop,
-            this,
-            buf.c_str(),
-            buf.size()));
+        sendInLoop(buf.data(), buf.size());
+      }
+      else
+      { // bind把右值移动进自己的存储, Functor再从bind对象移动构造, 字符数组始终只有一份
+        loop_->runInLoop(std::bind(&TcpConnection::sendStringInLoop, shared_from_this(), std::move(buf)));
       }
     }
   }
 
-  // 发送数据 应用写的快, 而内核发送数据慢, 因此需将发送数据写入缓冲区,且设置了水位回调
+  void TcpConnection::send(const void *data, size_t len)
+  {
+    if (state_ == kConnected)
+    {
+      if (loop_->isInLoopThread())
+      {
+        sendInLoop(data, len);
+      }
+      else
+      {
+        send(std::string(static_cast<const char *>(data), len));
+      }
+    }
+  }
+
+  void TcpConnection::send(Buffer *buf)
+  {
+    if (state_ == kConnected)
+    {
+      if (loop_->isInLoopThread())
+      {
+        sendInLoop(buf->peek(), buf->readableBytes());
+        buf->retrieveAll();
+      }
+      else
+      { // 把buf的存储交换到一个新的Buffer里交给回调, buf变成空的(未分配存储)
+        std::shared_ptr<Buffer> owned = std::make_shared<Buffer>();
+        owned->swap(*buf);
+        loop_->runInLoop(std::bind(&TcpConnection::sendBufferInLoop, shared_from_this(), owned));
+      }
+    }
+  }
+
+  void TcpConnection::send(const std::shared_ptr<const char> &data, size_t len)
+  {
+    if (state_ == kConnected)
+    {
+      if (loop_->isInLoopThread())
+      {
+        sendSharedInLoop(data, len);
+      }
+      else
+      { // data由shared_ptr持有, 跨线程也不会悬空
+        loop_->runInLoop(std::bind(&TcpConnection::sendSharedInLoop, shared_from_this(), data, len));
+      }
+    }
+  }
+
+  void TcpConnection::sendFile(int fd, off_t offset, size_t length)
+  {
+    if (state_ != kConnected || length == 0)
+      return;
+    int dupFd = ::dup(fd); // 在调用方线程dup, 调用方返回后立刻关闭自己的fd也没关系
+    if (dupFd < 0)
+    {
+      LOG_ERROR("TcpConnection::sendFile dup fd=%d errno=%d \n", fd, errno);
+      return;
+    }
+    if (loop_->isInLoopThread())
+    {
+      sendFileInLoop(dupFd, offset, length);
+    }
+    else
+    {
+      loop_->runInLoop(std::bind(&TcpConnection::sendFileInLoop, shared_from_this(), dupFd, offset, length));
+    }
+  }
+
+  void TcpConnection::sendFileInLoop(int fd, off_t offset, size_t length)
+  {
+    if (state_ == kDisconnected)
+    {
+      LOG_ERROR("disconnected, give up sending file!");
+      ::close(fd);
+      return;
+    }
+
+    PendingFile file = {fd, offset, length, outputFlushed_ + bufferedBytes()};
+    files_.push_back(file);
+    size_t oldLen = outputBytes();
+    fileBytes_ += length;
+
+    if ((channel_->isEdgeTriggered() || !channel_->isWriting()) && oldLen == 0)
+    { // 前面没有排队的数据, 直接发, 一直发到socket发送缓冲区满
+      int savedErrno = 0;
+      ssize_t n = 0;
+      do
+      {
+        n = sendFileChunk(&savedErrno);
+      } while (n > 0 && !files_.empty());
+
+      if (files_.empty())
+      {
+        if (callbacks_->writeCompleteCallback)
+          loop_->queueInLoop(std::bind(callbacks_->writeCompleteCallback, shared_from_this()));
+        return;
+      }
+      if (n < 0 && savedErrno != EAGAIN)
+      {
+        errno = savedErrno;
+        LOG_ERROR("TcpConnection::sendFileInLoop");
+        if (savedErrno == EPIPE || savedErrno == ECONNRESET)
+          return; // 连接出错, 剩下的文件在析构时关闭
+      }
+    }
+
+    size_t newLen = outputBytes();
+    if (newLen >= highWaterMark_ && oldLen < highWaterMark_ && callbacks_->highWaterMarkCallback)
+    {
+      loop_->queueInLoop(std::bind(callbacks_->highWaterMarkCallback, shared_from_this(), newLen));
+    }
+    updateBackpressure();
+    if (!channel_->isWriting())
+    {
+      channel_->enableWriting();
+    }
+  }
+
+  ssize_t TcpConnection::sendFileChunk(int *savedErrno)
+  {
+    PendingFile &file = files_.front();
+    // NOTE: 单次sendfile最多传输0x7ffff000字节
+    size_t count = std::min(file.remaining, static_cast<size_t>(0x7ffff000));
+    ssize_t n = ::sendfile(channel_->fd(), file.fd, &file.offset, count);
+    if (n > 0)
+    {
+      file.remaining -= n;
+      fileBytes_ -= n;
+    }
+    else if (n < 0)
+    {
+      *savedErrno = errno;
+      return n;
+    }
+    else
+    { // 文件比调用方给的长度短, 剩下的部分没法发了
+      LOG_ERROR("TcpConnection::sendFileChunk [%s] file truncated, %zu bytes not sent \n", name().c_str(), file.remaining);
+      fileBytes_ -= file.remaining;
+      file.remaining = 0;
+    }
+
+    if (file.remaining == 0)
+    {
+      ::close(file.fd);
+      files_.pop_front();
+      if (n == 0)
+        return flushOutput(savedErrno); // 接着发后面的数据
+    }
+    return n;
+  }
+
   void TcpConnection::sendInLoop(const void *data, size_t len)
+  {
+    sendBytesInLoop(data, len, std::shared_ptr<const char>());
+  }
+
+  void TcpConnection::sendSharedInLoop(const std::shared_ptr<const char> &data, size_t len)
+  {
+    sendBytesInLoop(data.get(), len, data);
+  }
+
+  // 发送数据 应用写的快, 而内核发送数据慢, 因此需将发送数据写入缓冲区,且设置了水位回调
+  void TcpConnection::sendBytesInLoop(const void *data, size_t len, const std::shared_ptr<const char> &owner)
   {
     ssize_t nwrote = 0;
     size_t remaining = len;  // 表示没发送完的数据
@@ -171,17 +549,19 @@ namespace zfwmuduo
       return;
     }
 
-    // 表示channel_第一次开始写数据, 而且缓冲区没有待发送数据
-    if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
+    // 表示channel_第一次开始写数据, 而且缓冲区没有待发送数据(ET模式下写事件常驻, 只看缓冲区)
+    // 自动cork模式下总是先放进缓冲区; 可以零拷贝发送的数据也是, 由flushOutput用MSG_ZEROCOPY发送
+    bool zeroCopy = owner && zeroCopyThreshold_ > 0 && len >= zeroCopyThreshold_;
+    if (!autoCork_ && !zeroCopy && (channel_->isEdgeTriggered() || !channel_->isWriting()) && outputBytes() == 0)
     {
       nwrote = ::write(channel_->fd(), data, len);
       if (nwrote >= 0)
       {
         remaining = len - nwrote;
-        if (remaining == 0 && writeCompleteCallback_)
+        if (remaining == 0 && callbacks_->writeCompleteCallback)
         {
           // 既然在这里数据全部发送完成, 就不用再给channel设置epoll事件了
-          loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+          loop_->queueInLoop(std::bind(callbacks_->writeCompleteCallback, shared_from_this()));
         }
       }
       else // nwrote < 0 也就是出错
@@ -206,27 +586,281 @@ namespace zfwmuduo
     if (!faultError && remaining > 0)
     {
       // 目前发送缓冲区待发送的剩余数据长度
-      size_t oldLen = outputBuffer_.readableBytes();
-      if (oldLen + remaining >= highWaterMark_ && oldLen < highWaterMark_)
+      size_t oldLen = outputBytes();
+      const char *rest = static_cast<const char *>(data) + nwrote;
+      if (chainedOutput_ && owner)
+      { // 零拷贝: 别名构造, 和owner共享引用计数, 指向还没发送的部分
+        outputChain_.append(std::shared_ptr<const char>(owner, rest), remaining);
+      }
+      else
       {
-        loop_->queueInLoop(std::bind(highWaterMarkCallback_, shared_from_this(), oldLen + remaining));
+        appendOutput(rest, remaining);
       }
-      outputBuffer_.append(static_cast<const char *>(data) + nwrote, remaining);
-      if (!channel_->isWriting())
+      if (zeroCopy && !autoCork_ && oldLen == 0 && (channel_->isEdgeTriggered() || !channel_->isWriting()))
+      { // 前面没有排队的数据, 不用等EPOLLOUT, 立即零拷贝发送
+        flushPending();
+        if (outputBytes() == 0)
+          return;
+      }
+      outputQueued(oldLen);
+    }
+  }
+
+  void TcpConnection::sendv(const struct iovec *iov, int iovcnt)
+  {
+    if (state_ == kConnected)
+    {
+      if (loop_->isInLoopThread())
+      {
+        sendvInLoop(iov, iovcnt);
+      }
+      else
+      { // 跨线程: 片段拼成一个string, 移动进回调
+        std::string joined;
+        for (int i = 0; i < iovcnt; ++i)
+        {
+          joined.append(static_cast<const char *>(iov[i].iov_base), iov[i].iov_len);
+        }
+        send(std::move(joined));
+      }
+    }
+  }
+
+  void TcpConnection::sendvInLoop(const struct iovec *iov, int iovcnt)
+  {
+    if (state_ == kDisconnected)
+    {
+      LOG_ERROR("disconnected, give up writing!");
+      return;
+    }
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; ++i)
+    {
+      total += iov[i].iov_len;
+    }
+    if (total == 0)
+      return;
+
+    size_t nwrote = 0;
+    if (!autoCork_ && (channel_->isEdgeTriggered() || !channel_->isWriting()) && outputBytes() == 0)
+    { // 和sendBytesInLoop一样, 缓冲区为空时直接写, 只是一次写多个片段
+      ssize_t n = ::writev(channel_->fd(), iov, std::min(iovcnt, IOV_MAX));
+      if (n >= 0)
       {
-        channel_->enableReading(); // 这里一定要注册channel的写事件, 否则poller不会给channel通知epollout
+        nwrote = n;
+        if (nwrote == total)
+        {
+          if (callbacks_->writeCompleteCallback)
+            loop_->queueInLoop(std::bind(callbacks_->writeCompleteCallback, shared_from_this()));
+          return;
+        }
+      }
+      else if (errno != EWOULDBLOCK)
+      {
+        LOG_ERROR("TcpConnection::sendvInLoop");
+        if (errno == EPIPE || errno == ECONNRESET)
+          return;
+      }
+    }
+
+    // 没写完的部分按顺序追加到发送缓冲区, 跳过已经写出去的nwrote字节
+    size_t oldLen = outputBytes();
+    for (int i = 0; i < iovcnt; ++i)
+    {
+      size_t len = iov[i].iov_len;
+      if (nwrote >= len)
+      {
+        nwrote -= len;
+        continue;
+      }
+      appendOutput(static_cast<const char *>(iov[i].iov_base) + nwrote, len - nwrote);
+      nwrote = 0;
+    }
+    outputQueued(oldLen);
+  }
+
+  void TcpConnection::outputQueued(size_t oldLen)
+  {
+    size_t newLen = outputBytes();
+    if (newLen >= highWaterMark_ && oldLen < highWaterMark_ && callbacks_->highWaterMarkCallback)
+    {
+      loop_->queueInLoop(std::bind(callbacks_->highWaterMarkCallback, shared_from_this(), newLen));
+    }
+    updateMemoryUsage();
+    updateBackpressure();
+    if (autoCork_)
+    { // 同一轮里只安排一次, 本轮所有的send合并到一次写
+      if (!corkScheduled_)
+      {
+        corkScheduled_ = true;
+        loop_->runAtIterationEnd(std::bind(&TcpConnection::flushCorked, shared_from_this()));
       }
     }
+    else if (!channel_->isWriting())
+    {
+      channel_->enableWriting(); // 这里一定要注册channel的写事件, 否则poller不会给channel通知epollout
+    }
+  }
+
+  void TcpConnection::flushCorked()
+  {
+    corkScheduled_ = false;
+    flushPending();
+  }
+
+  void TcpConnection::flushPending()
+  {
+    if (state_ == kDisconnected || outputBytes() == 0)
+      return;
+    if (!channel_->isEdgeTriggered() && channel_->isWriting())
+      return; // 之前的数据还没写完, 正在等EPOLLOUT, 由handleWrite接着发
+
+    int savedErrno = 0;
+    ssize_t n = 0;
+    do
+    {
+      n = flushOutput(&savedErrno);
+    } while (n > 0 && outputBytes() > 0);
+    updateBackpressure();
+
+    if (outputBytes() == 0)
+    {
+      shrinkOutputIfIdle();
+      if (callbacks_->writeCompleteCallback)
+        loop_->queueInLoop(std::bind(callbacks_->writeCompleteCallback, shared_from_this()));
+      if (state_ == kDisconnecting)
+        shutdownInLoop();
+      return;
+    }
+    if (n < 0 && savedErrno != EAGAIN && savedErrno != EWOULDBLOCK)
+    {
+      errno = savedErrno;
+      LOG_ERROR("TcpConnection::flushPending");
+      return;
+    }
+    if (!channel_->isWriting())
+      channel_->enableWriting(); // 写不动了, 剩下的等EPOLLOUT
+  }
+
+  void TcpConnection::appendOutput(const char *data, size_t len)
+  {
+    if (chainedOutput_)
+      outputChain_.append(data, len);
+    else
+      outputBuffer_.append(data, len);
+  }
+
+  ssize_t TcpConnection::flushOutput(int *savedErrno)
+  {
+    if (!files_.empty() && files_.front().position == outputFlushed_)
+    { // 排在文件前面的数据都发完了, 轮到文件
+      return sendFileChunk(savedErrno);
+    }
+    if (bufferedBytes() == 0)
+      return 0;
+
+    // 有文件排队时, 只能发到文件的位置为止
+    size_t limit = files_.empty() ? bufferedBytes() : files_.front().position - outputFlushed_;
+    if (zeroCopyThreshold_ > 0 && limit >= zeroCopyThreshold_)
+    {
+      ssize_t n = outputChain_.sendZeroCopy(channel_->fd(), savedErrno, limit);
+      if (n > 0)
+      { // 内核确认之前, 发出去的这部分内存不能释放
+        ZeroCopySend pending;
+        pending.seq = zeroCopyNextSeq_++;
+        outputChain_.retrieve(n, &pending.pinned);
+        zeroCopyPending_.push_back(std::move(pending));
+        outputFlushed_ += n;
+        return n;
+      }
+      if (*savedErrno != ENOBUFS)
+        return n;
+      // ENOBUFS: 通知占用的socket选项内存(optmem_max)用完了, 这一次退回普通的拷贝发送
+    }
+    ssize_t n = chainedOutput_ ? outputChain_.writeFd(channel_->fd(), savedErrno, limit)
+                               : outputBuffer_.writeFd(channel_->fd(), savedErrno, limit);
+    if (n > 0)
+    {
+      if (chainedOutput_)
+        outputChain_.retrieve(n);
+      else
+        outputBuffer_.retrieve(n);
+      outputFlushed_ += n;
+    }
+    return n;
+  }
+
+  void TcpConnection::shrinkInputIfIdle()
+  {
+    if (shrinkThreshold_ > 0)
+    {
+      if (inputBuffer_.readableBytes() == 0)
+      { // NOTE: 数据被用户全部取走, 存储直接还给内存池(线程缓存, 不加锁), 下一次读再取; 空闲连接不占接收缓冲区
+        inputBuffer_.releaseIfEmpty();
+      }
+      else if (inputBuffer_.internalCapacity() > shrinkThreshold_ &&
+               inputBuffer_.readableBytes() < shrinkThreshold_)
+      { // NOTE: 按预测的下一次读的大小预留, 持续大流量的连接不会每次读都收缩再扩容
+        inputBuffer_.shrink(inputBuffer_.nextReadSize());
+      }
+    }
+    updateMemoryUsage();
+  }
+
+  void TcpConnection::shrinkOutputIfIdle()
+  {
+    if (shrinkThreshold_ > 0)
+    { // 发送完了, 发送缓冲区和分段缓冲区正在写入的块都还回去
+      outputBuffer_.releaseIfEmpty();
+      outputChain_.releaseTail();
+    }
+    updateMemoryUsage();
+  }
+
+  void TcpConnection::updateMemoryUsage()
+  {
+    memoryUsage_ = inputBuffer_.internalCapacity() + outputBuffer_.internalCapacity() + outputChain_.internalCapacity();
+  }
+
+  void TcpConnection::reclaimMemory()
+  {
+    loop_->runInLoop(std::bind(&TcpConnection::reclaimMemoryInLoop, shared_from_this()));
+  }
+
+  void TcpConnection::reclaimMemoryInLoop()
+  {
+    inputBuffer_.shrink(0);
+    outputBuffer_.shrink(0);
+    if (outputChain_.readableBytes() == 0)
+      outputChain_.releaseTail();
+    updateMemoryUsage();
   }
 
   void TcpConnection::connectEstablished()
   {
     setState(kConnected);
     channel_->tie(shared_from_this());
-    channel_->enableReading(); // 向poller注册channel的epollin事件
+    if (zeroCopyThreshold_ > 0 && !socket_->setZeroCopy(true))
+    {
+      LOG_ERROR("TcpConnection::connectEstablished [%s] SO_ZEROCOPY not supported, errno=%d \n", name().c_str(), errno);
+      zeroCopyThreshold_ = 0;
+    }
+    bool readable = reading_ && readHolds_ == 0; // 建立之前调用过stopRead(或者已经被背压暂停)的话先不读
+    if (channel_->isEdgeTriggered())
+    { // ET模式下写事件一直保持注册, 发送时不再需要epoll_ctl来回切换EPOLLOUT
+      if (readable)
+        channel_->enableReadingAndWriting();
+      else
+        channel_->enableWriting();
+    }
+    else if (readable)
+    {
+      channel_->enableReading(); // 向poller注册channel的epollin事件
+    }
+    startIdleTimer();
 
     // 新连接建立, 执行回调
-    connectionCallback_(shared_from_this());
+    callbacks_->connectionCallback(shared_from_this());
   }
 
   void TcpConnection::connectDestroyed()
@@ -235,8 +869,9 @@ namespace zfwmuduo
     {
       setState(kDisconnected);
       channel_->disableAll();                  // 将channel的所有感兴趣事件, 从poller中delete掉
-      connectionCallback_(shared_from_this()); // 断开连接
+      callbacks_->connectionCallback(shared_from_this()); // 断开连接
     }
+    cancelIdleTimer();
     channel_->remove(); // 把channel从poller中删除
   }
 
@@ -251,10 +886,165 @@ namespace zfwmuduo
 
   void TcpConnection::shutdownInLoop()
   {
-    if (!channel_->isWriting()) // 说明当前outputBuffer中的数据已经全部发送完成
+    if (outputBytes() == 0) // 说明当前outputBuffer中的数据已经全部发送完成
     {
       socket_->shutdownWrite(); // 关闭写端
     }
   }
 
+  void TcpConnection::setEdgeTriggered(bool on)
+  {
+    channel_->setEdgeTriggered(on);
+  }
+
+  void TcpConnection::forceClose()
+  {
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+      setState(kDisconnecting);
+      loop_->queueInLoop(std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
+    }
+  }
+
+  void TcpConnection::forceCloseInLoop()
+  {
+    if (state_ == kConnected || state_ == kDisconnecting)
+    { // 和对端关闭连接走同一条路径
+      handleClose();
+    }
+  }
+
+  void TcpConnection::startRead()
+  {
+    loop_->runInLoop(std::bind(&TcpConnection::startReadInLoop, shared_from_this()));
+  }
+
+  void TcpConnection::stopRead()
+  {
+    loop_->runInLoop(std::bind(&TcpConnection::stopReadInLoop, shared_from_this()));
+  }
+
+  void TcpConnection::startReadInLoop()
+  {
+    reading_ = true;
+    updateReading();
+  }
+
+  void TcpConnection::stopReadInLoop()
+  {
+    reading_ = false;
+    updateReading();
+  }
+
+  // NOTE: 用户的意图(reading_)和背压的暂停(readHolds_)分开记录, 两者都允许时才读:
+  // 用户stopRead之后背压放开不会恢复读, 背压暂停期间用户startRead也不会绕过水位
+  void TcpConnection::updateReading()
+  {
+    // 还没建立(connectEstablished会按reading_和readHolds_注册)或者已经关闭的连接不碰channel
+    if (state_ != kConnected && state_ != kDisconnecting)
+      return;
+    bool readable = reading_ && readHolds_ == 0;
+    if (readable && !channel_->isReading())
+    { // NOTE: ET模式下重新注册EPOLLIN时, 接收缓冲区里已有的数据会立即再通知一次
+      channel_->enableReading();
+    }
+    else if (!readable && channel_->isReading())
+    {
+      channel_->disableReading();
+    }
+  }
+
+  void TcpConnection::holdRead()
+  {
+    loop_->runInLoop(std::bind(&TcpConnection::holdReadInLoop, shared_from_this()));
+  }
+
+  void TcpConnection::releaseRead()
+  {
+    loop_->runInLoop(std::bind(&TcpConnection::releaseReadInLoop, shared_from_this()));
+  }
+
+  void TcpConnection::holdReadInLoop()
+  {
+    if (readHolds_++ == 0)
+      updateReading();
+  }
+
+  // NOTE: 扇出时每个sink各自按水位暂停/放开; 第一个降到低水位的sink不能直接startRead, 否则其他还在高水位之上的sink又会无限积压
+  void TcpConnection::releaseReadInLoop()
+  {
+    if (readHolds_ > 0 && --readHolds_ == 0)
+      updateReading();
+  }
+
+  void TcpConnection::setBackpressure(const TcpConnectionPtr &source, size_t highWaterMark, size_t lowWaterMark)
+  {
+    if (backpressureActive_)
+    { // 换source或者关闭背压之前, 先放开原来暂停的那个
+      backpressureActive_ = false;
+      TcpConnectionPtr old = backpressureSource_.lock();
+      if (old)
+        old->releaseRead();
+    }
+    backpressureSource_ = source;
+    backpressureHigh_ = highWaterMark;
+    backpressureLow_ = std::min(lowWaterMark, highWaterMark);
+    updateBackpressure();
+  }
+
+  void TcpConnection::updateBackpressure()
+  {
+    if (backpressureHigh_ == 0)
+      return;
+    size_t pending = outputBytes();
+    if (!backpressureActive_ && pending >= backpressureHigh_)
+    {
+      TcpConnectionPtr source = backpressureSource_.lock();
+      if (source)
+      {
+        backpressureActive_ = true;
+        ++backpressurePauses_;
+        source->holdRead();
+      }
+    }
+    else if (backpressureActive_ && (pending <= backpressureLow_ || state_ == kDisconnected))
+    { // 本连接断开时也要放开source, 不然它再也收不到数据
+      backpressureActive_ = false;
+      TcpConnectionPtr source = backpressureSource_.lock();
+      if (source)
+        source->releaseRead();
+    }
+  }
+
+  void TcpConnection::startIdleTimer()
+  {
+    if (idleTimeout_ > 0.0 && !idleTimerArmed_)
+    {
+      // NOTE: 时间轮里只保存weak_ptr, 不延长TcpConnection的生命周期
+      std::weak_ptr<TcpConnection> weakConn(shared_from_this());
+      idleTimer_ = loop_->timingWheel()->add(idleTimeout_, [weakConn]() {
+        TcpConnectionPtr conn = weakConn.lock();
+        if (conn)
+          conn->handleIdleTimeout();
+      });
+      idleTimerArmed_ = true;
+    }
+  }
+
+  void TcpConnection::cancelIdleTimer()
+  {
+    if (idleTimerArmed_)
+    {
+      idleTimerArmed_ = false;
+      loop_->timingWheel()->remove(idleTimer_);
+    }
+  }
+
+  void TcpConnection::handleIdleTimeout()
+  {
+    idleTimerArmed_ = false; // 时间轮已经删除了这一项, idleTimer_失效
+    LOG_INFO("TcpConnection::handleIdleTimeout [%s] idle for %.1f seconds, closing \n", name().c_str(), idleTimeout_);
+    forceClose();
+  }
+
 } // namespace zfwmuduo
\ No newline at end of file
@@ -2,11 +2,19 @@
 
 #include <memory> // enable_shared_from_this<T>
 #include <string>
+#include <deque>
+#include <vector>
 #include <atomic> // atomic_int
+#include <mutex>  // once_flag
+#include <stdint.h>
+#include <sys/types.h> // off_t
+#include <sys/uio.h>   // iovec
 #include "../base/noncopyable.h"
 #include "InetAddress.h"
 #include "Callbacks.h"
 #include "Buffer.h"
+#include "BufferChain.h"
+#include "TimingWheel.h"
 #include "../base/Timestamp.h"
 
 /**
@@ -22,6 +30,7 @@ namespace zfwmuduo
   class Channel;
   class EventLoop;
   class Socket;
+  class TcpRelay;
 
   // NOTE:enable_shared_from_this<T> 作用是允许一个类的实例安全地生成一个指向自身的 std::shared_ptr
   /**
@@ -34,38 +43,150 @@ namespace zfwmuduo
   class TcpConnection : noncopyable, public std::enable_shared_from_this<TcpConnection>
   {
   public:
+    // 回调表: TcpServer的所有连接共享同一份(引用计数), 不再每个连接各自拷贝5个std::function;
+    // 某个连接单独set回调时才复制一份再改(写时复制)
+    struct CallbackTable
+    {
+      ConnectionCallback connectionCallback;       // 有新连接时的回调
+      MessageCallback messageCallback;             // 有读写消息时的回调
+      WriteCompleteCallback writeCompleteCallback; // 消息发送后的回调
+      HighWaterMarkCallback highWaterMarkCallback;
+      CloseCallback closeCallback;
+      std::string namePrefix; // 有id的连接名字是namePrefix#id, 用到时才生成; 没有id时就是名字本身
+    };
+    typedef std::shared_ptr<CallbackTable> CallbackTablePtr;
+
     TcpConnection(EventLoop *loop,
                   const std::string &name,
                   int sockfd,
                   const InetAddress &localAddr,
                   const InetAddress &peerAddr);
+    // TcpServer使用: 共享服务端的回调表, id在所属loop中登记时分配
+    TcpConnection(EventLoop *loop,
+                  const CallbackTablePtr &callbacks,
+                  int sockfd,
+                  const InetAddress &localAddr,
+                  const InetAddress &peerAddr);
     ~TcpConnection();
 
     EventLoop *getLoop() const { return loop_; }
-    const std::string &name() const { return name_; }
+    // TcpServer分配的连接id, 可以用TcpServer::findConnection查回连接; 0表示没有(比如TcpClient的连接)
+    uint64_t id() const { return id_; }
+    // NOTE: TcpServer的连接第一次调用时才拼出名字(主要用于日志), 之后一直返回同一个string
+    const std::string &name() const;
     const InetAddress &localAddress() const { return localAddr_; }
     const InetAddress &peerAddress() const { return peerAddr_; }
 
     bool connected() const { return state_ == kConnected; }
     bool disconnected() const { return state_ == kDisconnected; }
 
-    void send(const std::string &buf); // 用于发送数据
+    // 发送数据, 都可以跨线程调用; 跨线程时数据的所有权转移到投递给loop的回调中
+    void send(const std::string &buf);       // 跨线程时拷贝一份
+    void send(std::string &&buf);            // 跨线程时把string移动进回调, 不拷贝
+    void send(const void *data, size_t len); // 跨线程时拷贝一份
+    void send(Buffer *buf);                  // 发送buf中的全部可读数据并清空buf; 跨线程时交换存储, 不拷贝
+    // 聚集写: 多个片段按顺序发送, 缓冲区为空时一次writev; 跨线程时拼成一个string
+    void sendv(const struct iovec *iov, int iovcnt);
+    // 零拷贝发送: 分段输出模式下没写完的部分只保存对data的引用, 发送完之前data保持存活; 可跨线程调用
+    void send(const std::shared_ptr<const char> &data, size_t len);
+    // 用sendfile(2)发送文件fd中[offset, offset+length)的内容, 数据不经过用户态; 可跨线程调用
+    // 和send的数据按调用顺序排队发送, 全部发完后回调writeCompleteCallback_
+    // 内部会dup一份fd, 调用方返回后就可以关闭自己的fd
+    void sendFile(int fd, off_t offset, size_t length);
     void shutdown();                   // 关闭连接
+    void forceClose();                 // 不等待数据发送完, 直接关闭连接
+
+    // 暂停/恢复读: 关闭/打开channel的读事件, 暂停期间数据留在内核接收缓冲区, 由TCP流控让对端慢下来; 可跨线程调用
+    // 被背压暂停期间startRead只记录意图, 等所有sink都放开之后才真正恢复读; isReading()返回的是用户的意图
+    void startRead();
+    void stopRead();
+    bool isReading() const { return reading_; }
 
-    void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; }
-    void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
-    void setWriteCompleteCallback(const WriteCompleteCallback &cb) { writeCompleteCallback_ = cb; }
+    // 背压: 本连接待发送的数据达到highWaterMark时暂停source的读, 发送到lowWaterMark以下时恢复;
+    // source可以是本连接自己(比如echo), 也可以是转发的另一端(可以属于别的loop); highWaterMark为0表示关闭
+    // 一个source可以同时被多个sink背压(比如扇出或者带镜像的转发): 暂停按次数计, 所有sink都放开之后才恢复读
+    // 只引用source的weak_ptr; 需在本连接的loop线程中调用
+    void setBackpressure(const TcpConnectionPtr &source, size_t highWaterMark, size_t lowWaterMark);
+    // 因背压暂停source的次数
+    uint64_t backpressurePauses() const { return backpressurePauses_; }
+
+    // 以下set只影响本连接, 回调表是共享的话先复制一份; 连接建立之后只能在loop线程中调用
+    void setConnectionCallback(const ConnectionCallback &cb) { mutableCallbacks()->connectionCallback = cb; }
+    void setMessageCallback(const MessageCallback &cb) { mutableCallbacks()->messageCallback = cb; }
+    void setWriteCompleteCallback(const WriteCompleteCallback &cb) { mutableCallbacks()->writeCompleteCallback = cb; }
     void setHighWaterMarkCallback(const HighWaterMarkCallback &cb, size_t highWaterMark)
     {
-      highWaterMarkCallback_ = cb;
+      mutableCallbacks()->highWaterMarkCallback = cb;
       highWaterMark_ = highWaterMark;
     }
-    void setCloseCallback(const CloseCallback &cb) { closeCallback_ = cb; }
+    void setCloseCallback(const CloseCallback &cb) { mutableCallbacks()->closeCallback = cb; }
+
+    // 以EPOLLET方式注册socket, 读写都会一直进行到EAGAIN; 需在connectEstablished之前设置
+    void setEdgeTriggered(bool on);
+
+    // 发送缓冲区使用分段的BufferChain(writev, 零拷贝追加), 默认使用连续的Buffer; 需在connectEstablished之前设置
+    // 零拷贝发送依赖分段输出, 关闭分段输出时也一并关闭零拷贝
+    void setChainedOutput(bool on)
+    {
+      chainedOutput_ = on;
+      if (!on)
+        zeroCopyThreshold_ = 0;
+    }
+
+    // 自动cork: send不再立即write, 只追加到发送缓冲区, 本轮循环结束时(doPendingFunctors之后)一次写出去;
+    // 一轮里的多次send(比如先发头再发体, 或者流水线上的多个响应)只需要一次系统调用
+    void setAutoCork(bool on) { autoCork_ = on; }
+
+    // 零拷贝发送: 一次要写出的数据不少于bytes时用MSG_ZEROCOPY, 内核直接引用用户内存, 发送完成后从socket的错误队列
+    // 通知(EPOLLERR), 收到通知之前这部分内存一直被引用; 0表示不启用(默认)
+    // 只对不需要拷贝就能排队的数据生效: send(shared_ptr)和send(std::string&&); 会同时启用分段输出
+    // 需在connectEstablished之前设置; 小块数据得不偿失(通知本身的开销), 阈值一般在几十KB以上, 见test/benchZeroCopy
+    void setZeroCopyThreshold(size_t bytes)
+    {
+      zeroCopyThreshold_ = bytes;
+      if (bytes > 0)
+        chainedOutput_ = true;
+    }
+    struct ZeroCopyStats
+    {
+      uint64_t sends;        // MSG_ZEROCOPY的sendmsg次数
+      uint64_t completions;  // 内核已经确认的次数
+      uint64_t copied;       // 其中内核退回拷贝的次数(比如发往本机回环的数据)
+      size_t pendingSends;   // 还没确认, 仍然引用着内存的发送
+    };
+    // 只能在loop线程中调用
+    ZeroCopyStats zeroCopyStats() const;
+
+    // 读之前用FIONREAD查询可读字节数来预留接收缓冲区, 见Buffer::setProbeReadable
+    void setReadProbe(bool on) { inputBuffer_.setProbeReadable(on); }
+
+    // 缓冲区收缩阈值: 接收缓冲区剩余数据少于阈值时, 容量超过阈值就缩回去; 收发缓冲区变空时存储整块还给内存池
+    // 0表示不收缩也不释放(存储一旦分配就一直保留), 默认256KB
+    void setShrinkThreshold(size_t bytes) { shrinkThreshold_ = bytes; }
+
+    // 收发缓冲区当前占用的内存, 以及最后一次读写的时间; 可以跨线程读取, 供TcpServer的内存预算使用
+    size_t memoryUsage() const { return memoryUsage_; }
+    Timestamp lastActive() const { return Timestamp(lastActive_); }
+    // 把收发缓冲区缩到只容纳未处理的数据, 可跨线程调用
+    void reclaimMemory();
+
+    // 空闲超时(秒): 超过这么久没有收到数据就关闭连接, <=0表示不启用; 需在connectEstablished之前设置
+    void setIdleTimeout(double seconds) { idleTimeout_ = seconds; }
 
     void connectEstablished(); // 连接建立
     void connectDestroyed();   // 连接销毁
 
   private:
+    friend class TcpRelay;  // 转发模式下由TcpRelay直接操作socket和channel
+    friend class TcpServer; // 在所属loop中登记连接时设置id_
+
+    CallbackTable *mutableCallbacks()
+    {
+      if (!callbacks_.unique())
+        callbacks_ = std::make_shared<CallbackTable>(*callbacks_);
+      return callbacks_.get();
+    }
+
     enum StateE // 表示连接状态
     {
       kDisconnected,
@@ -76,17 +197,63 @@ namespace zfwmuduo
     void setState(StateE state) { state_ = state; }
 
     void handleRead(Timestamp receiveTime);
+    void handleReadEdgeTriggered(Timestamp receiveTime);
     void handleWrite();
     void handleClose();
     void handleError();
+    bool handleZeroCopyCompletions(); // 读错误队列中的完成通知, 释放对应的内存; 没有通知时返回false
 
     void sendInLoop(const void *data, size_t len);
+    void sendStringInLoop(const std::string &buf) { sendInLoop(buf.data(), buf.size()); }
+    void sendBufferInLoop(const std::shared_ptr<Buffer> &buf) { sendInLoop(buf->peek(), buf->readableBytes()); }
+    void reclaimMemoryInLoop();
+    void shrinkInputIfIdle();  // 读回调之后调用
+    void shrinkOutputIfIdle(); // 发送缓冲区发完之后调用
+    void updateMemoryUsage();
+    void sendSharedInLoop(const std::shared_ptr<const char> &data, size_t len);
+    // owner非空时, 分段输出模式下剩余数据直接引用owner而不拷贝
+    void sendBytesInLoop(const void *data, size_t len, const std::shared_ptr<const char> &owner);
+
+    void sendvInLoop(const struct iovec *iov, int iovcnt);
+    // 数据追加到发送缓冲区之后调用: 高水位回调, 然后注册写事件(或者自动cork模式下安排本轮结束时发送)
+    void outputQueued(size_t oldLen);
+    // 待发送数据变化之后调用: 越过高水位时暂停source的读, 降到低水位时恢复
+    void updateBackpressure();
+    void startReadInLoop();
+    void stopReadInLoop();
+    // 按reading_和readHolds_开关channel的读事件
+    void updateReading();
+    // 背压对source的暂停/放开, 可跨线程调用; 在source的loop中计数, 第一个暂停时停止读, 最后一个放开时恢复(除非用户stopRead了)
+    void holdRead();
+    void releaseRead();
+    void holdReadInLoop();
+    void releaseReadInLoop();
+    void flushCorked();
+    // 立即把发送缓冲区写到EAGAIN或者写完为止, 写完时和handleWrite一样收尾; 已经在等EPOLLOUT时什么都不做
+    void flushPending();
+    void sendFileInLoop(int fd, off_t offset, size_t length);
+    ssize_t sendFileChunk(int *savedErrno); // 对排在最前面的文件调用一次sendfile
+
+    // 发送缓冲区的操作, 根据chainedOutput_分派给outputBuffer_或outputChain_
+    size_t bufferedBytes() const { return chainedOutput_ ? outputChain_.readableBytes() : outputBuffer_.readableBytes(); }
+    // 待发送的总字节数, 包括排队中的文件
+    size_t outputBytes() const { return bufferedBytes() + fileBytes_; }
+    void appendOutput(const char *data, size_t len);
+    ssize_t flushOutput(int *savedErrno); // 写一次fd(或sendfile一次), 并丢弃已经写出去的数据
     void shutdownInLoop();
+    void forceCloseInLoop();
+
+    // 空闲超时, 基于所属loop的时间轮
+    void startIdleTimer();
+    void cancelIdleTimer();
+    void handleIdleTimeout();
 
     EventLoop *loop_; // 这里绝对不是baseloop!! 因为TcpConnection都是在subloop里面管理的
-    const std::string name_;
+    uint64_t id_;
+    mutable std::once_flag nameOnce_;
+    mutable std::string name_; // 有id时由name()生成
     std::atomic_int state_;
-    bool reading_;
+    std::atomic_bool reading_; // startRead/stopRead的状态, 可以跨线程读取
 
     // 和Acceptor类似  Acceptor在mainloop中; TcpConnection在subloop中
     std::unique_ptr<Socket> socket_;
@@ -95,16 +262,56 @@ namespace zfwmuduo
     const InetAddress localAddr_; // 本端的IP地址端口号
     const InetAddress peerAddr_;  // 对端的IP地址端口号
 
-    // 用户设置的回调
-    ConnectionCallback connectionCallback_;       // 有新连接时的回调
-    MessageCallback messageCallback_;             // 有读写消息时的回调
-    WriteCompleteCallback writeCompleteCallback_; // 消息发送后的回调
-    HighWaterMarkCallback highWaterMarkCallback_;
-    CloseCallback closeCallback_;
-    size_t highWaterMark_; // 水位标志
+    CallbackTablePtr callbacks_; // 用户设置的回调
+    size_t highWaterMark_;       // 水位标志
+
+    std::weak_ptr<TcpConnection> backpressureSource_;
+    size_t backpressureHigh_; // 0表示没有设置背压
+    size_t backpressureLow_;
+    bool backpressureActive_; // 当前是否暂停了source的读
+    std::atomic<uint64_t> backpressurePauses_;
+    int readHolds_; // 作为source时, 当前有几个sink因为背压暂停了本连接的读; 只在本连接的loop线程中访问
 
     Buffer inputBuffer_;  // 接收数据的缓冲区
     Buffer outputBuffer_; // 发送数据的缓冲区
+    BufferChain outputChain_; // 分段输出模式下的发送缓冲区
+    bool chainedOutput_;
+    bool autoCork_;
+    bool corkScheduled_; // 已经安排了本轮结束时的flushCorked
+
+    // 排队中的文件; position是它在输出流中的位置, 发送缓冲区累计发出outputFlushed_达到position时轮到它
+    struct PendingFile
+    {
+      int fd; // dup出来的, 发送完/连接析构时关闭
+      off_t offset;
+      size_t remaining;
+      uint64_t position;
+    };
+    std::deque<PendingFile> files_;
+    size_t fileBytes_;       // files_中还没发送的字节数
+    uint64_t outputFlushed_; // 发送缓冲区累计发出的字节数
+
+    // 已经用MSG_ZEROCOPY发出, 等待内核确认的发送; seq是内核为每次成功的sendmsg分配的序号, 从0开始递增
+    struct ZeroCopySend
+    {
+      uint32_t seq;
+      std::vector<std::shared_ptr<const char>> pinned; // 这次发送引用的内存
+    };
+    size_t zeroCopyThreshold_;
+    uint32_t zeroCopyNextSeq_;
+    std::deque<ZeroCopySend> zeroCopyPending_;
+    uint64_t zeroCopyCompletions_;
+    uint64_t zeroCopyCopied_;
+
+    size_t shrinkThreshold_;
+    std::atomic<size_t> memoryUsage_;
+    std::atomic<int64_t> lastActive_; // microSecondsSinceEpoch
+
+    std::shared_ptr<TcpRelay> relay_; // 非空表示处于转发模式, 读写事件交给TcpRelay
+
+    double idleTimeout_;
+    bool idleTimerArmed_;
+    TimingWheel::Handle idleTimer_; // idleTimerArmed_为true时有效
   };
 
 } // namespace zfwmuduo
\ No newline at end of file
@@ -0,0 +1,332 @@
+#include "TcpRelay.h"
+#include <errno.h>
+#include <fcntl.h>  // ::splice() ::pipe2()
+#include <unistd.h> // ::close()
+#include <functional>
+#include <vector>
+
+#include "TcpConnection.h"
+#include "Channel.h"
+#include "EventLoop.h"
+#include "Logger.h"
+#include "Socket.h"
+
+namespace zfwmuduo
+{
+  namespace
+  {
+    const size_t kPipeSize = 256 * 1024;  // 尽量把管道调大, 一次splice搬更多数据
+    const int kMaxSplicesPerEvent = 16;   // LT模式下一次可读事件最多搬几轮, 避免一个连接占住loop
+    const size_t kMaxIdlePipes = 16;      // 每个loop最多缓存的空闲管道
+
+    // NOTE: 只有所属loop线程写, 其他线程只在stats()时读, 同BufferPool
+    void bump(std::atomic<uint64_t> &counter, uint64_t n = 1)
+    {
+      counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    // 每个loop(线程)的空闲管道, 池中的管道都是空的
+    struct PipePool
+    {
+      std::vector<std::pair<int, int>> idle;
+      ~PipePool()
+      {
+        for (size_t i = 0; i < idle.size(); ++i)
+        {
+          ::close(idle[i].first);
+          ::close(idle[i].second);
+        }
+      }
+    };
+    thread_local PipePool t_pipes;
+  } // namespace
+
+  TcpRelay::TcpRelay(const TcpConnectionPtr &first, const TcpConnectionPtr &second)
+      : first_(first),
+        second_(second),
+        splices_(0),
+        stalls_(0),
+        finished_(false)
+  {
+    TcpConnection *ends[2] = {first.get(), second.get()};
+    for (int i = 0; i < 2; ++i)
+    {
+      dirs_[i].src = ends[i];
+      dirs_[i].dst = ends[1 - i];
+      dirs_[i].pipe.readFd = dirs_[i].pipe.writeFd = -1;
+      dirs_[i].pipeBytes = 0;
+      dirs_[i].eof = false;
+      dirs_[i].bytes = 0;
+    }
+  }
+
+  TcpRelay::~TcpRelay()
+  {
+    for (int i = 0; i < 2; ++i)
+    { // 没有经过stop(比如start之前就被释放了)
+      if (dirs_[i].pipe.readFd >= 0)
+      {
+        ::close(dirs_[i].pipe.readFd);
+        ::close(dirs_[i].pipe.writeFd);
+      }
+    }
+  }
+
+  void TcpRelay::start()
+  {
+    first_->getLoop()->runInLoop(std::bind(&TcpRelay::startInLoop, shared_from_this()));
+  }
+
+  TcpRelay::Stats TcpRelay::stats() const
+  {
+    Stats stats;
+    stats.bytesForward = dirs_[0].bytes.load(std::memory_order_relaxed);
+    stats.bytesBackward = dirs_[1].bytes.load(std::memory_order_relaxed);
+    stats.splices = splices_.load(std::memory_order_relaxed);
+    stats.stalls = stalls_.load(std::memory_order_relaxed);
+    return stats;
+  }
+
+  void TcpRelay::startInLoop()
+  {
+    if (first_->getLoop() != second_->getLoop())
+    {
+      LOG_ERROR("TcpRelay::start [%s] and [%s] belong to different loops \n", first_->name().c_str(), second_->name().c_str());
+      return;
+    }
+    if (!first_->connected() || !second_->connected())
+    {
+      LOG_ERROR("TcpRelay::start [%s] <-> [%s] not connected \n", first_->name().c_str(), second_->name().c_str());
+      stop();
+      return;
+    }
+
+    TcpRelayPtr self(shared_from_this());
+    first_->relay_ = self;
+    second_->relay_ = self;
+    for (int i = 0; i < 2; ++i)
+    { // 开始之前已经读进来的数据, 追加到对端发送缓冲区的末尾, 由drain先发出去
+      Buffer &input = dirs_[i].src->inputBuffer_;
+      if (input.readableBytes() > 0)
+      {
+        bump(dirs_[i].bytes, input.readableBytes());
+        dirs_[i].dst->appendOutput(input.peek(), input.readableBytes());
+        input.retrieveAll();
+      }
+      input.releaseIfEmpty();
+      if (!dirs_[i].src->channel_->isReading())
+        dirs_[i].src->channel_->enableReading();
+    }
+    // socket中可能已经有数据了, ET模式下不会再通知, 先各搬一次
+    pump(dirs_[0]);
+    if (!finished_)
+      pump(dirs_[1]);
+  }
+
+  void TcpRelay::handleReadable(TcpConnection *conn)
+  {
+    TcpRelayPtr guard(shared_from_this()); // stop()会断开连接对relay的引用
+    pump(conn == dirs_[0].src ? dirs_[0] : dirs_[1]);
+  }
+
+  void TcpRelay::handleWritable(TcpConnection *conn)
+  {
+    TcpRelayPtr guard(shared_from_this());
+    pump(conn == dirs_[0].dst ? dirs_[0] : dirs_[1]);
+  }
+
+  void TcpRelay::handleClose(TcpConnection *conn)
+  {
+    TcpRelayPtr guard(shared_from_this());
+    LOG_INFO("TcpRelay [%s] closed, stop relaying \n", conn->name().c_str());
+    stop();
+  }
+
+  void TcpRelay::pump(Direction &dir)
+  {
+    if (finished_ || !drain(dir))
+      return;
+
+    bool edgeTriggered = dir.src->channel_->isEdgeTriggered();
+    for (int i = 0; !dir.eof && (edgeTriggered || i < kMaxSplicesPerEvent); ++i)
+    {
+      if (dir.pipe.readFd < 0)
+      {
+        dir.pipe = acquirePipe();
+        if (dir.pipe.readFd < 0)
+        {
+          stop();
+          return;
+        }
+      }
+      ssize_t n = ::splice(dir.src->channel_->fd(), NULL, dir.pipe.writeFd, NULL, kPipeSize,
+                           SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+      bump(splices_);
+      if (n > 0)
+      {
+        dir.pipeBytes += n;
+        dir.src->lastActive_ = dir.src->loop_->pollReturnTime().microSecondsSinceEpoch();
+        if (dir.src->idleTimerArmed_)
+          dir.src->loop_->timingWheel()->refresh(dir.src->idleTimer_, dir.src->idleTimeout_);
+        if (!drain(dir))
+          return; // 背压, 管道留给这个方向
+      }
+      else if (n == 0)
+      {
+        dir.eof = true;
+      }
+      else if (errno == EAGAIN)
+      {
+        break;
+      }
+      else
+      {
+        LOG_ERROR("TcpRelay::pump splice from [%s] errno=%d \n", dir.src->name().c_str(), errno);
+        stop();
+        return;
+      }
+    }
+
+    if (dir.pipe.readFd >= 0) // 管道已经空了, 还回池里给别的转发用
+      releasePipe(dir.pipe, true);
+
+    if (dir.eof)
+    { // 半关闭: 这个方向的数据都发完了, 把EOF传给另一端
+      if (dir.src->channel_->isReading())
+        dir.src->channel_->disableReading();
+      dir.dst->socket_->shutdownWrite();
+      if (dirs_[0].eof && dirs_[1].eof)
+        stop();
+    }
+  }
+
+  bool TcpRelay::drain(Direction &dir)
+  {
+    TcpConnection *dst = dir.dst;
+    int savedErrno = 0;
+    while (dst->outputBytes() > 0)
+    { // 开始转发之前排队的数据要排在前面
+      ssize_t n = dst->flushOutput(&savedErrno);
+      if (n <= 0)
+      {
+        if (n < 0 && savedErrno != EAGAIN)
+        {
+          stop();
+          return false;
+        }
+        block(dir);
+        return false;
+      }
+    }
+
+    while (dir.pipeBytes > 0)
+    {
+      ssize_t n = ::splice(dir.pipe.readFd, NULL, dst->channel_->fd(), NULL, dir.pipeBytes,
+                           SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+      bump(splices_);
+      if (n > 0)
+      {
+        dir.pipeBytes -= n;
+        bump(dir.bytes, n);
+      }
+      else if (n < 0 && errno == EAGAIN)
+      {
+        block(dir);
+        return false;
+      }
+      else
+      {
+        LOG_ERROR("TcpRelay::drain splice to [%s] errno=%d \n", dst->name().c_str(), errno);
+        stop();
+        return false;
+      }
+    }
+    dst->lastActive_ = dst->loop_->pollReturnTime().microSecondsSinceEpoch();
+    unblock(dir);
+    return true;
+  }
+
+  void TcpRelay::block(Direction &dir)
+  {
+    if (dir.src->channel_->isReading())
+    {
+      bump(stalls_);
+      dir.src->channel_->disableReading();
+    }
+    if (!dir.dst->channel_->isWriting())
+      dir.dst->channel_->enableWriting();
+  }
+
+  void TcpRelay::unblock(Direction &dir)
+  {
+    // ET模式下写事件常驻, 和TcpConnection一致
+    if (!dir.dst->channel_->isEdgeTriggered() && dir.dst->channel_->isWriting())
+      dir.dst->channel_->disableWriting();
+    if (!dir.eof && !dir.src->channel_->isReading())
+      dir.src->channel_->enableReading();
+  }
+
+  void TcpRelay::stop()
+  {
+    if (finished_)
+      return;
+    finished_ = true;
+    for (int i = 0; i < 2; ++i)
+    {
+      if (dirs_[i].pipe.readFd >= 0)
+        releasePipe(dirs_[i].pipe, dirs_[i].pipeBytes == 0);
+      dirs_[i].pipeBytes = 0;
+    }
+
+    // NOTE: 先断开连接对relay的引用, 再关闭连接, 关闭流程就和普通连接一样了
+    TcpConnectionPtr ends[2] = {first_, second_};
+    for (int i = 0; i < 2; ++i)
+    {
+      if (ends[i]->relay_.get() == this)
+        ends[i]->relay_.reset();
+      ends[i]->forceClose();
+    }
+    // 连接和relay互相不再引用, 各自正常析构
+    first_.reset();
+    second_.reset();
+  }
+
+  TcpRelay::Pipe TcpRelay::acquirePipe()
+  {
+    Pipe pipe = {-1, -1};
+    if (!t_pipes.idle.empty())
+    {
+      pipe.readFd = t_pipes.idle.back().first;
+      pipe.writeFd = t_pipes.idle.back().second;
+      t_pipes.idle.pop_back();
+      return pipe;
+    }
+
+    int fds[2];
+    if (::pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0)
+    {
+      LOG_ERROR("TcpRelay::acquirePipe errno=%d \n", errno);
+      return pipe;
+    }
+    ::fcntl(fds[1], F_SETPIPE_SZ, kPipeSize); // 失败(超过pipe-max-size)就用默认的64KB
+    pipe.readFd = fds[0];
+    pipe.writeFd = fds[1];
+    return pipe;
+  }
+
+  void TcpRelay::releasePipe(Pipe &pipe, bool empty)
+  {
+    // 还有残留数据的管道不能给别的转发用, 直接关闭
+    if (empty && t_pipes.idle.size() < kMaxIdlePipes)
+    {
+      t_pipes.idle.push_back(std::make_pair(pipe.readFd, pipe.writeFd));
+    }
+    else
+    {
+      ::close(pipe.readFd);
+      ::close(pipe.writeFd);
+    }
+    pipe.readFd = pipe.writeFd = -1;
+  }
+
+} // namespace zfwmuduo
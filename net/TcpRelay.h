@@ -0,0 +1,92 @@
+#pragma once
+
+#include <memory> // enable_shared_from_this<T>
+#include <atomic>
+#include <stdint.h>
+#include "../base/noncopyable.h"
+#include "Callbacks.h"
+
+/**
+ * TcpRelay: 在两个TcpConnection之间双向转发数据(四层代理/隧道), 数据不经过用户态
+ *
+ * 普通的代理要 readv进inputBuffer_ -> retrieveAllAsString拷贝 -> send拷贝进outputBuffer_ -> write,
+ * TcpRelay用splice(2): 源socket -> 管道 -> 目的socket, 数据只在内核的页之间移动
+ * - 管道来自每个loop(线程)的管道池; 一次就能全部写到目的socket时, 管道马上还回池里, 同一个loop上的所有转发共用它
+ * - 目的socket写不动(EAGAIN)时, 这个方向占住管道, 关闭源socket的读事件、打开目的socket的写事件(背压),
+ *   可写时把管道里剩下的数据发完, 再恢复读源socket
+ * - 一端读到EOF, 对应方向的数据发完后shutdown另一端的写; 两个方向都结束, 或任意一端出错/关闭时, 两个连接都关闭
+ *
+ * 两个连接必须属于同一个loop; 开始转发后, 连接的读写不再经过messageCallback_和收发缓冲区,
+ * 开始之前已经读进inputBuffer_、还在outputBuffer_中的数据会先按顺序发出去
+ */
+
+namespace zfwmuduo
+{
+  class TcpConnection;
+
+  class TcpRelay : noncopyable, public std::enable_shared_from_this<TcpRelay>
+  {
+  public:
+    struct Stats
+    {
+      uint64_t bytesForward;  // first -> second
+      uint64_t bytesBackward; // second -> first
+      uint64_t splices;       // splice系统调用次数
+      uint64_t stalls;        // 目的socket写不动、暂停读源socket的次数
+    };
+
+    TcpRelay(const TcpConnectionPtr &first, const TcpConnectionPtr &second);
+    ~TcpRelay();
+
+    // 开始转发, 可跨线程调用
+    void start();
+    // 可以跨线程读取
+    Stats stats() const;
+    bool finished() const { return finished_; }
+
+  private:
+    friend class TcpConnection;
+
+    struct Pipe
+    {
+      int readFd;
+      int writeFd;
+    };
+
+    // 一个转发方向
+    struct Direction
+    {
+      TcpConnection *src;
+      TcpConnection *dst;
+      Pipe pipe;        // readFd为-1表示没有占用管道
+      size_t pipeBytes; // 管道中还没写到dst的字节数
+      bool eof;         // src已经读到EOF
+      std::atomic<uint64_t> bytes;
+    };
+
+    void startInLoop();
+    // 由TcpConnection的读/写/关闭事件转过来
+    void handleReadable(TcpConnection *conn);
+    void handleWritable(TcpConnection *conn);
+    void handleClose(TcpConnection *conn);
+
+    void pump(Direction &dir);
+    bool drain(Direction &dir); // 把已经排队给dst的数据发出去, 全部发完返回true
+    void block(Direction &dir);
+    void unblock(Direction &dir);
+    void stop(); // 结束转发, 关闭两个连接
+
+    static Pipe acquirePipe();
+    static void releasePipe(Pipe &pipe, bool empty);
+
+    TcpConnectionPtr first_;
+    TcpConnectionPtr second_;
+    Direction dirs_[2]; // dirs_[0]: first -> second, dirs_[1]: second -> first
+    std::atomic<uint64_t> splices_;
+    std::atomic<uint64_t> stalls_;
+    std::atomic_bool finished_;
+  };
+
+  typedef std::shared_ptr<TcpRelay> TcpRelayPtr;
+
+} // namespace zfwmuduo
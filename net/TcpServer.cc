@@ -2,6 +2,10 @@
 #include "TcpConnection.h"
 #include "../base/Logger.h" // LOG_FATAL
 #include <functional>       // bind()
+#include <future>           // promise
+#include <algorithm>        // sort()
+#include <utility>          // pair
+#include <vector>
 #include <string>
 #include <strings.h>    // bzero()
 #include <sys/socket.h> // getsockname()
@@ -24,30 +28,73 @@ namespace zfwmuduo
                        Option option) : loop_(CheckLoopNotNull(loop)),
                                         ipPort_(listenAddr.toIpPort()),
                                         name_(nameArg),
-                                        acceptor_(new Acceptor(loop, listenAddr, option == kReusePort)), // 需要监听新用户连接(listenAddr), loop相当于mainloop
+                                        listenAddr_(listenAddr),
+                                        option_(option),
+                                        maxAcceptsPerWakeup_(64),
+                                        acceptor_(option == kReusePortPerLoop ? NULL : new Acceptor(loop, listenAddr, option == kReusePort)), // 需要监听新用户连接(listenAddr), loop相当于mainloop
                                         threadPool_(new EventLoopThreadPool(loop, nameArg)),             // 线程池对象创建，默认不会自己先开启额外线程(即刚开始只有主线程(它运行mainloop))
                                         connectionCallback_(),
                                         messageCallback_(),
-                                        nextConnId_(1),
-                                        started_(0)
+                                        started_(0),
+                                        idleTimeout_(0.0),
+                                        edgeTriggered_(false),
+                                        chainedOutput_(false),
+                                        readProbe_(false),
+                                        autoCork_(false),
+                                        zeroCopyThreshold_(0),
+                                        memoryBudget_(0),
+                                        memoryCheckInterval_(1.0),
+                                        stopping_(false),
+                                        stopped_(false),
+                                        pendingShards_(0)
   {
     // 当有新用户连接时，会执行TcpServer::newConnection回调
-    acceptor_->setNewConnectionCallback(
-        std::bind(&TcpServer::newConnection, this, std::placeholders::_1, std::placeholders::_2)); // std::placeholders::_1是bind绑定器函数参数的占位符
+    if (acceptor_)
+    {
+      acceptor_->setNewConnectionCallback(
+          std::bind(&TcpServer::newConnection, this, std::placeholders::_1, std::placeholders::_2)); // std::placeholders::_1是bind绑定器函数参数的占位符
+    }
   }
 
   TcpServer::~TcpServer()
   {
     LOG_INFO("TcpServer::~TcpServer [%s] destructing", name_.c_str());
 
-    for (auto &item : connections_)
-    {
-      // TAG:这里就体现了智能指针的优势! 出了右括号, 它所指向的new出来的TcpConnection对象资源就自动释放了! 细品：为什么是map的结构
-      TcpConnectionPtr conn(item.second);
-      item.second.reset(); // reset()函数用于释放智能指针当前管理的资源
+    stopLoopAcceptors(); // 先停止接收新连接
+    if (memoryBudget_ > 0)
+      loop_->cancel(memoryTimer_);
 
-      // 销毁连接
-      conn->getLoop()->runInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+    // NOTE: 连接的关闭回调绑定了this, subloop此时还在运行; 只是把connectDestroyed投递过去的话,
+    // 对端恰好在它执行之前关闭, handleClose就会回调到已经析构的TcpServer上.
+    // 所以在每个subloop中同步销毁它的连接, 等它做完再继续析构
+    for (auto &item : loopShards_)
+    {
+      EventLoop *ioLoop = item.first;
+      ConnectionShard *shard = item.second;
+      {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        if (shard->count == 0)
+          continue; // stop()之后subloop已经退出, 连接表也是空的
+      }
+      std::promise<void> done;
+      std::future<void> finished = done.get_future();
+      ioLoop->runInLoop([shard, &done]()
+                        {
+                          std::vector<TcpConnectionPtr> conns;
+                          {
+                            std::lock_guard<std::mutex> lock(shard->mutex);
+                            for (auto &slot : shard->slots)
+                            {
+                              if (slot.conn)
+                                conns.push_back(std::move(slot.conn)); // 连接表不再持有
+                            }
+                            shard->count = 0;
+                          }
+                          // TAG:这里就体现了智能指针的优势! conns析构时, 它所指向的new出来的TcpConnection对象资源就自动释放了!
+                          for (const TcpConnectionPtr &conn : conns)
+                            conn->connectDestroyed();
+                          done.set_value(); });
+      finished.wait();
     }
   }
 
@@ -57,6 +104,29 @@ namespace zfwmuduo
     threadPool_->setThreadNum(numThreads);
   }
 
+  void TcpServer::setMaxAcceptsPerWakeup(int n)
+  {
+    maxAcceptsPerWakeup_ = n;
+    if (acceptor_)
+      acceptor_->setMaxAcceptsPerWakeup(n);
+  }
+
+  Acceptor::Stats TcpServer::acceptStats() const
+  {
+    if (acceptor_)
+      return acceptor_->stats();
+
+    Acceptor::Stats total = {0, 0, 0};
+    for (const auto &acceptor : loopAcceptors_)
+    {
+      Acceptor::Stats stats = acceptor->stats();
+      total.accepted += stats.accepted;
+      total.failed += stats.failed;
+      total.shed += stats.shed;
+    }
+    return total;
+  }
+
   // 开启服务器监听  loop.loop()
   void TcpServer::start()
   {
@@ -64,6 +134,25 @@ namespace zfwmuduo
     if (started_++ == 0)
     {
       threadPool_->start(threadInitCallback_); // 启动底层loop的线程池
+      std::vector<EventLoop *> loops = threadPool_->getAllLoops();
+      if (loops.size() > kMaxShards)
+      {
+        LOG_FATAL("TcpServer::start [%s] - at most %u loops \n", name_.c_str(), kMaxShards);
+      }
+      for (EventLoop *ioLoop : loops)
+      {
+        shards_.push_back(std::unique_ptr<ConnectionShard>(new ConnectionShard(static_cast<uint32_t>(shards_.size()))));
+        loopShards_[ioLoop] = shards_.back().get();
+      }
+
+      // 回调表只建一份, 所有连接共享
+      callbacks_ = std::make_shared<TcpConnection::CallbackTable>();
+      callbacks_->connectionCallback = connectionCallback_;
+      callbacks_->messageCallback = messageCallback_;
+      callbacks_->writeCompleteCallback = writeCompleteCallback_;
+      callbacks_->closeCallback = std::bind(&TcpServer::removeConnection, this, std::placeholders::_1);
+      callbacks_->namePrefix = name_ + "-" + ipPort_;
+
       // TAG: &Acceptor::listen表示成员函数指针；acceptor_.get()表示对象指针[get()允许你访问底层的原始指针，而不会转移所有权]
       /**
        * 这个bind的作用等价于：
@@ -71,22 +160,29 @@ namespace zfwmuduo
        *   acceptor->listen();
        * };
        **/
-      loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
+      if (acceptor_)
+        loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
+      else
+        startLoopAcceptors();
+
+      if (memoryBudget_ > 0)
+        memoryTimer_ = loop_->runEvery(memoryCheckInterval_, std::bind(&TcpServer::checkMemoryBudget, this));
     }
   }
 
   // 有一个新的客户端的连接，acceptor会执行这个回调操作
   void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
   {
-    // 1-根据轮询算法选择一个subloop, 来管理channel
-    EventLoop *ioLoop = threadPool_->getNextLoop(); // 处理subloop
-    char buf[64] = {0};
-    snprintf(buf, sizeof buf, "-%s#%d", ipPort_.c_str(), nextConnId_);
-    ++nextConnId_; // 因为(in mainloop)只有一个线程在处理它, 所以不涉及线程安全问题
-    std::string connName = name_ + buf;
+    // 1-按照选择策略(默认轮询)选择一个subloop, 来管理channel
+    createConnection(threadPool_->getNextLoop(peerAddr), sockfd, peerAddr);
+  }
 
-    LOG_INFO("TcpServer::newConnection [ %s ] - new connection [ %s ] from %s \n",
-             name_.c_str(), connName.c_str(), peerAddr.toIpPort().c_str());
+  // 单acceptor时在mainloop中调用; kReusePortPerLoop时在ioLoop自己的线程中调用
+  void TcpServer::createConnection(EventLoop *ioLoop, int sockfd, const InetAddress &peerAddr)
+  {
+    // NOTE: 这里还没有连接id, 连接名要等用到时才生成
+    LOG_INFO("TcpServer::newConnection [ %s ] - new connection fd=%d from %s \n",
+             name_.c_str(), sockfd, peerAddr.toIpPort().c_str());
 
     // 通过sockfd获取其绑定的本机ip地址和端口信息
     sockaddr_in local;
@@ -99,46 +195,309 @@ namespace zfwmuduo
     InetAddress localAddr(local);
 
     // 2-唤醒subloop; 根据连接成功的sockfd, 创建TcpConnection连接对象
+    // 回调是用户设置给TcpServer=>TcpConnection=>Channel=>Poller=>notify channel调用回调; 连接关闭时回调TcpServer::removeConnection
     TcpConnectionPtr conn(new TcpConnection(ioLoop,
-                                            connName,
-                                            sockfd, // 通过这个fd 底层即可创建Socket对象和Channel
+                                            callbacks_, // 共享同一份回调表, 不再逐个拷贝
+                                            sockfd,     // 通过这个fd 底层即可创建Socket对象和Channel
                                             localAddr,
                                             peerAddr));
+    conn->setIdleTimeout(idleTimeout_);
+    conn->setEdgeTriggered(edgeTriggered_);
+    conn->setChainedOutput(chainedOutput_);
+    conn->setReadProbe(readProbe_);
+    conn->setAutoCork(autoCork_);
+    conn->setZeroCopyThreshold(zeroCopyThreshold_);
 
-    // 3 - 把当前confd封装成channel分发给subloop
-    connections_[connName] = conn;
-    // 下面的回调都是用户设置给TcpServer=>TcpConnection=>Channel=>Poller=>notify channel调用回调
-    conn->setConnectionCallback(connectionCallback_);
-    conn->setMessageCallback(messageCallback_);
-    conn->setWriteCompleteCallback(writeCompleteCallback_);
-
-    // 设置了如何关闭连接的回调!!  conn->shutdown()
-    conn->setCloseCallback(
-        std::bind(&TcpServer::removeConnection, this, std::placeholders::_1));
-
-    // 直接调用 TcpConnection::connectEstablished
+    // 3 - 在ioLoop中加入该loop的连接表(分配连接id), 然后调用 TcpConnection::connectEstablished
     /**
      * 确保回调函数已设置：在调用 connectEstablished 之前，必须确保所有回调函数已经设置完毕，
      * 否则在 connectEstablished 中可能会触发未设置的回调函数，导致未定义行为。
      * 线程安全：runInLoop 会将任务提交到 ioLoop 的线程中执行，确保线程安全
      */
-    ioLoop->runInLoop(std::bind(&TcpConnection::connectEstablished, conn));
+    ioLoop->runInLoop(std::bind(&TcpServer::establishConnection, this, conn));
   }
 
-  void TcpServer::removeConnection(const TcpConnectionPtr &conn)
+  // 在conn所属的loop线程中调用
+  void TcpServer::establishConnection(const TcpConnectionPtr &conn)
   {
-    loop_->runInLoop(std::bind(&TcpServer::removeConnectionInLoop, this, conn));
+    ConnectionShard *shard = shardOf(conn->getLoop());
+    {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      uint32_t index;
+      if (!shard->freeSlots.empty())
+      {
+        index = shard->freeSlots.back();
+        shard->freeSlots.pop_back();
+      }
+      else
+      {
+        index = static_cast<uint32_t>(shard->slots.size());
+        if (index >= (1u << kSlotBits))
+        {
+          LOG_FATAL("TcpServer [%s] - too many connections in one loop \n", name_.c_str());
+        }
+        ConnectionShard::Slot slot = {1, TcpConnectionPtr()};
+        shard->slots.push_back(slot);
+      }
+      ConnectionShard::Slot &slot = shard->slots[index];
+      slot.conn = conn;
+      ++shard->count;
+      conn->id_ = (static_cast<uint64_t>(slot.generation) << 32) | (shard->index << kSlotBits) | index;
+    }
+    conn->connectEstablished();
   }
 
-  void TcpServer::removeConnectionInLoop(const TcpConnectionPtr &conn)
+  // TcpConnection::handleClose => closeCallback, 在conn所属的loop线程中调用, 不再绕道mainloop
+  void TcpServer::removeConnection(const TcpConnectionPtr &conn)
   {
-    LOG_INFO("TcpServer::removeConnectionInLoop [%s] - connection %s \n",
+    LOG_INFO("TcpServer::removeConnection [%s] - connection id=%llu \n",
              name_.c_str(),
-             conn->name().c_str());
+             static_cast<unsigned long long>(conn->id()));
+
+    ConnectionShard *shard = shardOf(conn->getLoop());
+    bool drained = false;
+    {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      uint32_t index = static_cast<uint32_t>(conn->id() & ((1u << kSlotBits) - 1));
+      ConnectionShard::Slot &slot = shard->slots[index];
+      if (slot.conn == conn)
+      { // 回收槽位, generation加1(跳过0), 旧id从此查不到
+        slot.conn.reset();
+        if (++slot.generation == 0)
+          slot.generation = 1;
+        shard->freeSlots.push_back(index);
+        --shard->count;
+      }
+      drained = stopping_ && shard->count == 0;
+    }
+    // NOTE: 现在还在handleClose里(channel正在处理事件), 等本轮事件处理完再销毁
+    conn->getLoop()->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+    if (drained) // 本loop的连接已经关完, 让mainloop看看是不是全部关完了
+      loop_->queueInLoop(std::bind(&TcpServer::checkStopped, this));
+  }
+
+  size_t TcpServer::connectionCount() const
+  {
+    size_t total = 0;
+    for (const auto &shard : shards_)
+    {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      total += shard->count;
+    }
+    return total;
+  }
+
+  TcpConnectionPtr TcpServer::findConnection(uint64_t id) const
+  {
+    uint32_t shardIndex = static_cast<uint32_t>(id >> kSlotBits) & (kMaxShards - 1);
+    uint32_t index = static_cast<uint32_t>(id & ((1u << kSlotBits) - 1));
+    uint32_t generation = static_cast<uint32_t>(id >> 32);
+    if (shardIndex >= shards_.size())
+      return TcpConnectionPtr();
+    const ConnectionShard *shard = shards_[shardIndex].get();
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    if (index >= shard->slots.size() || shard->slots[index].generation != generation)
+      return TcpConnectionPtr();
+    return shard->slots[index].conn;
+  }
+
+  void TcpServer::forEachConnection(const std::function<void(const TcpConnectionPtr &)> &func) const
+  {
+    for (const auto &shard : shards_)
+    {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      for (const auto &slot : shard->slots)
+      {
+        if (slot.conn)
+          func(slot.conn);
+      }
+    }
+  }
+
+  void TcpServer::stop(double deadline, const StopCallback &cb)
+  {
+    // NOTE: 调用者可能正处于本轮的事件处理中(比如定时器回调), 这一轮poll也可能返回了listenfd的事件,
+    // 放到pending functors里再析构acceptor, 免得它的channel在析构之后还被处理
+    loop_->queueInLoop(std::bind(&TcpServer::stopInLoop, this, deadline, cb));
+  }
+
+  void TcpServer::stopInLoop(double deadline, const StopCallback &cb)
+  {
+    if (started_ == 0 || stopping_)
+      return;
+    if (stopped_)
+    { // NOTE: 已经停止过, subloop线程都已经join了, 不能再往它们那里投递stopShard
+      if (cb)
+        cb();
+      return;
+    }
+    LOG_INFO("TcpServer::stop [%s] - draining connections, deadline %.3fs \n", name_.c_str(), deadline);
+    stopping_ = true;
+    stopCallback_ = cb;
+    pendingShards_ = loopShards_.size();
 
-    connections_.erase(conn->name());
-    EventLoop *ioLoop = conn->getLoop();
-    ioLoop->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+    // 1-关闭监听socket, 新的连接请求会被拒绝, 可以由新进程接手
+    acceptor_.reset();
+    stopLoopAcceptors();
+    if (memoryBudget_ > 0)
+      loop_->cancel(memoryTimer_);
+
+    // 2-半关闭: 每个loop半关闭自己的连接; TcpConnection::shutdown会等发送缓冲区写完再shutdownWrite, 已经生成的响应不会丢
+    // NOTE: stopShard排在之前投递的establishConnection后面, 刚accept的连接也能被半关闭
+    for (auto &item : loopShards_)
+    {
+      item.first->runInLoop(std::bind(&TcpServer::stopShard, this, item.first));
+    }
+
+    // 3-对端一直不关闭的连接, 到时强制关闭
+    stopTimer_ = loop_->runAfter(deadline, std::bind(&TcpServer::forceCloseStragglers, this));
+  }
+
+  void TcpServer::stopShard(EventLoop *ioLoop)
+  {
+    ConnectionShard *shard = shardOf(ioLoop);
+    std::vector<TcpConnectionPtr> conns;
+    {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      for (auto &slot : shard->slots)
+      {
+        if (slot.conn)
+          conns.push_back(slot.conn);
+      }
+    }
+    for (const TcpConnectionPtr &conn : conns)
+      conn->shutdown();
+    // NOTE: 不管本loop有没有连接都要回报; 别的loop可能还有没执行的establishConnection,
+    // 连接数暂时为0不代表已经关完, 所有loop都回报之后才能结束
+    loop_->queueInLoop(std::bind(&TcpServer::shardStopped, this));
+  }
+
+  // 某个loop已经半关闭了自己的连接, 在baseloop中计数
+  void TcpServer::shardStopped()
+  {
+    --pendingShards_;
+    checkStopped();
+  }
+
+  void TcpServer::forceCloseStragglers()
+  {
+    LOG_INFO("TcpServer::stop [%s] - deadline reached, force closing %zu connections \n", name_.c_str(), connectionCount());
+    forEachConnection([](const TcpConnectionPtr &conn)
+                      { conn->forceClose(); });
+  }
+
+  // 某个loop的连接关完了(或者刚回报了stopShard), 在baseloop中检查是不是所有loop都关完了
+  void TcpServer::checkStopped()
+  {
+    if (stopping_ && pendingShards_ == 0 && connectionCount() == 0)
+      finishStop();
+  }
+
+  // 所有连接都已经从连接表中移除, 在baseloop中执行
+  void TcpServer::finishStop()
+  {
+    stopping_ = false;
+    stopped_ = true;
+    loop_->cancel(stopTimer_);
+
+    // NOTE: connectDestroyed是投递到各个subloop中执行的, 先等每个subloop处理完手上的任务, 再让它们退出
+    std::vector<EventLoop *> loops = threadPool_->getAllLoops();
+    for (EventLoop *ioLoop : loops)
+    {
+      if (ioLoop == loop_)
+        continue;
+      std::promise<void> done;
+      std::future<void> finished = done.get_future();
+      ioLoop->queueInLoop([&done]()
+                          { done.set_value(); });
+      finished.wait();
+    }
+    threadPool_->stop();
+    LOG_INFO("TcpServer::stop [%s] - stopped \n", name_.c_str());
+
+    StopCallback cb;
+    cb.swap(stopCallback_);
+    if (cb)
+      cb();
+  }
+
+  // 每个loop各自bind一个SO_REUSEPORT的监听socket; socket/bind可以在当前线程完成,
+  // 但注册到Poller(listen)必须在acceptor所属的loop线程中进行
+  void TcpServer::startLoopAcceptors()
+  {
+    std::vector<EventLoop *> loops = threadPool_->getAllLoops();
+    for (EventLoop *ioLoop : loops)
+    {
+      Acceptor *acceptor = new Acceptor(ioLoop, listenAddr_, true);
+      acceptor->setMaxAcceptsPerWakeup(maxAcceptsPerWakeup_);
+      acceptor->setNewConnectionCallback(
+          std::bind(&TcpServer::createConnection, this, ioLoop, std::placeholders::_1, std::placeholders::_2));
+      loopAcceptors_.push_back(std::unique_ptr<Acceptor>(acceptor));
+      ioLoop->runInLoop(std::bind(&Acceptor::listen, acceptor));
+    }
+  }
+
+  // Acceptor析构时要把channel从Poller中移除, 必须在它的loop线程中进行, 这里同步等待每一个完成
+  void TcpServer::stopLoopAcceptors()
+  {
+    for (auto &acceptor : loopAcceptors_)
+    {
+      std::promise<void> done;
+      std::future<void> finished = done.get_future();
+      Acceptor *raw = acceptor.release();
+      raw->getLoop()->runInLoop([raw, &done]()
+                                {
+                                  delete raw;
+                                  done.set_value(); });
+      finished.wait();
+    }
+    loopAcceptors_.clear();
+  }
+
+  size_t TcpServer::bufferMemory() const
+  {
+    size_t total = 0;
+    forEachConnection([&total](const TcpConnectionPtr &conn)
+                      { total += conn->memoryUsage(); });
+    return total;
+  }
+
+  // 在mainloop中定时执行: 超出预算时按最后活跃时间从旧到新回收, 直到估计回收的量足够为止
+  void TcpServer::checkMemoryBudget()
+  {
+    struct Candidate
+    {
+      int64_t lastActive;
+      size_t usage; // 采样时的占用; 之后subloop还会修改memoryUsage(), 不能再读一次
+      TcpConnectionPtr conn;
+    };
+    std::vector<Candidate> candidates;
+    size_t total = 0;
+    const size_t minUsage = 2 * BufferPool::kMinBlockSize; // 收发缓冲区都是最小规格时, 已经没有可回收的了
+    forEachConnection([&](const TcpConnectionPtr &conn)
+                      {
+                        size_t usage = conn->memoryUsage();
+                        total += usage;
+                        if (usage > minUsage)
+                          candidates.push_back(Candidate{conn->lastActive().microSecondsSinceEpoch(), usage, conn}); });
+    if (total <= memoryBudget_)
+      return;
+
+    std::sort(candidates.begin(), candidates.end(),
+              [](const Candidate &lhs, const Candidate &rhs)
+              { return lhs.lastActive < rhs.lastActive; });
+
+    size_t excess = total - memoryBudget_;
+    size_t reclaimed = 0;
+    int count = 0;
+    for (size_t i = 0; i < candidates.size() && reclaimed < excess; ++i)
+    {
+      reclaimed += candidates[i].usage - minUsage; // 收集时已经保证usage > minUsage
+      candidates[i].conn->reclaimMemory();          // 在连接所属的subloop中执行
+      ++count;
+    }
+    LOG_INFO("TcpServer::checkMemoryBudget [%s] buffers use %zu bytes, budget %zu, reclaiming %d connections \n",
+             name_.c_str(), total, memoryBudget_, count);
   }
 
-} // namespace zfwmuduo
\ No newline at end of file
+} // namespace zfwmuduo
@@ -9,6 +9,8 @@
 #include <memory> // unique_ptr, shared_ptr
 #include <atomic> // AtomicInt
 #include <unordered_map>
+#include <vector>
+#include <mutex>
 #include "../base/noncopyable.h"
 #include "EventLoopThreadPool.h"
 #include "EventLoop.h"
@@ -34,11 +36,15 @@ namespace zfwmuduo
     // - 函数返回类型为 void（即不返回任何值）。
     // - 函数接受一个参数，类型为 EventLoop *（即指向 EventLoop 类型的指针）。
     typedef std::function<void(EventLoop *)> ThreadInitCallback;
+    typedef std::function<void()> StopCallback;
 
     enum Option // 枚举: 选项, 是否对端口可重用
     {
       kNoReusePort, // 不重用端口
       kReusePort,
+      // 每个subloop各自持有一个SO_REUSEPORT的监听socket, 由内核在它们之间分摊accept,
+      // 连接直接诞生在服务它的subloop上, 不再经过mainloop中转
+      kReusePortPerLoop,
     };
 
     TcpServer(EventLoop *, std::string nameArg, const InetAddress &listenAddr, Option option = kNoReusePort);
@@ -48,8 +54,10 @@ namespace zfwmuduo
     const std::string &ipPort() const { return ipPort_; }
     const std::string name() const { return name_; }
     EventLoop *getLoop() const { return loop_; }
+    // 底层线程池, 可在start()之前设置绑核等选项
+    EventLoopThreadPool *threadPool() const { return threadPool_.get(); }
 
-    // 设置线程初始化回调
+    // 设置线程初始化回调; 以下回调在start()时放进所有连接共享的回调表, 需在start()之前设置
     void setThreadInitCallback(const ThreadInitCallback &cb) { threadInitCallback_ = cb; }
     void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; }
     void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
@@ -58,22 +66,108 @@ namespace zfwmuduo
     // 设置底层subloop的个数
     void setThreadNum(int numThreads);
 
+    // 新连接分配给subloop的策略, 默认轮询; 需在start()之前设置
+    void setLoopSelectPolicy(EventLoopThreadPool::SelectPolicy policy) { threadPool_->setSelectPolicy(policy); }
+
+    // 新连接以边沿触发(EPOLLET)方式注册, 默认水平触发; 需在start()之前设置
+    void setEdgeTriggered(bool on) { edgeTriggered_ = on; }
+
+    // 新连接的发送缓冲区使用分段的BufferChain, 见TcpConnection::setChainedOutput; 需在start()之前设置
+    void setChainedOutput(bool on) { chainedOutput_ = on; }
+
+    // 新连接读之前先用FIONREAD探测可读字节数, 见TcpConnection::setReadProbe; 需在start()之前设置
+    void setReadProbe(bool on) { readProbe_ = on; }
+
+    // 新连接的发送在本轮循环结束时合并成一次写, 见TcpConnection::setAutoCork; 需在start()之前设置
+    void setAutoCork(bool on) { autoCork_ = on; }
+
+    // 新连接不少于bytes的发送用MSG_ZEROCOPY, 0表示不启用, 见TcpConnection::setZeroCopyThreshold; 需在start()之前设置
+    void setZeroCopyThreshold(size_t bytes) { zeroCopyThreshold_ = bytes; }
+
+    // 所有连接收发缓冲区的内存预算: 每隔checkInterval秒检查一次, 超出预算时从最久没有读写的连接开始回收缓冲区;
+    // 0表示不限制; 需在start()之前设置
+    void setMemoryBudget(size_t bytes, double checkInterval = 1.0)
+    {
+      memoryBudget_ = bytes;
+      memoryCheckInterval_ = checkInterval;
+    }
+    // 所有连接收发缓冲区当前占用的内存
+    size_t bufferMemory() const;
+    // 当前的连接数, 各个loop之和
+    size_t connectionCount() const;
+    // 按TcpConnection::id()查找连接, O(1), 可跨线程调用; 连接已经关闭(槽位被回收或者复用)时返回空
+    TcpConnectionPtr findConnection(uint64_t id) const;
+
+    // 连接空闲超过seconds秒(没有收到任何数据)就主动关闭, <=0表示不启用; 需在start()之前设置
+    void setIdleTimeout(double seconds) { idleTimeout_ = seconds; }
+
+    // 每次listenfd可读时最多连续accept的连接数, 默认64
+    void setMaxAcceptsPerWakeup(int n);
+    // accept成功/失败/因描述符耗尽被关闭的连接计数, kReusePortPerLoop时为所有acceptor之和
+    Acceptor::Stats acceptStats() const;
+
     // 开启服务器监听
     void start();
 
+    // 优雅停止(比如滚动重启): 关闭监听不再accept; 每个连接在发送缓冲区写完之后半关闭, 等对端关闭;
+    // deadline秒后还没关闭的连接强制关闭; 全部关闭后join所有subloop线程, 然后在baseloop中回调cb
+    // 只能在baseloop线程中调用, baseloop要一直运行到cb被调用; 之后可以直接析构TcpServer
+    // 已经停止之后再调用不做任何事, 直接回调cb
+    void stop(double deadline, const StopCallback &cb = StopCallback());
+
   private:
     void newConnection(int sockfd, const InetAddress &peerAddr);
+    void createConnection(EventLoop *ioLoop, int sockfd, const InetAddress &peerAddr);
+    void checkMemoryBudget();
+    void startLoopAcceptors();
+    void stopLoopAcceptors();
+    void establishConnection(const TcpConnectionPtr &conn);
     void removeConnection(const TcpConnectionPtr &conn);
-    void removeConnectionInLoop(const TcpConnectionPtr &conn);
+    void stopInLoop(double deadline, const StopCallback &cb);
+    void stopShard(EventLoop *ioLoop);
+    void shardStopped();
+    void forceCloseStragglers();
+    void checkStopped();
+    void finishStop();
+
+    // 每个loop一份连接表: 连接的加入和移除都只在所属的loop线程中进行, 建立和关闭不需要经过mainloop;
+    // 锁只是给统计/停止/findConnection这类偶尔从别的线程访问的操作用的, 平时没有竞争
+    // 连接存放在slots中, 连接id = generation(高32位) | shard序号(8位) | 槽位下标(24位);
+    // 槽位回收时generation加1, 拿着旧id来查的会因为generation对不上而查不到
+    struct ConnectionShard
+    {
+      struct Slot
+      {
+        uint32_t generation;
+        TcpConnectionPtr conn;
+      };
+      explicit ConnectionShard(uint32_t idx) : index(idx), count(0) {}
+
+      const uint32_t index;
+      mutable std::mutex mutex;
+      std::vector<Slot> slots;
+      std::vector<uint32_t> freeSlots; // 空闲的槽位下标, 后进先出
+      size_t count;                    // slots中的连接数
+    };
+    static const int kSlotBits = 24;
+    static const uint32_t kMaxShards = 256;
 
-    typedef std::unordered_map<std::string, TcpConnectionPtr> ConnectionMap;
+    ConnectionShard *shardOf(EventLoop *ioLoop) const { return loopShards_.find(ioLoop)->second; }
+    // 依次锁住每个shard, 对其中的每个连接调用func
+    void forEachConnection(const std::function<void(const TcpConnectionPtr &)> &func) const;
 
     EventLoop *loop_; // baseloop 用户定义的loop
 
     const std::string ipPort_;
     const std::string name_;
 
-    std::unique_ptr<Acceptor> acceptor_; // 运行在mainloop, 任务：监听新连接事件 | "avoid revealing Acceptor"
+    const InetAddress listenAddr_;
+    const Option option_;
+    int maxAcceptsPerWakeup_;
+
+    std::unique_ptr<Acceptor> acceptor_; // 运行在mainloop, 任务：监听新连接事件 | "avoid revealing Acceptor"; kReusePortPerLoop时为空
+    // kReusePortPerLoop: 每个subloop一个acceptor, 在start()中创建, 只能在各自的loop线程中析构
+    std::vector<std::unique_ptr<Acceptor>> loopAcceptors_;
 
     std::shared_ptr<EventLoopThreadPool> threadPool_; // one loop per thread
 
@@ -86,8 +180,29 @@ namespace zfwmuduo
 
     std::atomic_int started_;
 
-    int nextConnId_;
-    ConnectionMap connections_; // 保存所有的连接
+    // 所有连接共享的回调表, 在start()中建好
+    TcpConnection::CallbackTablePtr callbacks_;
+    // 连接表, 按shard序号排列; loopShards_: loop -> 该loop的连接表; 都在start()中建好, 之后只读
+    std::vector<std::unique_ptr<ConnectionShard>> shards_;
+    std::unordered_map<EventLoop *, ConnectionShard *> loopShards_;
+
+    double idleTimeout_; // 连接的空闲超时, 由各个subloop的时间轮负责
+    bool edgeTriggered_;
+    bool chainedOutput_;
+    bool readProbe_;
+    bool autoCork_;
+    size_t zeroCopyThreshold_;
+
+    size_t memoryBudget_;
+    double memoryCheckInterval_;
+    TimerId memoryTimer_;
+
+    // stop(): 除stopping_外只在baseloop线程中访问
+    std::atomic_bool stopping_; // 正在等连接关闭, subloop中移除连接时会读取
+    bool stopped_;              // 已经停止, 不能再次停止
+    StopCallback stopCallback_;
+    TimerId stopTimer_;    // deadline到时强制关闭
+    size_t pendingShards_; // 还没执行完stopShard的loop数
   };
 
 } // namespace zfwmuduo
\ No newline at end of file
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h> // int64_t
+
+/**
+ * TimerId: 对外暴露的定时器标识, 用于取消定时器
+ * 只保存Timer指针和序号, 不参与Timer的生命周期管理
+ */
+
+namespace zfwmuduo
+{
+  class Timer;
+  class TimerId
+  {
+  public:
+    TimerId() : timer_(nullptr), sequence_(0) {}
+    TimerId(Timer *timer, int64_t seq) : timer_(timer), sequence_(seq) {}
+
+    // 默认的拷贝构造、析构、赋值都可以使用
+
+    friend class TimerQueue;
+
+  private:
+    Timer *timer_;
+    int64_t sequence_;
+  };
+
+} // namespace zfwmuduo
@@ -0,0 +1,204 @@
+#include <sys/timerfd.h> // timerfd_create() timerfd_settime()
+#include <errno.h>
+#include <string.h> // memset()
+#include <unistd.h> // read() close()
+#include <functional>
+#include <iterator>  // back_inserter
+#include <algorithm> // copy()
+
+#include "TimerQueue.h"
+#include "Timer.h"
+#include "TimerId.h"
+#include "EventLoop.h"
+#include "../base/Logger.h"
+
+namespace zfwmuduo
+{
+  static int createTimerfd()
+  {
+    // CLOCK_MONOTONIC: 不受系统时间修改的影响
+    int timerfd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timerfd < 0)
+    {
+      LOG_FATAL("%s:%s:%d timerfd_create errno:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    return timerfd;
+  }
+
+  // 计算从现在到when的时间间隔
+  static struct timespec howMuchTimeFromNow(Timestamp when)
+  {
+    int64_t microseconds = when.microSecondsSinceEpoch() - Timestamp::now().microSecondsSinceEpoch();
+    if (microseconds < 100) // 间隔为0会被timerfd当作停止定时器
+    {
+      microseconds = 100;
+    }
+    struct timespec ts;
+    ts.tv_sec = static_cast<time_t>(microseconds / Timestamp::kMicroSecondsPerSecond);
+    ts.tv_nsec = static_cast<long>((microseconds % Timestamp::kMicroSecondsPerSecond) * 1000);
+    return ts;
+  }
+
+  // 读走timerfd上的到期次数, 否则LT模式下会一直触发
+  static void readTimerfd(int timerfd)
+  {
+    uint64_t howmany;
+    ssize_t n = ::read(timerfd, &howmany, sizeof howmany);
+    if (n != sizeof howmany)
+    {
+      LOG_ERROR("TimerQueue::handleRead() reads %ld bytes instead of 8", n);
+    }
+  }
+
+  // 重新设置timerfd的到期时间
+  static void resetTimerfd(int timerfd, Timestamp expiration)
+  {
+    struct itimerspec newValue;
+    struct itimerspec oldValue;
+    memset(&newValue, 0, sizeof newValue);
+    memset(&oldValue, 0, sizeof oldValue);
+    newValue.it_value = howMuchTimeFromNow(expiration);
+    if (::timerfd_settime(timerfd, 0, &newValue, &oldValue))
+    {
+      LOG_ERROR("timerfd_settime errno:%d \n", errno);
+    }
+  }
+
+  TimerQueue::TimerQueue(EventLoop *loop) : loop_(loop),
+                                            timerfd_(createTimerfd()),
+                                            timerfdChannel_(loop, timerfd_),
+                                            timers_(),
+                                            callingExpiredTimers_(false)
+  {
+    timerfdChannel_.setReadCallback(std::bind(&TimerQueue::handleRead, this));
+    // 定时器到期, timerfd可读
+    timerfdChannel_.enableReading();
+  }
+
+  TimerQueue::~TimerQueue()
+  {
+    timerfdChannel_.disableAll();
+    timerfdChannel_.remove();
+    ::close(timerfd_);
+    for (const Entry &timer : timers_)
+    {
+      delete timer.second;
+    }
+  }
+
+  TimerId TimerQueue::addTimer(TimerCallback cb, Timestamp when, double interval)
+  {
+    Timer *timer = new Timer(std::move(cb), when, interval);
+    // 真正的插入操作放到loop线程中执行, 这样timers_不需要加锁
+    loop_->runInLoop(std::bind(&TimerQueue::addTimerInLoop, this, timer));
+    return TimerId(timer, timer->sequence());
+  }
+
+  void TimerQueue::cancel(TimerId timerId)
+  {
+    loop_->runInLoop(std::bind(&TimerQueue::cancelInLoop, this, timerId));
+  }
+
+  void TimerQueue::addTimerInLoop(Timer *timer)
+  {
+    bool earliestChanged = insert(timer);
+    if (earliestChanged) // 新定时器最早到期, 需要重新设置timerfd
+    {
+      resetTimerfd(timerfd_, timer->expiration());
+    }
+  }
+
+  void TimerQueue::cancelInLoop(TimerId timerId)
+  {
+    ActiveTimer timer(timerId.timer_, timerId.sequence_);
+    ActiveTimerSet::iterator it = activeTimers_.find(timer);
+    if (it != activeTimers_.end())
+    {
+      timers_.erase(Entry(it->first->expiration(), it->first));
+      delete it->first;
+      activeTimers_.erase(it);
+    }
+    else if (callingExpiredTimers_)
+    { // TAG: 定时器在自己的回调里取消自己(比如runEvery的回调里cancel), 此时它已经不在timers_中了
+      // 记录下来, 等回调执行完之后不再重新插入
+      cancelingTimers_.insert(timer);
+    }
+  }
+
+  void TimerQueue::handleRead()
+  {
+    Timestamp now(Timestamp::now());
+    readTimerfd(timerfd_);
+
+    std::vector<Entry> expired = getExpired(now);
+
+    callingExpiredTimers_ = true;
+    cancelingTimers_.clear();
+    for (const Entry &it : expired)
+    {
+      it.second->run(); // 执行定时器回调
+    }
+    callingExpiredTimers_ = false;
+
+    reset(expired, now);
+  }
+
+  std::vector<TimerQueue::Entry> TimerQueue::getExpired(Timestamp now)
+  {
+    std::vector<Entry> expired;
+    // NOTE: UINTPTR_MAX保证sentry比所有到期时间等于now的Entry都大
+    Entry sentry(now, reinterpret_cast<Timer *>(UINTPTR_MAX));
+    TimerList::iterator end = timers_.lower_bound(sentry); // 第一个未到期的定时器
+    std::copy(timers_.begin(), end, std::back_inserter(expired));
+    timers_.erase(timers_.begin(), end);
+
+    for (const Entry &it : expired)
+    {
+      ActiveTimer timer(it.second, it.second->sequence());
+      activeTimers_.erase(timer);
+    }
+    return expired;
+  }
+
+  void TimerQueue::reset(const std::vector<Entry> &expired, Timestamp now)
+  {
+    for (const Entry &it : expired)
+    {
+      ActiveTimer timer(it.second, it.second->sequence());
+      // 重复的定时器, 并且没有在回调中被取消, 就重新插入
+      if (it.second->repeat() && cancelingTimers_.find(timer) == cancelingTimers_.end())
+      {
+        it.second->restart(now);
+        insert(it.second);
+      }
+      else
+      {
+        delete it.second;
+      }
+    }
+
+    if (!timers_.empty())
+    {
+      Timestamp nextExpire = timers_.begin()->second->expiration();
+      if (nextExpire.valid())
+      {
+        resetTimerfd(timerfd_, nextExpire);
+      }
+    }
+  }
+
+  bool TimerQueue::insert(Timer *timer)
+  {
+    bool earliestChanged = false;
+    Timestamp when = timer->expiration();
+    TimerList::iterator it = timers_.begin();
+    if (it == timers_.end() || when < it->first)
+    {
+      earliestChanged = true;
+    }
+    timers_.insert(Entry(when, timer));
+    activeTimers_.insert(ActiveTimer(timer, timer->sequence()));
+    return earliestChanged;
+  }
+
+} // namespace zfwmuduo
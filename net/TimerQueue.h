@@ -0,0 +1,70 @@
+#pragma once
+
+#include <set>
+#include <vector>
+#include <utility> // pair
+#include "../base/noncopyable.h"
+#include "../base/Timestamp.h"
+#include "Callbacks.h"
+#include "Channel.h"
+
+/**
+ * TimerQueue: 定时器队列
+ * 基于timerfd实现, timerfd被封装成Channel注册到所属EventLoop的Poller上,
+ * 定时器到期时由loop线程自己处理, 不需要额外的定时线程
+ *
+ * 内部使用有序集合std::set<(到期时间, Timer*)>, 最早到期的定时器总在begin()
+ */
+
+namespace zfwmuduo
+{
+  class EventLoop;
+  class Timer;
+  class TimerId;
+
+  class TimerQueue : noncopyable
+  {
+  public:
+    explicit TimerQueue(EventLoop *loop);
+    ~TimerQueue();
+
+    // 添加定时器, 可以跨线程调用
+    TimerId addTimer(TimerCallback cb, Timestamp when, double interval);
+
+    // 取消定时器, 可以跨线程调用
+    void cancel(TimerId timerId);
+
+  private:
+    // NOTE: 这里使用裸指针, Timer的生命周期完全由TimerQueue管理
+    typedef std::pair<Timestamp, Timer *> Entry;
+    typedef std::set<Entry> TimerList;
+    typedef std::pair<Timer *, int64_t> ActiveTimer;
+    typedef std::set<ActiveTimer> ActiveTimerSet;
+
+    void addTimerInLoop(Timer *timer);
+    void cancelInLoop(TimerId timerId);
+
+    // timerfd可读时的回调
+    void handleRead();
+
+    // 取出所有已到期的定时器
+    std::vector<Entry> getExpired(Timestamp now);
+    // 重新插入重复的定时器, 并重置timerfd
+    void reset(const std::vector<Entry> &expired, Timestamp now);
+
+    // 插入定时器, 返回最早到期时间是否发生了变化
+    bool insert(Timer *timer);
+
+    EventLoop *loop_; // 定时器队列所属的EventLoop
+    const int timerfd_;
+    Channel timerfdChannel_;
+
+    TimerList timers_; // 按到期时间排序的定时器
+
+    // 用于cancel: activeTimers_与timers_保存的是同一批Timer
+    ActiveTimerSet activeTimers_;
+    bool callingExpiredTimers_; // 是否正在执行到期定时器的回调
+    ActiveTimerSet cancelingTimers_; // 执行回调期间被取消的定时器
+  };
+
+} // namespace zfwmuduo
@@ -0,0 +1,107 @@
+#include <math.h> // ceil()
+#include "TimingWheel.h"
+#include "EventLoop.h"
+
+namespace zfwmuduo
+{
+  TimingWheel::TimingWheel(EventLoop *loop,
+                           double tickSeconds,
+                           size_t numSlots) : loop_(loop),
+                                              tickSeconds_(tickSeconds),
+                                              buckets_(numSlots > 0 ? numSlots : 1),
+                                              cursor_(0),
+                                              size_(0),
+                                              ticking_(false) {}
+
+  TimingWheel::~TimingWheel()
+  {
+    stopTicking();
+  }
+
+  void TimingWheel::place(Entry &entry, double timeout) const
+  {
+    size_t ticks = static_cast<size_t>(ceil(timeout / tickSeconds_));
+    if (ticks == 0)
+      ticks = 1; // 至少等到下一次tick
+    const size_t n = buckets_.size();
+    entry.slot = (cursor_ + ticks) % n;
+    entry.rounds = (ticks - 1) / n;
+  }
+
+  TimingWheel::Handle TimingWheel::add(double timeout, ExpireCallback cb)
+  {
+    Entry entry;
+    entry.callback = std::move(cb);
+    place(entry, timeout);
+    Bucket &bucket = buckets_[entry.slot];
+    Handle handle = bucket.insert(bucket.end(), std::move(entry));
+    if (size_++ == 0)
+      startTicking();
+    return handle;
+  }
+
+  void TimingWheel::refresh(Handle handle, double timeout)
+  {
+    Bucket &from = bucketOf(*handle);
+    place(*handle, timeout);
+    Bucket &to = buckets_[handle->slot];
+    to.splice(to.end(), from, handle); // O(1), 只是挪动链表节点
+  }
+
+  void TimingWheel::remove(Handle handle)
+  {
+    bucketOf(*handle).erase(handle);
+    if (--size_ == 0)
+      stopTicking();
+  }
+
+  void TimingWheel::tick()
+  {
+    cursor_ = (cursor_ + 1) % buckets_.size();
+    Bucket &bucket = buckets_[cursor_];
+    for (Handle it = bucket.begin(); it != bucket.end();)
+    {
+      Handle cur = it++;
+      if (cur->rounds > 0)
+      {
+        --cur->rounds;
+      }
+      else
+      {
+        cur->slot = kExpiringSlot;
+        expiring_.splice(expiring_.end(), bucket, cur);
+      }
+    }
+
+    // TAG: 回调中可能会refresh/remove其它还在expiring_中的超时项, 所以每次先取出再执行
+    while (!expiring_.empty())
+    {
+      ExpireCallback cb(std::move(expiring_.front().callback));
+      expiring_.pop_front();
+      --size_;
+      cb();
+    }
+
+    if (size_ == 0)
+      stopTicking();
+  }
+
+  void TimingWheel::startTicking()
+  {
+    if (!ticking_)
+    {
+      ticking_ = true;
+      tickTimer_ = loop_->runEvery(tickSeconds_, std::bind(&TimingWheel::tick, this));
+    }
+  }
+
+  void TimingWheel::stopTicking()
+  {
+    if (ticking_)
+    {
+      ticking_ = false;
+      loop_->cancel(tickTimer_);
+    }
+  }
+
+} // namespace zfwmuduo
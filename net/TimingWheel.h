@@ -0,0 +1,79 @@
+#pragma once
+
+#include <functional> // function
+#include <list>
+#include <vector>
+#include "../base/noncopyable.h"
+#include "TimerId.h"
+
+/**
+ * TimingWheel: 哈希时间轮(hashed timing wheel)
+ * 专门用于大量"经常被刷新、很少真正到期"的超时, 比如连接的空闲超时
+ *
+ * 每个槽位是一个双向链表, 超时项按 (当前槽位 + 超时tick数) % 槽位数 放入对应槽位,
+ * 超过一圈的用rounds记录剩余圈数. 插入/刷新/删除都是O(1)的链表splice/erase,
+ * 不会像TimerQueue那样每次刷新都要在有序集合里删除再插入
+ *
+ * 由所属EventLoop的定时器驱动, 每tickSeconds秒前进一格, 所有接口只能在loop线程中调用
+ */
+
+namespace zfwmuduo
+{
+  class EventLoop;
+  class TimingWheel : noncopyable
+  {
+  public:
+    typedef std::function<void()> ExpireCallback;
+
+  private:
+    struct Entry
+    {
+      ExpireCallback callback;
+      size_t slot;   // 所在槽位, kExpiringSlot表示已到期正等待执行回调
+      size_t rounds; // 还需要转几圈才到期
+    };
+    typedef std::list<Entry> Bucket;
+
+  public:
+    // NOTE: std::list的splice不会使迭代器失效, 所以Handle在刷新之后依然有效
+    // Handle在回调被执行或者remove之后失效
+    typedef Bucket::iterator Handle;
+
+    TimingWheel(EventLoop *loop, double tickSeconds = 1.0, size_t numSlots = 60);
+    ~TimingWheel();
+
+    // 添加一个timeout秒后到期的超时项
+    Handle add(double timeout, ExpireCallback cb);
+    // 重新从现在开始计时
+    void refresh(Handle handle, double timeout);
+    void remove(Handle handle);
+
+    // 前进一格, 执行所有到期项的回调
+    void tick();
+
+    size_t size() const { return size_; }
+    double tickSeconds() const { return tickSeconds_; }
+
+  private:
+    static const size_t kExpiringSlot = static_cast<size_t>(-1);
+
+    // 计算timeout对应的槽位和圈数
+    void place(Entry &entry, double timeout) const;
+    Bucket &bucketOf(const Entry &entry) { return entry.slot == kExpiringSlot ? expiring_ : buckets_[entry.slot]; }
+
+    // 有超时项时才需要tick, 避免空闲的loop被定时器频繁唤醒
+    void startTicking();
+    void stopTicking();
+
+    EventLoop *loop_;
+    const double tickSeconds_;
+    std::vector<Bucket> buckets_;
+    size_t cursor_; // 当前指向的槽位
+    size_t size_;   // 超时项总数
+
+    Bucket expiring_; // 本次tick已到期、还没执行回调的超时项
+    bool ticking_;
+    TimerId tickTimer_;
+  };
+
+} // namespace zfwmuduo
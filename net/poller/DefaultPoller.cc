@@ -1,5 +1,6 @@
 #include "../Poller.h"
 #include "EPollPoller.h"
+#include "IoUringPoller.h"
 #include <stdlib.h> // getenv()
 /**
  * 属于poller的公共源文件
@@ -11,6 +12,8 @@ namespace zfwmuduo
   {
     if (::getenv("MUDUO_USE_POLL"))
       return nullptr; // 生成poll实例
+    else if (::getenv("MUDUO_USE_IOURING") && IoUringPoller::isSupported())
+      return new IoUringPoller(loop); // 生成io_uring实例, 内核不支持时仍然使用epoll
     else
       return new EPollPoller(loop); // 生成epoll实例
   }
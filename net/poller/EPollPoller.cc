@@ -47,6 +47,11 @@ namespace zfwmuduo
         int fd = channel->fd();
         channels_[fd] = channel;
       }
+      if (channel->isNoneEvent())
+      { // NOTE: 不关注任何事件的channel不能加进epoll, 否则EPOLLHUP/EPOLLERR仍会上报(比如已经被删除的channel再disableAll)
+        channel->set_index(kDeleted);
+        return;
+      }
 
       channel->set_index(kAdded);
       update(EPOLL_CTL_ADD, channel);
@@ -85,6 +90,10 @@ namespace zfwmuduo
     int fd = channel->fd();
 
     event.events = channel->events();
+    if (channel->isEdgeTriggered())
+    {
+      event.events |= EPOLLET;
+    }
     event.data.fd = fd;
     event.data.ptr = channel;
 
@@ -0,0 +1,372 @@
+#include "IoUringPoller.h"
+#include "../../base/Logger.h"
+#include "../Channel.h"
+#include <errno.h>        // errno
+#include <string.h>       // memset()
+#include <unistd.h>       // close() syscall()
+#include <sys/mman.h>     // mmap() munmap()
+#include <sys/syscall.h>  // __NR_io_uring_setup __NR_io_uring_enter __NR_io_uring_register
+#include <stdlib.h>       // malloc() free()
+#include <algorithm>      // max() min()
+
+namespace zfwmuduo
+{
+  // channel的index_状态, 和EPollPoller保持一致
+  static const int kNew = -1;
+  static const int kAdded = 1;
+  static const int kDeleted = 2;
+
+  // user_data的低32位是fd, 高32位是注册序号; 下面两个值的fd部分不可能是合法fd
+  static const uint64_t kTimeoutTag = 0xFFFFFFFFULL;
+  static const uint64_t kCancelTag = 0xFFFFFFFEULL;
+
+  static inline uint64_t makeUserData(int fd, uint32_t seq)
+  {
+    return (static_cast<uint64_t>(seq) << 32) | static_cast<uint32_t>(fd);
+  }
+
+  static int sysIoUringSetup(unsigned entries, io_uring_params *p)
+  {
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, p));
+  }
+
+  static int sysIoUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+  {
+    return static_cast<int>(::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, NULL, 0));
+  }
+
+  bool IoUringPoller::isSupported()
+  {
+    // 只检测一次
+    static const bool supported = []() {
+      io_uring_params params;
+      memset(&params, 0, sizeof params);
+      int fd = sysIoUringSetup(4, &params);
+      if (fd < 0)
+        return false; // ENOSYS(内核太老) 或者被禁用
+
+      // 通过IORING_REGISTER_PROBE确认需要的操作码都可用
+      const size_t len = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+      io_uring_probe *probe = static_cast<io_uring_probe *>(malloc(len));
+      memset(probe, 0, len);
+      bool ok = ::syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+      if (ok)
+      {
+        const int ops[] = {IORING_OP_POLL_ADD, IORING_OP_POLL_REMOVE, IORING_OP_TIMEOUT};
+        for (int op : ops)
+        {
+          if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+            ok = false;
+        }
+      }
+      free(probe);
+      ::close(fd);
+      return ok;
+    }();
+    return supported;
+  }
+
+  IoUringPoller::IoUringPoller(EventLoop *loop) : Poller(loop),
+                                                  ringFd_(-1),
+                                                  sqRing_(nullptr),
+                                                  sqRingSize_(0),
+                                                  sqEntries_(0),
+                                                  sqes_(nullptr),
+                                                  sqesSize_(0),
+                                                  toSubmit_(0),
+                                                  cqRing_(nullptr),
+                                                  cqRingSize_(0),
+                                                  nextSeq_(0),
+                                                  iteration_(0),
+                                                  multishotSupported_(true)
+  {
+    setupRing();
+  }
+
+  IoUringPoller::~IoUringPoller()
+  {
+    ::munmap(sqes_, sqesSize_);
+    if (cqRing_ != sqRing_)
+      ::munmap(cqRing_, cqRingSize_);
+    ::munmap(sqRing_, sqRingSize_);
+    ::close(ringFd_);
+  }
+
+  void IoUringPoller::setupRing()
+  {
+    io_uring_params params;
+    memset(&params, 0, sizeof params);
+    params.flags = IORING_SETUP_CQSIZE; // 完成队列开大一些, 大量连接同时就绪时不容易溢出
+    params.cq_entries = kCqEntries;
+    ringFd_ = sysIoUringSetup(kRingEntries, &params);
+    if (ringFd_ < 0)
+    {
+      LOG_FATAL("io_uring_setup error: %d \n", errno);
+    }
+
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    // NOTE: 新内核SQ和CQ可以共用一次mmap
+    bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap)
+    {
+      sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+    }
+
+    sqRing_ = ::mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED)
+    {
+      LOG_FATAL("io_uring mmap sq ring error: %d \n", errno);
+    }
+    if (singleMmap)
+    {
+      cqRing_ = sqRing_;
+    }
+    else
+    {
+      cqRing_ = ::mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_CQ_RING);
+      if (cqRing_ == MAP_FAILED)
+      {
+        LOG_FATAL("io_uring mmap cq ring error: %d \n", errno);
+      }
+    }
+
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe *>(::mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQES));
+    if (sqes_ == MAP_FAILED)
+    {
+      LOG_FATAL("io_uring mmap sqes error: %d \n", errno);
+    }
+
+    char *sq = static_cast<char *>(sqRing_);
+    sqHead_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sqMask_ = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sqArray_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    sqEntries_ = params.sq_entries;
+
+    char *cq = static_cast<char *>(cqRing_);
+    cqHead_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cqMask_ = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+  }
+
+  int IoUringPoller::enter(unsigned toSubmit, unsigned minComplete, unsigned flags)
+  {
+    int ret = sysIoUringEnter(ringFd_, toSubmit, minComplete, flags);
+    if (ret >= 0)
+    {
+      toSubmit_ -= std::min(toSubmit_, static_cast<unsigned>(ret));
+    }
+    return ret;
+  }
+
+  io_uring_sqe *IoUringPoller::getSqe()
+  {
+    unsigned tail = *sqTail_;
+    // NOTE: sqHead_由内核更新, 需要acquire语义读取
+    if (tail - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) >= sqEntries_)
+    { // 提交队列满了, 先提交一批
+      if (enter(toSubmit_, 0, 0) < 0)
+      {
+        LOG_ERROR("io_uring_enter submit error: %d \n", errno);
+      }
+    }
+
+    unsigned index = tail & *sqMask_;
+    io_uring_sqe *sqe = &sqes_[index];
+    memset(sqe, 0, sizeof *sqe);
+    sqArray_[index] = index;
+    // 内核看到新的tail之前, sqe的内容必须已经写好
+    __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+    ++toSubmit_;
+    return sqe;
+  }
+
+  // channel update remove => EventLoop updateChannel removeChannel => Poller updateChannel removeChannel
+  void IoUringPoller::updateChannel(Channel *channel)
+  {
+    const int index = channel->index();
+    const int fd = channel->fd();
+    LOG_DEBUG("func=%s => fd=%d events=%d index=%d \n", __FUNCTION__, fd, channel->events(), index);
+    if (index == kNew || index == kDeleted)
+    {
+      if (index == kNew)
+      {
+        channels_[fd] = channel;
+      }
+      channel->set_index(kAdded);
+
+      PollState &state = states_[fd];
+      state.channel = channel;
+      state.seq = ++nextSeq_;
+      state.armed = false;
+      state.revents = 0;
+      state.activeIteration = 0;
+      dirty_.push_back(fd);
+    }
+    else
+    { // channel已在poller上注册过, 先撤销旧的poll请求, 再按新的事件重新提交
+      PollState &state = states_[fd];
+      if (state.armed)
+      {
+        cancelPoll(fd, state.seq);
+        state.armed = false;
+      }
+      state.seq = ++nextSeq_;
+      if (channel->isNoneEvent())
+      {
+        channel->set_index(kDeleted);
+      }
+      else
+      {
+        dirty_.push_back(fd);
+      }
+    }
+  }
+
+  void IoUringPoller::removeChannel(Channel *channel)
+  {
+    int fd = channel->fd();
+    channels_.erase(fd);
+
+    LOG_DEBUG("func=%s => fd=%d \n", __FUNCTION__, fd);
+
+    PollStateMap::iterator it = states_.find(fd);
+    if (it != states_.end())
+    {
+      if (it->second.armed)
+        cancelPoll(fd, it->second.seq);
+      states_.erase(it);
+    }
+    channel->set_index(kNew);
+  }
+
+  void IoUringPoller::cancelPoll(int fd, uint32_t seq)
+  {
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = makeUserData(fd, seq);
+    sqe->user_data = kCancelTag;
+  }
+
+  void IoUringPoller::armPending()
+  {
+    for (int fd : dirty_)
+    {
+      PollStateMap::iterator it = states_.find(fd);
+      if (it == states_.end())
+        continue; // 已经removeChannel了
+      PollState &state = it->second;
+      if (state.armed || state.channel->isNoneEvent())
+        continue; // 同一个fd可能在dirty_中出现多次
+
+      io_uring_sqe *sqe = getSqe();
+      sqe->opcode = IORING_OP_POLL_ADD;
+      sqe->fd = fd;
+      // NOTE: EPOLLIN/EPOLLOUT/EPOLLPRI与POLLIN/POLLOUT/POLLPRI的取值相同
+      sqe->poll32_events = static_cast<__u32>(state.channel->events());
+      if (state.channel->isEdgeTriggered() && multishotSupported_)
+      {
+        sqe->len = IORING_POLL_ADD_MULTI;
+      }
+      sqe->user_data = makeUserData(fd, state.seq);
+      state.armed = true;
+    }
+    dirty_.clear();
+  }
+
+  Timestamp IoUringPoller::poll(int timeoutMs, ChannelList *activeChannels)
+  {
+    LOG_DEBUG("func=%s => fd total count:%lu \n", __FUNCTION__, channels_.size());
+
+    armPending();
+
+    if (timeoutMs >= 0)
+    { // off=1: 只要有别的请求完成, 这个超时请求也随之完成, 不会在内核里堆积
+      timeout_.tv_sec = timeoutMs / 1000;
+      timeout_.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000 * 1000;
+      io_uring_sqe *sqe = getSqe();
+      sqe->opcode = IORING_OP_TIMEOUT;
+      sqe->fd = -1;
+      sqe->addr = reinterpret_cast<uint64_t>(&timeout_);
+      sqe->len = 1;
+      sqe->off = 1;
+      sqe->user_data = kTimeoutTag;
+    }
+
+    // TAG: 本轮所有的注册/取消/超时请求, 和等待完成事件合并成一次系统调用
+    int ret = enter(toSubmit_, 1, IORING_ENTER_GETEVENTS);
+    int saveErrno = errno;
+    Timestamp now(Timestamp::now());
+    if (ret < 0 && saveErrno != EINTR && saveErrno != EBUSY && saveErrno != EAGAIN)
+    {
+      errno = saveErrno;
+      LOG_ERROR("IoUringPoller::poll() errno:%d", saveErrno);
+    }
+
+    fillActiveChannels(activeChannels);
+    if (activeChannels->empty())
+    {
+      LOG_DEBUG("%s timeout! \n", __FUNCTION__);
+    }
+    return now;
+  }
+
+  void IoUringPoller::fillActiveChannels(ChannelList *activeChannels)
+  {
+    ++iteration_;
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head)
+    {
+      const io_uring_cqe &cqe = cqes_[head & *cqMask_];
+      if (cqe.user_data == kTimeoutTag || cqe.user_data == kCancelTag)
+        continue;
+
+      int fd = static_cast<int>(cqe.user_data & 0xFFFFFFFFULL);
+      uint32_t seq = static_cast<uint32_t>(cqe.user_data >> 32);
+      PollStateMap::iterator it = states_.find(fd);
+      if (it == states_.end() || it->second.seq != seq)
+        continue; // 已经被移除或者重新注册过的旧请求
+
+      PollState &state = it->second;
+      if (!(cqe.flags & IORING_CQE_F_MORE))
+      { // 单次poll已完成, 或者multishot被内核终止了, 下一轮需要重新提交
+        state.armed = false;
+        dirty_.push_back(fd);
+      }
+
+      if (cqe.res < 0)
+      {
+        if (cqe.res == -EINVAL && state.channel->isEdgeTriggered() && multishotSupported_)
+        { // 内核不支持IORING_POLL_ADD_MULTI, 之后都使用单次poll
+          LOG_ERROR("IoUringPoller: multishot poll unsupported, fall back to oneshot \n");
+          multishotSupported_ = false;
+        }
+        else if (cqe.res != -ECANCELED)
+        {
+          LOG_ERROR("IoUringPoller: poll fd=%d error:%d \n", fd, -cqe.res);
+        }
+        continue;
+      }
+
+      // 同一轮里同一个fd可能有多个完成事件, 合并成一次通知
+      if (state.activeIteration != iteration_)
+      {
+        state.activeIteration = iteration_;
+        state.revents = cqe.res;
+        activeChannels->push_back(state.channel);
+      }
+      else
+      {
+        state.revents |= cqe.res;
+      }
+      state.channel->set_revents(state.revents);
+    }
+    __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+  }
+
+} // namespace zfwmuduo
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "../Poller.h"
+#include "../../base/Timestamp.h"
+#include <vector>
+#include <unordered_map>
+#include <linux/io_uring.h> // io_uring_sqe io_uring_cqe io_uring_params __kernel_timespec
+/**
+ * io_uring的使用: io_uring_setup、io_uring_enter (直接走系统调用, 不依赖liburing)
+ *
+ * 仍然是"就绪通知"模型, 和EPollPoller对外的行为保持一致:
+ * - 水平触发的channel使用单次IORING_OP_POLL_ADD, 完成后在下一次poll()时重新提交,
+ *   如果fd仍然就绪会立即完成, 效果等同于LT
+ * - 边沿触发的channel使用multishot poll, 注册一次持续产生完成事件, 效果等同于ET
+ * 所有的注册/取消请求都先放进提交队列, 在poll()里和超时请求一起通过一次io_uring_enter提交并等待
+ */
+
+namespace zfwmuduo
+{
+  class EventLoop;
+  class Channel;
+  class IoUringPoller : public Poller
+  {
+  public:
+    IoUringPoller(EventLoop *loop);
+    ~IoUringPoller() override;
+
+    void updateChannel(Channel *channel) override;
+    void removeChannel(Channel *channel) override;
+    Timestamp poll(int timeoutMs, ChannelList *activeChannels) override;
+
+    // 运行时检测内核是否支持io_uring及所需的操作码, 不支持时使用epoll
+    static bool isSupported();
+
+  private:
+    static const unsigned kRingEntries = 256;
+    static const unsigned kCqEntries = 4096;
+
+    // 每个fd的注册状态
+    struct PollState
+    {
+      Channel *channel;
+      uint32_t seq;             // 每次重新注册都会更换, 用来丢弃旧请求的完成事件
+      bool armed;               // 内核中是否有这个fd的poll请求
+      int revents;              // 本轮poll累计的就绪事件
+      uint64_t activeIteration; // 最近一次加入activeChannels的轮次, 用于去重
+    };
+    typedef std::unordered_map<int, PollState> PollStateMap;
+
+    void setupRing();
+    io_uring_sqe *getSqe(); // 提交队列满时先把已有请求提交给内核
+    int enter(unsigned toSubmit, unsigned minComplete, unsigned flags);
+
+    void armPending();                     // 为dirty_中的fd提交poll请求
+    void cancelPoll(int fd, uint32_t seq); // 提交IORING_OP_POLL_REMOVE
+    void fillActiveChannels(ChannelList *activeChannels);
+
+    int ringFd_;
+
+    // 提交队列(SQ)
+    void *sqRing_;
+    size_t sqRingSize_;
+    unsigned *sqHead_;
+    unsigned *sqTail_;
+    unsigned *sqMask_;
+    unsigned *sqArray_;
+    unsigned sqEntries_;
+    io_uring_sqe *sqes_;
+    size_t sqesSize_;
+    unsigned toSubmit_; // 已写入SQ还没有提交的请求数
+
+    // 完成队列(CQ)
+    void *cqRing_;
+    size_t cqRingSize_;
+    unsigned *cqHead_;
+    unsigned *cqTail_;
+    unsigned *cqMask_;
+    io_uring_cqe *cqes_;
+
+    PollStateMap states_;
+    std::vector<int> dirty_; // 需要(重新)提交poll请求的fd
+    uint32_t nextSeq_;
+    uint64_t iteration_;
+    bool multishotSupported_; // 老内核不支持multishot poll时退化成单次poll
+    struct __kernel_timespec timeout_;
+  };
+
+} // namespace zfwmuduo
@@ -0,0 +1,97 @@
+// 连接风暴基准测试: 多个客户端线程不停地connect/close, 统计每秒能接下多少个连接以及connect延迟
+// 用法: ./benchAcceptStorm single|perloop [clients] [seconds] [maxAcceptsPerWakeup] [threads]
+// single为mainloop单acceptor, perloop为每个subloop一个SO_REUSEPORT acceptor
+// 把ulimit -n调小可以观察EMFILE时的shed计数
+#include <stdio.h>
+#include <stdlib.h> // atoi()
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <algorithm> // sort()
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../net/TcpServer.h"
+
+static const uint16_t kPort = 9982;
+
+static std::mutex g_mutex;
+static std::vector<int64_t> g_latencies; // 每次connect的耗时(us)
+
+static void runClient(std::atomic_bool *stop, std::atomic<int64_t> *connects)
+{
+  std::vector<int64_t> latencies;
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(kPort);
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  while (!*stop)
+  {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (::connect(fd, (sockaddr *)&addr, sizeof addr) == 0)
+    {
+      ++*connects;
+      latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(
+                              std::chrono::steady_clock::now() - start)
+                              .count());
+    }
+    ::close(fd);
+  }
+  std::lock_guard<std::mutex> lock(g_mutex);
+  g_latencies.insert(g_latencies.end(), latencies.begin(), latencies.end());
+}
+
+int main(int argc, char *argv[])
+{
+  bool perLoop = argc > 1 && strcmp(argv[1], "perloop") == 0;
+  int numClients = argc > 2 ? atoi(argv[2]) : 4;
+  double seconds = argc > 3 ? atof(argv[3]) : 5.0;
+  int maxAccepts = argc > 4 ? atoi(argv[4]) : 64;
+  int numThreads = argc > 5 ? atoi(argv[5]) : 2;
+
+  zfwmuduo::EventLoop loop;
+  zfwmuduo::TcpServer server(&loop, "storm", zfwmuduo::InetAddress(kPort),
+                             perLoop ? zfwmuduo::TcpServer::kReusePortPerLoop : zfwmuduo::TcpServer::kNoReusePort);
+  server.setThreadNum(numThreads);
+  server.setMaxAcceptsPerWakeup(maxAccepts);
+  server.setConnectionCallback([](const zfwmuduo::TcpConnectionPtr &) {});
+  server.setMessageCallback([](const zfwmuduo::TcpConnectionPtr &, zfwmuduo::Buffer *buf, zfwmuduo::Timestamp)
+                            { buf->retrieveAll(); });
+  server.start();
+
+  std::atomic_bool stop(false);
+  std::atomic<int64_t> connects(0);
+  std::vector<std::thread> clients;
+  for (int i = 0; i < numClients; ++i)
+  {
+    clients.push_back(std::thread(runClient, &stop, &connects));
+  }
+
+  loop.runAfter(seconds, [&]()
+                {
+                  stop = true;
+                  loop.quit(); });
+  loop.loop();
+  for (size_t i = 0; i < clients.size(); ++i)
+  {
+    clients[i].join();
+  }
+
+  std::sort(g_latencies.begin(), g_latencies.end());
+  int64_t p50 = g_latencies.empty() ? 0 : g_latencies[g_latencies.size() / 2];
+  int64_t p99 = g_latencies.empty() ? 0 : g_latencies[g_latencies.size() * 99 / 100];
+
+  zfwmuduo::Acceptor::Stats stats = server.acceptStats();
+  printf("%s clients=%d threads=%d maxAccepts=%d: %.0f connects/s, p50=%lldus p99=%lldus, accepted=%llu failed=%llu shed=%llu\n",
+         perLoop ? "perloop" : "single", numClients, numThreads, maxAccepts,
+         static_cast<double>(connects) / seconds, (long long)p50, (long long)p99,
+         (unsigned long long)stats.accepted, (unsigned long long)stats.failed,
+         (unsigned long long)stats.shed);
+  return 0;
+}
@@ -0,0 +1,146 @@
+// 读写速度不匹配的echo: 客户端一个线程尽快写, 另一个线程按固定速率慢慢读, 比较服务端发送缓冲区的峰值
+// 用法: ./benchBackpressure none|backpressure [seconds] [readMBps]
+// none:         普通echo, 服务端照单全收, 发不出去的数据全部积压在发送缓冲区
+// backpressure: conn->setBackpressure(conn, 1MB, 256KB), 积压到高水位时暂停读本连接, 由TCP流控让客户端的写阻塞
+#include <stdio.h>
+#include <stdlib.h> // atoi() atof()
+#include <string.h> // strcmp()
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/time.h> // timeval
+#include <algorithm>  // max()
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "../net/TcpServer.h"
+#include "../net/EventLoop.h"
+
+using namespace zfwmuduo;
+
+static const uint16_t kPort = 9993;
+static const size_t kHighWaterMark = 1024 * 1024;
+static const size_t kLowWaterMark = 256 * 1024;
+static std::atomic_bool g_stop(false);
+
+static long residentKB()
+{
+  FILE *fp = ::fopen("/proc/self/statm", "r");
+  long pages = 0, resident = 0;
+  if (fp)
+  {
+    if (::fscanf(fp, "%ld %ld", &pages, &resident) != 2)
+      resident = 0;
+    ::fclose(fp);
+  }
+  return resident * (::sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static int connectServer()
+{
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(kPort);
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  if (::connect(fd, (sockaddr *)&addr, sizeof addr) < 0)
+  {
+    perror("connect");
+    ::close(fd);
+    return -1;
+  }
+  // 阻塞读写加上超时, 结束时两个线程都能及时看到g_stop
+  struct timeval tv = {0, 100 * 1000};
+  ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof tv);
+  ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+  return fd;
+}
+
+static void writer(int fd, std::atomic<uint64_t> *written)
+{
+  std::vector<char> buf(64 * 1024, 'x');
+  while (!g_stop)
+  {
+    ssize_t n = ::write(fd, &buf[0], buf.size());
+    if (n > 0)
+      *written += n;
+    else if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+      break;
+  }
+}
+
+// 每10ms最多读readMBps/100
+static void reader(int fd, double readMBps, std::atomic<uint64_t> *received)
+{
+  size_t perTick = std::max<size_t>(1, static_cast<size_t>(readMBps * 1e6 / 100));
+  std::vector<char> buf(perTick);
+  while (!g_stop)
+  {
+    size_t got = 0;
+    while (got < perTick && !g_stop)
+    {
+      ssize_t n = ::read(fd, &buf[got], perTick - got);
+      if (n > 0)
+        got += n;
+      else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+        return;
+    }
+    *received += got;
+    ::usleep(10 * 1000);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  const char *mode = argc > 1 ? argv[1] : "backpressure";
+  double seconds = argc > 2 ? atof(argv[2]) : 3.0;
+  double readMBps = argc > 3 ? atof(argv[3]) : 20.0;
+  bool backpressure = strcmp(mode, "none") != 0;
+
+  EventLoop loop;
+  TcpServer server(&loop, "echo", InetAddress(kPort));
+  TcpConnectionPtr echoConn;
+  server.setConnectionCallback([&](const TcpConnectionPtr &conn)
+                               {
+                                 if (!conn->connected())
+                                   return;
+                                 echoConn = conn;
+                                 if (backpressure) // 本连接的输出积压时暂停读本连接
+                                   conn->setBackpressure(conn, kHighWaterMark, kLowWaterMark); });
+  server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+                            { conn->send(buf); });
+  server.start();
+
+  size_t peakMemory = 0;
+  long baseRss = residentKB();
+  long peakRss = baseRss;
+  loop.runEvery(0.01, [&]()
+                {
+                  if (echoConn)
+                    peakMemory = std::max(peakMemory, echoConn->memoryUsage());
+                  peakRss = std::max(peakRss, residentKB()); });
+
+  std::atomic<uint64_t> written(0), received(0);
+  int fd = connectServer();
+  if (fd < 0)
+    return 1;
+  std::thread writeThread(writer, fd, &written);
+  std::thread readThread(reader, fd, readMBps, &received);
+
+  loop.runAfter(seconds, [&]()
+                { loop.quit(); });
+  loop.loop();
+
+  g_stop = true;
+  writeThread.join();
+  readThread.join();
+  ::close(fd);
+
+  printf("%-12s %.1fs read %.0fMB/s: written %.1fMB, echoed %.1fMB, peak buffered %.1fMB, peak rss +%.1fMB, pauses %llu\n",
+         mode, seconds, readMBps, written / 1e6, received / 1e6, peakMemory / 1e6, (peakRss - baseRss) / 1024.0,
+         static_cast<unsigned long long>(echoConn ? echoConn->backpressurePauses() : 0));
+  return 0;
+}
@@ -0,0 +1,120 @@
+// 突发流量之后的常驻内存: 每个连接先收发一次大消息, 之后一直空闲, 比较稳定后的缓冲区占用和RSS
+// 用法: ./benchBurstRss none|shrink|budget [connections] [burstBytes]
+// none:   不收缩(setShrinkThreshold(0))
+// shrink: 默认的收缩策略, 发送完/接收缓冲区剩余数据少时缩回去
+// budget: 不收缩, 但设置4MB的内存预算, 由TcpServer定时回收最冷的连接
+#include <stdio.h>
+#include <stdlib.h> // atoi()
+#include <string.h> // strcmp()
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../net/TcpServer.h"
+
+static const uint16_t kPort = 9985;
+
+static long readStatusKb(const char *key)
+{
+  FILE *fp = ::fopen("/proc/self/status", "r");
+  if (!fp)
+    return -1;
+  char line[256];
+  long value = -1;
+  size_t keyLen = strlen(key);
+  while (::fgets(line, sizeof line, fp))
+  {
+    if (strncmp(line, key, keyLen) == 0)
+    {
+      value = atol(line + keyLen + 1);
+      break;
+    }
+  }
+  ::fclose(fp);
+  return value;
+}
+
+// 建立连接, 发送一次突发请求并读完响应, 连接保持打开
+static int burst(size_t burstBytes)
+{
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(kPort);
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  if (::connect(fd, (sockaddr *)&addr, sizeof addr) < 0)
+  {
+    perror("connect");
+    ::close(fd);
+    return -1;
+  }
+
+  std::string request(burstBytes, 'q');
+  std::thread writer([&]()
+                     { ::write(fd, request.data(), request.size()); });
+  std::vector<char> response(65536);
+  size_t received = 0;
+  while (received < burstBytes)
+  {
+    ssize_t n = ::read(fd, &response[0], response.size());
+    if (n <= 0)
+      break;
+    received += n;
+  }
+  writer.join();
+  return fd;
+}
+
+int main(int argc, char *argv[])
+{
+  const char *mode = argc > 1 ? argv[1] : "shrink";
+  int connections = argc > 2 ? atoi(argv[2]) : 100;
+  size_t burstBytes = argc > 3 ? atoi(argv[3]) : 1024 * 1024;
+
+  zfwmuduo::EventLoop loop;
+  zfwmuduo::TcpServer server(&loop, "burst", zfwmuduo::InetAddress(kPort));
+  server.setThreadNum(2);
+  bool shrink = strcmp(mode, "shrink") == 0;
+  if (strcmp(mode, "budget") == 0)
+    server.setMemoryBudget(4 * 1024 * 1024, 0.5);
+  server.setConnectionCallback([shrink](const zfwmuduo::TcpConnectionPtr &conn)
+                               {
+                                 if (!shrink)
+                                   conn->setShrinkThreshold(0); });
+  server.setMessageCallback([burstBytes](const zfwmuduo::TcpConnectionPtr &conn, zfwmuduo::Buffer *buf, zfwmuduo::Timestamp)
+                            {
+                              if (buf->readableBytes() >= burstBytes)
+                              { // 收齐一个请求后回一个同样大小的响应
+                                buf->retrieve(burstBytes);
+                                conn->send(std::string(burstBytes, 'r'));
+                              } });
+  server.start();
+
+  long baseline = readStatusKb("VmRSS");
+  std::vector<int> fds;
+  std::thread client([&]()
+                     {
+                       for (int i = 0; i < connections; ++i)
+                       {
+                         int fd = burst(burstBytes);
+                         if (fd >= 0)
+                           fds.push_back(fd);
+                       }
+                       ::sleep(2); // 等预算回收
+                       loop.quit(); });
+  loop.loop();
+  client.join();
+
+  printf("%-6s connections=%zu burst=%zu: buffers=%zukB VmRSS=%ldkB (baseline %ldkB) VmHWM=%ldkB\n",
+         mode, fds.size(), burstBytes, server.bufferMemory() / 1024,
+         readStatusKb("VmRSS"), baseline, readStatusKb("VmHWM"));
+  for (size_t i = 0; i < fds.size(); ++i)
+  {
+    ::close(fds[i]);
+  }
+  return 0;
+}
@@ -0,0 +1,116 @@
+// 连接抖动基准测试: 客户端不停地 建连->发送->等回显->关闭, 比较BufferPool和直接malloc的吞吐量与RSS
+// 用法: ./benchChurn pool|malloc [clients] [messageBytes] [seconds]
+#include <stdio.h>
+#include <stdlib.h> // atoi()
+#include <string.h> // strcmp()
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../net/TcpServer.h"
+#include "../net/BufferPool.h"
+
+static const uint16_t kPort = 9984;
+
+static void runClient(int messageBytes, std::atomic_bool *stop, std::atomic<int64_t> *sessions)
+{
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(kPort);
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+  std::string message(messageBytes, 'x');
+  std::vector<char> echo(messageBytes);
+  while (!*stop)
+  {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (::connect(fd, (sockaddr *)&addr, sizeof addr) == 0 &&
+        ::write(fd, message.data(), message.size()) == messageBytes)
+    {
+      int received = 0;
+      while (received < messageBytes)
+      {
+        ssize_t n = ::read(fd, &echo[received], messageBytes - received);
+        if (n <= 0)
+          break;
+        received += n;
+      }
+      if (received == messageBytes)
+        ++*sessions;
+    }
+    ::close(fd);
+  }
+}
+
+// 从/proc/self/status中读取VmRSS或VmHWM(kB)
+static long readStatusKb(const char *key)
+{
+  FILE *fp = ::fopen("/proc/self/status", "r");
+  if (!fp)
+    return -1;
+  char line[256];
+  long value = -1;
+  size_t keyLen = strlen(key);
+  while (::fgets(line, sizeof line, fp))
+  {
+    if (strncmp(line, key, keyLen) == 0)
+    {
+      value = atol(line + keyLen + 1);
+      break;
+    }
+  }
+  ::fclose(fp);
+  return value;
+}
+
+int main(int argc, char *argv[])
+{
+  bool usePool = !(argc > 1 && strcmp(argv[1], "malloc") == 0);
+  int numClients = argc > 2 ? atoi(argv[2]) : 4;
+  int messageBytes = argc > 3 ? atoi(argv[3]) : 4096;
+  double seconds = argc > 4 ? atof(argv[4]) : 5.0;
+
+  zfwmuduo::BufferPool::setEnabled(usePool);
+
+  zfwmuduo::EventLoop loop;
+  zfwmuduo::TcpServer server(&loop, "churn", zfwmuduo::InetAddress(kPort));
+  server.setThreadNum(2);
+  server.setConnectionCallback([](const zfwmuduo::TcpConnectionPtr &) {});
+  server.setMessageCallback([](const zfwmuduo::TcpConnectionPtr &conn, zfwmuduo::Buffer *buf, zfwmuduo::Timestamp)
+                            { conn->send(buf->retrieveAllAsString()); });
+  server.start();
+
+  std::atomic_bool stop(false);
+  std::atomic<int64_t> sessions(0);
+  std::vector<std::thread> clients;
+  for (int i = 0; i < numClients; ++i)
+  {
+    clients.push_back(std::thread(runClient, messageBytes, &stop, &sessions));
+  }
+
+  loop.runAfter(seconds, [&]()
+                {
+                  stop = true;
+                  loop.quit(); });
+  loop.loop();
+  for (size_t i = 0; i < clients.size(); ++i)
+  {
+    clients[i].join();
+  }
+
+  zfwmuduo::BufferPool::Stats stats = zfwmuduo::BufferPool::stats();
+  printf("%-6s clients=%d message=%d: %.0f sessions/s, VmRSS=%ldkB VmHWM=%ldkB\n",
+         usePool ? "pool" : "malloc", numClients, messageBytes,
+         static_cast<double>(sessions) / seconds, readStatusKb("VmRSS"), readStatusKb("VmHWM"));
+  printf("       allocations=%llu threadCacheHits=%llu globalHits=%llu systemAllocs=%llu frees=%llu systemFrees=%llu globalBytes=%llu\n",
+         (unsigned long long)stats.allocations, (unsigned long long)stats.threadCacheHits,
+         (unsigned long long)stats.globalHits, (unsigned long long)stats.systemAllocs,
+         (unsigned long long)stats.frees, (unsigned long long)stats.systemFrees,
+         (unsigned long long)stats.globalBytes);
+  return 0;
+}
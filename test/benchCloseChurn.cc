@@ -0,0 +1,109 @@
+// 短连接抖动(HTTP/1.0风格): 客户端 建连->发请求->读到EOF->关闭, 服务端回复后立即shutdown
+// 用法: ./benchCloseChurn [loops] [clients] [seconds] [acceptor|perloop]
+// acceptor: mainloop中一个Acceptor, 轮询分给各个subloop; perloop: kReusePortPerLoop, 每个subloop自己accept
+// 打印每秒完成的连接数, 以及进程每个连接消耗的CPU时间和线程切换次数(跨线程唤醒越多, 切换越多)
+// 目标地址轮流使用127.0.0.1~127.0.0.4; 服务端先关闭, TIME_WAIT留在服务端, 不会耗尽客户端的临时端口
+#include <stdio.h>
+#include <stdlib.h> // atoi() atof()
+#include <string.h> // strcmp() memset()
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/resource.h> // getrusage()
+#include <sys/time.h>     // timeval
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../net/TcpServer.h"
+#include "../net/EventLoop.h"
+
+using namespace zfwmuduo;
+
+static const uint16_t kPort = 9996;
+static std::atomic_bool g_stop(false);
+static std::atomic<int64_t> g_sessions(0);
+
+static double cpuSeconds(long *switches)
+{
+  struct rusage usage;
+  ::getrusage(RUSAGE_SELF, &usage);
+  *switches = usage.ru_nvcsw + usage.ru_nivcsw;
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+static void runClient(int id)
+{
+  static const char kRequest[] = "GET / HTTP/1.0\r\n\r\n";
+  char buf[256];
+  for (int i = id; !g_stop; ++i)
+  {
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = htonl(0x7f000001 + i % 4);
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct timeval tv = {1, 0}; // 结束时还在accept队列里的连接等不到响应
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+    if (::connect(fd, (sockaddr *)&addr, sizeof addr) == 0 &&
+        ::write(fd, kRequest, sizeof kRequest - 1) == sizeof kRequest - 1)
+    {
+      size_t received = 0;
+      ssize_t n;
+      while ((n = ::read(fd, buf, sizeof buf)) > 0)
+        received += n;
+      if (n == 0 && received > 0)
+        ++g_sessions;
+    }
+    ::close(fd);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  int loops = argc > 1 ? atoi(argv[1]) : 16;
+  int clients = argc > 2 ? atoi(argv[2]) : 32;
+  double seconds = argc > 3 ? atof(argv[3]) : 3.0;
+  bool perLoop = argc > 4 && strcmp(argv[4], "perloop") == 0;
+
+  EventLoop loop;
+  TcpServer server(&loop, "churn", InetAddress(kPort, "0.0.0.0"),
+                   perLoop ? TcpServer::kReusePortPerLoop : TcpServer::kNoReusePort);
+  server.setThreadNum(loops);
+  server.setConnectionCallback([](const TcpConnectionPtr &) {});
+  server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+                            {
+                              static const char kResponse[] = "HTTP/1.0 200 OK\r\nContent-Length: 2\r\n\r\nok";
+                              buf->retrieveAll();
+                              conn->send(kResponse, sizeof kResponse - 1);
+                              conn->shutdown(); });
+  server.start();
+
+  std::vector<std::thread> threads;
+  long switchesBegin = 0;
+  double cpuBegin = cpuSeconds(&switchesBegin);
+  for (int i = 0; i < clients; ++i)
+    threads.push_back(std::thread(runClient, i));
+
+  int64_t sessions = 0;
+  double cpu = 0;
+  long switches = 0;
+  loop.runAfter(seconds, [&]()
+                {
+                  g_stop = true;
+                  sessions = g_sessions;
+                  cpu = cpuSeconds(&switches) - cpuBegin;
+                  switches -= switchesBegin;
+                  server.stop(1.0, [&loop]()
+                              { loop.quit(); }); });
+  loop.loop();
+  for (size_t i = 0; i < threads.size(); ++i)
+    threads[i].join();
+
+  printf("%-8s loops=%d clients=%d: %.0f connections/s, per connection %.1fus cpu, %.2f context switches (client included)\n",
+         perLoop ? "perloop" : "acceptor", loops, clients, sessions / seconds,
+         sessions > 0 ? cpu * 1e6 / sessions : 0.0, sessions > 0 ? static_cast<double>(switches) / sessions : 0.0);
+  return 0;
+}
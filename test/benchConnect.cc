@@ -0,0 +1,133 @@
+// 建连吞吐量: 向本机的服务端建立total个连接(连上即关闭), 同时进行中的连接不超过concurrency个
+// 用法: ./benchConnect client|blocking [total] [concurrency]
+// client:   一个loop中的TcpClient, 非阻塞connect
+// blocking: concurrency个线程, 每个线程循环阻塞connect/close(以前的做法)
+// 目标地址轮流使用127.0.0.1~127.0.0.4, 连接关闭后的TIME_WAIT不会耗尽同一个目标的临时端口
+#include <stdio.h>
+#include <stdlib.h> // atoi()
+#include <string.h> // strcmp()
+#include <time.h>   // clock_gettime()
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../net/TcpServer.h"
+#include "../net/TcpClient.h"
+
+static const uint16_t kPort = 9991;
+static const int kTargets = 4;
+
+static double now()
+{
+  struct timespec ts;
+  ::clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static std::string targetIp(int i)
+{
+  return "127.0.0." + std::to_string(1 + i % kTargets);
+}
+
+static void runBlocking(int total, int threads, std::atomic_int *established)
+{
+  std::atomic_int next(0);
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t)
+  {
+    workers.push_back(std::thread([&]()
+                                  {
+                                    for (int i = next++; i < total; i = next++)
+                                    {
+                                      int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+                                      sockaddr_in addr;
+                                      memset(&addr, 0, sizeof addr);
+                                      addr.sin_family = AF_INET;
+                                      addr.sin_port = htons(kPort);
+                                      addr.sin_addr.s_addr = inet_addr(targetIp(i).c_str());
+                                      if (::connect(fd, (sockaddr *)&addr, sizeof addr) == 0)
+                                        ++*established;
+                                      ::close(fd);
+                                    } }));
+  }
+  for (size_t t = 0; t < workers.size(); ++t)
+    workers[t].join();
+}
+
+static void runClients(int total, int concurrency, std::atomic_int *established, int *retries)
+{
+  zfwmuduo::EventLoop loop;
+  std::vector<std::unique_ptr<zfwmuduo::TcpClient>> clients;
+  clients.reserve(total);
+  int launched = 0;
+
+  std::function<void()> launch = [&]()
+  {
+    int i = launched++;
+    zfwmuduo::TcpClient *client = new zfwmuduo::TcpClient(&loop, zfwmuduo::InetAddress(kPort, targetIp(i)), "client");
+    clients.push_back(std::unique_ptr<zfwmuduo::TcpClient>(client));
+    client->setRetryDelay(0.01, 1.0);
+    client->setConnectionCallback([&](const zfwmuduo::TcpConnectionPtr &conn)
+                                  {
+                                    if (!conn->connected())
+                                      return;
+                                    conn->forceClose();
+                                    if (++*established == total)
+                                      loop.quit();
+                                    else if (launched < total)
+                                      launch(); });
+    client->setMessageCallback([](const zfwmuduo::TcpConnectionPtr &, zfwmuduo::Buffer *buf, zfwmuduo::Timestamp)
+                               { buf->retrieveAll(); });
+    client->connect();
+  };
+  for (int i = 0; i < concurrency && i < total; ++i)
+    launch();
+  loop.loop();
+
+  *retries = 0;
+  for (size_t i = 0; i < clients.size(); ++i)
+    *retries += clients[i]->connectRetries();
+  clients.clear(); // loop已经停止, 可以在这里析构
+}
+
+int main(int argc, char *argv[])
+{
+  const char *mode = argc > 1 ? argv[1] : "client";
+  int total = argc > 2 ? atoi(argv[2]) : 50000;
+  int concurrency = argc > 3 ? atoi(argv[3]) : 256;
+
+  // 服务端在单独的线程中, 只accept, 客户端关闭后随之关闭
+  std::promise<zfwmuduo::EventLoop *> serverLoopReady;
+  std::thread serverThread([&]()
+                           {
+                             zfwmuduo::EventLoop loop;
+                             zfwmuduo::TcpServer server(&loop, "sink", zfwmuduo::InetAddress(kPort, "0.0.0.0"));
+                             server.setConnectionCallback([](const zfwmuduo::TcpConnectionPtr &) {});
+                             server.setMessageCallback([](const zfwmuduo::TcpConnectionPtr &, zfwmuduo::Buffer *buf, zfwmuduo::Timestamp)
+                                                       { buf->retrieveAll(); });
+                             server.start();
+                             serverLoopReady.set_value(&loop);
+                             loop.loop(); });
+  zfwmuduo::EventLoop *serverLoop = serverLoopReady.get_future().get();
+
+  std::atomic_int established(0);
+  int retries = 0;
+  double begin = now();
+  if (strcmp(mode, "blocking") == 0)
+    runBlocking(total, concurrency, &established);
+  else
+    runClients(total, concurrency, &established, &retries);
+  double elapsed = now() - begin;
+
+  serverLoop->quit();
+  serverThread.join();
+  printf("%-8s total=%d concurrency=%d: established=%d retries=%d in %.2fs, %.0f connects/s\n",
+         mode, total, concurrency, established.load(), retries, elapsed, established / elapsed);
+  return 0;
+}
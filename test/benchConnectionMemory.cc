@@ -0,0 +1,99 @@
+// 每个连接的堆内存和mainloop上的accept路径耗时: 客户端一次性建立total个空闲连接
+// 用法: ./benchConnectionMemory [total] [threads]
+// 堆内存: 全部连接建立前后mallinfo2().uordblks之差 / total (客户端只用裸socket, 不占堆)
+// accept路径: 这段时间mainloop线程消耗的CPU时间 / total, 包括accept、创建TcpConnection和投递给subloop(还有日志)
+#include <stdio.h>
+#include <stdlib.h> // atoi()
+#include <string.h> // memset()
+#include <malloc.h> // mallinfo2()
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/resource.h> // getrusage()
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "../net/TcpServer.h"
+#include "../net/EventLoop.h"
+
+using namespace zfwmuduo;
+
+static const uint16_t kPort = 9997;
+
+static int64_t threadCpuNanos()
+{
+  struct rusage usage;
+  ::getrusage(RUSAGE_THREAD, &usage);
+  return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000LL +
+         (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000LL;
+}
+
+int main(int argc, char *argv[])
+{
+  int total = argc > 1 ? atoi(argv[1]) : 8000;
+  int threads = argc > 2 ? atoi(argv[2]) : 2;
+
+  EventLoop loop;
+  TcpServer server(&loop, "memory", InetAddress(kPort, "0.0.0.0"));
+  server.setThreadNum(threads);
+  server.setConnectionCallback([](const TcpConnectionPtr &) {});
+  server.setMessageCallback([](const TcpConnectionPtr &, Buffer *buf, Timestamp)
+                            { buf->retrieveAll(); });
+  server.start();
+
+  std::vector<int> fds;
+  fds.reserve(total);
+  std::atomic_bool go(false);
+  std::thread client([&]()
+                     {
+                       while (!go)
+                         ::usleep(1000);
+                       for (int i = 0; i < total; ++i)
+                       {
+                         sockaddr_in addr;
+                         memset(&addr, 0, sizeof addr);
+                         addr.sin_family = AF_INET;
+                         addr.sin_port = htons(kPort);
+                         addr.sin_addr.s_addr = htonl(0x7f000001 + i % 4);
+                         int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+                         if (::connect(fd, (sockaddr *)&addr, sizeof addr) < 0)
+                         {
+                           perror("connect");
+                           ::close(fd);
+                           break;
+                         }
+                         fds.push_back(fd);
+                       } });
+
+  size_t heapBefore = 0, heapAfter = 0;
+  int64_t cpuBefore = 0, cpuAfter = 0;
+  Timestamp begin, end;
+  bool measured = false;
+  loop.runAfter(0.1, [&]()
+                {
+                  heapBefore = ::mallinfo2().uordblks;
+                  cpuBefore = threadCpuNanos();
+                  begin = Timestamp::now();
+                  go = true; });
+  loop.runEvery(0.005, [&]()
+                {
+                  if (measured || server.connectionCount() < static_cast<size_t>(total))
+                    return;
+                  measured = true;
+                  cpuAfter = threadCpuNanos();
+                  end = Timestamp::now();
+                  heapAfter = ::mallinfo2().uordblks;
+                  server.stop(1.0, [&loop]()
+                              { loop.quit(); }); });
+  loop.loop();
+  client.join();
+  for (int fd : fds)
+    ::close(fd);
+
+  double seconds = (end.microSecondsSinceEpoch() - begin.microSecondsSinceEpoch()) / 1e6;
+  printf("connections=%d threads=%d: sizeof(TcpConnection)=%zu, heap %.0f bytes/connection, accept path %.0f ns/connection (mainloop cpu), %.0f connections/s\n",
+         total, threads, sizeof(TcpConnection), static_cast<double>(heapAfter - heapBefore) / total,
+         static_cast<double>(cpuAfter - cpuBefore) / total, total / seconds);
+  return 0;
+}
@@ -0,0 +1,173 @@
+// 出站连接池: 前端的每个loop上同时有chains个请求链, 每个请求向后端发一行并等待一行响应, 收到后立刻发下一个
+// 用法: ./benchConnectionPool pooled|percall [threads] [chains] [seconds]
+// pooled:  ConnectionPool, 在当前loop的子池中借出连接, 响应到了之后归还
+// percall: 每个请求新建一个TcpClient, 连上后发送, 收到响应后关闭(目标地址轮流使用127.0.0.1~127.0.0.4, 避免TIME_WAIT耗尽端口)
+// 后端在单独的线程中, 对每一行请求回复"ok\n"
+#include <stdio.h>
+#include <stdlib.h> // atoi()
+#include <string.h> // strcmp() memchr()
+#include <unistd.h> // usleep()
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "../net/TcpServer.h"
+#include "../net/TcpClient.h"
+#include "../net/ConnectionPool.h"
+#include "../net/EventLoopThreadPool.h"
+
+using namespace zfwmuduo;
+
+static const uint16_t kPort = 9992;
+static std::atomic<int64_t> g_requests(0);
+static std::atomic_bool g_stop(false);
+
+// pooled模式: 每个loop上等待响应的连接 -> 响应到达后的处理
+static thread_local std::unordered_map<TcpConnection *, std::function<void(const TcpConnectionPtr &)>> t_pending;
+
+static size_t takeLines(Buffer *buf)
+{
+  size_t lines = 0;
+  while (true)
+  {
+    const char *eol = static_cast<const char *>(memchr(buf->peek(), '\n', buf->readableBytes()));
+    if (!eol)
+      break;
+    buf->retrieve(eol - buf->peek() + 1);
+    ++lines;
+  }
+  return lines;
+}
+
+static void pooledRequest(ConnectionPool *pool, EventLoop *loop)
+{
+  if (g_stop)
+    return;
+  pool->acquire(loop, [pool, loop](const TcpConnectionPtr &conn)
+                {
+                  t_pending[conn.get()] = [pool, loop](const TcpConnectionPtr &c)
+                  {
+                    ++g_requests;
+                    pool->release(c);
+                    pooledRequest(pool, loop);
+                  };
+                  conn->send("req\n", 4); });
+}
+
+static void perCallRequest(EventLoop *loop, int seq)
+{
+  if (g_stop)
+    return;
+  InetAddress addr(kPort, "127.0.0." + std::to_string(1 + seq % 4));
+  TcpClient *client = new TcpClient(loop, addr, "percall");
+  client->setConnectionCallback([client, loop](const TcpConnectionPtr &conn)
+                                {
+                                  if (conn->connected())
+                                  {
+                                    conn->send("req\n", 4);
+                                  }
+                                  else
+                                  { // NOTE: 之后还要回调TcpClient::removeConnection, 推迟析构
+                                    loop->queueInLoop([client]()
+                                                      { delete client; });
+                                  } });
+  client->setMessageCallback([loop, seq](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+                             {
+                               if (takeLines(buf) > 0)
+                               {
+                                 ++g_requests;
+                                 conn->forceClose();
+                                 perCallRequest(loop, seq + 1);
+                               } });
+  client->connect();
+}
+
+int main(int argc, char *argv[])
+{
+  const char *mode = argc > 1 ? argv[1] : "pooled";
+  int threads = argc > 2 ? atoi(argv[2]) : 2;
+  int chains = argc > 3 ? atoi(argv[3]) : 16;
+  double seconds = argc > 4 ? atof(argv[4]) : 3.0;
+  bool pooled = strcmp(mode, "percall") != 0;
+
+  std::promise<EventLoop *> backendReady;
+  std::thread backend([&]()
+                      {
+                        EventLoop loop;
+                        TcpServer server(&loop, "backend", InetAddress(kPort, "0.0.0.0"));
+                        server.setConnectionCallback([](const TcpConnectionPtr &) {});
+                        server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+                                                  {
+                                                    for (size_t n = takeLines(buf); n > 0; --n)
+                                                      conn->send("ok\n", 3); });
+                        server.start();
+                        backendReady.set_value(&loop);
+                        loop.loop(); });
+  EventLoop *backendLoop = backendReady.get_future().get();
+
+  EventLoop baseLoop;
+  EventLoopThreadPool front(&baseLoop, "front");
+  front.setThreadNum(threads);
+  front.start();
+
+  std::unique_ptr<ConnectionPool> pool;
+  if (pooled)
+  {
+    pool.reset(new ConnectionPool(&front, InetAddress(kPort), "pool"));
+    pool->setPoolSize(chains, chains);
+    pool->setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+                             {
+                               for (size_t n = takeLines(buf); n > 0; --n)
+                               {
+                                 auto it = t_pending.find(conn.get());
+                                 if (it == t_pending.end())
+                                   continue;
+                                 std::function<void(const TcpConnectionPtr &)> done = std::move(it->second);
+                                 t_pending.erase(it);
+                                 done(conn);
+                               } });
+    pool->start();
+  }
+
+  std::vector<EventLoop *> loops = front.getAllLoops();
+  for (size_t i = 0; i < loops.size(); ++i)
+  {
+    EventLoop *loop = loops[i];
+    ConnectionPool *rawPool = pool.get();
+    loop->runInLoop([loop, rawPool, chains, i]()
+                    {
+                      for (int c = 0; c < chains; ++c)
+                      {
+                        if (rawPool)
+                          pooledRequest(rawPool, loop);
+                        else
+                          perCallRequest(loop, static_cast<int>(i * chains + c));
+                      } });
+  }
+
+  baseLoop.runAfter(seconds, [&]()
+                    {
+                      g_stop = true;
+                      baseLoop.quit(); });
+  baseLoop.loop();
+  int64_t requests = g_requests;
+
+  ::usleep(200 * 1000); // 等还在进行中的请求结束
+  printf("%-7s threads=%d chains=%d: %.0f requests/s", mode, threads, chains, requests / seconds);
+  if (pool)
+  {
+    ConnectionPool::Stats stats = pool->stats();
+    printf(", connects=%llu acquires=%llu waits=%llu", static_cast<unsigned long long>(stats.connects),
+           static_cast<unsigned long long>(stats.acquires), static_cast<unsigned long long>(stats.waits));
+  }
+  printf("\n");
+  pool.reset(); // 子池在各自的loop线程中销毁, loop还要在运行
+  backendLoop->quit();
+  backend.join();
+  return 0;
+}
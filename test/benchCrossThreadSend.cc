@@ -0,0 +1,144 @@
+// 工作线程发送: 非loop线程对同一个连接连续发送4KiB的消息, 统计每条消息的内存分配次数
+// 用法: ./benchCrossThreadSend lambda|copy|move|buffer|raw [messages] [messageSize]
+// lambda: 以前的做法, 为了不悬空自己把string拷贝进lambda, 再在loop里send
+// copy:   send(const std::string&)
+// move:   send(std::string&&)
+// buffer: send(Buffer*), 交换存储
+// raw:    send(const void*, size_t)
+// 分配次数 = operator new的次数 + BufferPool向系统malloc的次数(两个线程合计)
+#include <stdio.h>
+#include <stdlib.h> // atoi() malloc()
+#include <string.h> // strcmp()
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../net/TcpServer.h"
+#include "../net/EventLoop.h"
+#include "../net/BufferPool.h"
+
+static std::atomic<uint64_t> g_news(0);
+
+void *operator new(size_t size)
+{
+  g_news.fetch_add(1, std::memory_order_relaxed);
+  void *p = ::malloc(size ? size : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+void operator delete(void *p) noexcept { ::free(p); }
+
+static const uint16_t kPort = 9988;
+
+int main(int argc, char *argv[])
+{
+  const char *mode = argc > 1 ? argv[1] : "move";
+  int messages = argc > 2 ? atoi(argv[2]) : 200000;
+  size_t messageSize = argc > 3 ? atoi(argv[3]) : 4096;
+
+  zfwmuduo::EventLoop loop;
+  zfwmuduo::TcpServer server(&loop, "xthread", zfwmuduo::InetAddress(kPort));
+  server.setThreadNum(1);
+  std::mutex mutex;
+  std::condition_variable cond;
+  zfwmuduo::TcpConnectionPtr connection;
+  server.setConnectionCallback([&](const zfwmuduo::TcpConnectionPtr &conn)
+                               {
+                                 std::lock_guard<std::mutex> lock(mutex);
+                                 connection = conn->connected() ? conn : zfwmuduo::TcpConnectionPtr();
+                                 cond.notify_one(); });
+  server.setMessageCallback([](const zfwmuduo::TcpConnectionPtr &, zfwmuduo::Buffer *buf, zfwmuduo::Timestamp)
+                            { buf->retrieveAll(); });
+  server.start();
+
+  size_t total = static_cast<size_t>(messages) * messageSize;
+  std::thread reader([&]()
+                     { // 客户端: 把所有消息读完
+                       int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+                       sockaddr_in addr;
+                       memset(&addr, 0, sizeof addr);
+                       addr.sin_family = AF_INET;
+                       addr.sin_port = htons(kPort);
+                       addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+                       if (::connect(fd, (sockaddr *)&addr, sizeof addr) < 0)
+                       {
+                         perror("connect");
+                         loop.quit();
+                         return;
+                       }
+                       std::vector<char> buf(256 * 1024);
+                       size_t received = 0;
+                       while (received < total)
+                       {
+                         ssize_t n = ::read(fd, &buf[0], buf.size());
+                         if (n <= 0)
+                           break;
+                         received += n;
+                       }
+                       ::close(fd);
+                       loop.quit(); });
+
+  double seconds = 0;
+  uint64_t newsBefore = 0, mallocsBefore = 0;
+  std::thread worker([&]()
+                     {
+                       zfwmuduo::TcpConnectionPtr conn;
+                       {
+                         std::unique_lock<std::mutex> lock(mutex);
+                         while (!connection)
+                           cond.wait(lock);
+                         conn = connection;
+                       }
+                       std::string payload(messageSize, 'w');
+                       zfwmuduo::Buffer buffer;
+                       newsBefore = g_news.load();
+                       mallocsBefore = zfwmuduo::BufferPool::stats().systemAllocs;
+                       std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+                       for (int i = 0; i < messages; ++i)
+                       {
+                         if (strcmp(mode, "lambda") == 0)
+                         {
+                           std::string message(payload);
+                           conn->getLoop()->runInLoop([conn, message]()
+                                                      { conn->send(message); });
+                         }
+                         else if (strcmp(mode, "copy") == 0)
+                         {
+                           std::string message(payload);
+                           conn->send(message);
+                         }
+                         else if (strcmp(mode, "move") == 0)
+                         {
+                           std::string message(payload);
+                           conn->send(std::move(message));
+                         }
+                         else if (strcmp(mode, "buffer") == 0)
+                         {
+                           buffer.append(payload.data(), payload.size());
+                           conn->send(&buffer);
+                         }
+                         else
+                         {
+                           conn->send(payload.data(), payload.size());
+                         }
+                       }
+                       seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count(); });
+
+  loop.loop(); // 客户端读完所有消息后退出, 这时loop线程已经处理完了所有的发送
+  worker.join();
+  reader.join();
+  uint64_t allocations = g_news.load() - newsBefore + zfwmuduo::BufferPool::stats().systemAllocs - mallocsBefore;
+
+  printf("%-6s messages=%d size=%zu: %.2f allocations/message, %.0f messages/s (worker)\n",
+         mode, messages, messageSize, static_cast<double>(allocations) / messages, messages / seconds);
+  return 0;
+}
@@ -0,0 +1,159 @@
+// 负载下反复重启服务端, 统计客户端收到的被截断的响应
+// 用法: ./benchGracefulRestart stop|destroy [rounds] [clients] [responseKB]
+// stop:    TcpServer::stop(deadline): 关闭监听, 每个连接把已经生成的响应发完后半关闭, 全部关闭后再析构
+// destroy: 以前的做法, 直接quit并析构TcpServer, 发送缓冲区里的数据随连接一起丢掉
+// 每轮服务端运行200ms; 客户端每个线程一个连接, 发"get\n", 读一个带4字节长度头的响应;
+// 在两个响应之间被关闭属于正常情况(重连后重发), 读到一半被关闭才算截断
+#include <stdio.h>
+#include <stdlib.h> // atoi()
+#include <string.h> // strcmp() memset()
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/time.h> // timeval
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../net/TcpServer.h"
+#include "../net/EventLoop.h"
+
+using namespace zfwmuduo;
+
+static const uint16_t kPort = 9994;
+static std::atomic_bool g_stop(false);
+static std::atomic<uint64_t> g_responses(0);
+static std::atomic<uint64_t> g_retries(0);
+static std::atomic<uint64_t> g_truncated(0);
+
+static int connectServer()
+{
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(kPort);
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  if (::connect(fd, (sockaddr *)&addr, sizeof addr) < 0)
+  {
+    ::close(fd);
+    return -1;
+  }
+  struct timeval tv = {2, 0}; // 服务端异常时不要一直卡住
+  ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+  return fd;
+}
+
+// 读满len字节; 返回实际读到的字节数, 对端关闭或出错时少于len
+static size_t readFully(int fd, char *buf, size_t len)
+{
+  size_t got = 0;
+  while (got < len)
+  {
+    ssize_t n = ::read(fd, buf + got, len - got);
+    if (n > 0)
+      got += n;
+    else if (n < 0 && errno == EINTR)
+      continue;
+    else
+      break;
+  }
+  return got;
+}
+
+static void client()
+{
+  std::vector<char> body;
+  int fd = -1;
+  while (!g_stop)
+  {
+    if (fd < 0)
+    {
+      fd = connectServer();
+      if (fd < 0)
+      { // 两轮之间没有服务端在监听
+        ::usleep(1000);
+        continue;
+      }
+    }
+
+    bool ok = ::send(fd, "get\n", 4, MSG_NOSIGNAL) == 4;
+    uint32_t header = 0;
+    size_t got = ok ? readFully(fd, reinterpret_cast<char *>(&header), sizeof header) : 0;
+    if (got == 0)
+    { // 在两个响应之间被关闭, 重连后重发
+      ++g_retries;
+      ::close(fd);
+      fd = -1;
+      continue;
+    }
+    size_t len = ntohl(header);
+    body.resize(len);
+    if (got < sizeof header || readFully(fd, &body[0], len) < len)
+    {
+      ++g_truncated;
+      ::close(fd);
+      fd = -1;
+      continue;
+    }
+    ++g_responses;
+  }
+  if (fd >= 0)
+    ::close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+  const char *mode = argc > 1 ? argv[1] : "stop";
+  int rounds = argc > 2 ? atoi(argv[2]) : 20;
+  int clients = argc > 3 ? atoi(argv[3]) : 8;
+  size_t responseSize = (argc > 4 ? atoi(argv[4]) : 8192) * 1024;
+  bool graceful = strcmp(mode, "destroy") != 0;
+
+  std::string response(4 + responseSize, 'x');
+  uint32_t header = htonl(static_cast<uint32_t>(responseSize));
+  memcpy(&response[0], &header, sizeof header);
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < clients; ++i)
+    threads.push_back(std::thread(client));
+
+  for (int round = 0; round < rounds; ++round)
+  {
+    EventLoop loop;
+    TcpServer *server = new TcpServer(&loop, "restart", InetAddress(kPort));
+    server->setThreadNum(2);
+    server->setConnectionCallback([](const TcpConnectionPtr &) {});
+    server->setMessageCallback([&response](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+                               {
+                                 while (true)
+                                 {
+                                   const char *eol = static_cast<const char *>(memchr(buf->peek(), '\n', buf->readableBytes()));
+                                   if (!eol)
+                                     break;
+                                   buf->retrieve(eol - buf->peek() + 1);
+                                   conn->send(response);
+                                 } });
+    server->start();
+    loop.runAfter(0.2, [&]()
+                  {
+                    if (graceful)
+                      server->stop(1.0, [&loop]()
+                                   { loop.quit(); });
+                    else
+                      loop.quit(); });
+    loop.loop();
+    delete server;
+  }
+
+  g_stop = true;
+  for (size_t i = 0; i < threads.size(); ++i)
+    threads[i].join();
+
+  printf("%-7s rounds=%d clients=%d response=%zuKB: responses=%llu retries=%llu truncated=%llu\n",
+         mode, rounds, clients, responseSize / 1024, static_cast<unsigned long long>(g_responses.load()),
+         static_cast<unsigned long long>(g_retries.load()), static_cast<unsigned long long>(g_truncated.load()));
+  return 0;
+}
@@ -0,0 +1,104 @@
+// 空闲连接的内存占用: 建立N个连接, 每个连接收发一条小消息后一直空闲, 统计每个连接占用的缓冲区和RSS, 并外推到100万连接
+// 用法: ./benchIdleConnections [connections]
+// 同一进程里客户端和服务端各占一个fd, connections受ulimit -n限制(约为它的一半)
+#include <stdio.h>
+#include <stdlib.h> // atoi()
+#include <string.h> // strncmp()
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../net/TcpServer.h"
+
+static const uint16_t kPort = 9986;
+
+static long readStatusKb(const char *key)
+{
+  FILE *fp = ::fopen("/proc/self/status", "r");
+  if (!fp)
+    return -1;
+  char line[256];
+  long value = -1;
+  size_t keyLen = strlen(key);
+  while (::fgets(line, sizeof line, fp))
+  {
+    if (strncmp(line, key, keyLen) == 0)
+    {
+      value = atol(line + keyLen + 1);
+      break;
+    }
+  }
+  ::fclose(fp);
+  return value;
+}
+
+static int connectOne()
+{
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(kPort);
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  if (::connect(fd, (sockaddr *)&addr, sizeof addr) < 0)
+  {
+    perror("connect");
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int main(int argc, char *argv[])
+{
+  int connections = argc > 1 ? atoi(argv[1]) : 8000;
+
+  zfwmuduo::EventLoop loop;
+  zfwmuduo::TcpServer server(&loop, "idle", zfwmuduo::InetAddress(kPort));
+  std::atomic_int messages(0);
+  server.setConnectionCallback([](const zfwmuduo::TcpConnectionPtr &) {});
+  server.setMessageCallback([&messages](const zfwmuduo::TcpConnectionPtr &conn, zfwmuduo::Buffer *buf, zfwmuduo::Timestamp)
+                            { // 订阅请求取走后回一条很短的推送, 之后连接一直空闲
+                              buf->retrieveAll();
+                              conn->send(std::string("subscribed\n"));
+                              ++messages; });
+  server.start();
+
+  long baseline = readStatusKb("VmRSS");
+  std::vector<int> fds;
+  std::thread client([&]()
+                     {
+                       const char request[] = "subscribe topic\n";
+                       char reply[64];
+                       for (int i = 0; i < connections; ++i)
+                       {
+                         int fd = connectOne();
+                         if (fd < 0)
+                           break;
+                         ::write(fd, request, sizeof request - 1);
+                         ::read(fd, reply, sizeof reply);
+                         fds.push_back(fd);
+                       }
+                       while (messages < static_cast<int>(fds.size()))
+                         ::usleep(10 * 1000);
+                       ::usleep(200 * 1000);
+                       loop.quit(); });
+  loop.loop();
+  client.join();
+
+  long rss = readStatusKb("VmRSS");
+  size_t n = fds.size();
+  double buffersPerConn = n ? static_cast<double>(server.bufferMemory()) / n : 0;
+  double rssPerConn = n ? (rss - baseline) * 1024.0 / n : 0;
+  printf("connections=%zu buffers=%.0fB/conn VmRSS delta=%.0fB/conn -> 1M idle connections: buffers=%.0fMB RSS=%.0fMB\n",
+         n, buffersPerConn, rssPerConn, buffersPerConn * 1e6 / (1 << 20), rssPerConn * 1e6 / (1 << 20));
+  for (size_t i = 0; i < fds.size(); ++i)
+  {
+    ::close(fds[i]);
+  }
+  return 0;
+}
@@ -0,0 +1,117 @@
+// 大响应发送基准测试: 比较连续Buffer和分段BufferChain发送1MB响应时的拷贝量
+// 用法: ./benchLargeResponse [responses] [responseBytes]
+// 模拟TcpConnection::sendInLoop: 先直接write, 写不完的部分进入发送缓冲区, 再等待可写时发送
+// 对端用一个线程读socketpair的另一端
+#include <stdio.h>
+#include <stdlib.h> // atoi()
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h> // FIONBIO
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "../net/Buffer.h"
+#include "../net/BufferChain.h"
+
+static void drainPeer(int fd)
+{
+  char buf[65536];
+  while (::read(fd, buf, sizeof buf) > 0)
+  {
+  }
+}
+
+static void waitWritable(int fd)
+{
+  struct pollfd pfd = {fd, POLLOUT, 0};
+  ::poll(&pfd, 1, -1);
+}
+
+// 发送缓冲区积压超过一个响应时才等待, 让后续响应在有积压的情况下追加
+template <typename Output, typename Append>
+static void run(const char *mode, Output &output, Append append, int responses, size_t bytes)
+{
+  int fds[2];
+  ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds);
+  int sndbuf = 64 * 1024;
+  ::setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof sndbuf);
+  int flags = 0;
+  ::ioctl(fds[1], FIONBIO, &flags);
+  std::thread peer(drainPeer, fds[1]);
+
+  std::shared_ptr<std::string> response = std::make_shared<std::string>(bytes, 'x');
+  std::shared_ptr<const char> block(response, response->data());
+
+  size_t copied = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int i = 0; i < responses; ++i)
+  {
+    ssize_t n = 0;
+    if (output.readableBytes() == 0)
+    {
+      n = ::write(fds[0], block.get(), bytes);
+      if (n < 0)
+        n = 0;
+    }
+    copied += append(output, block, n, bytes - n);
+
+    int savedErrno = 0;
+    while (output.readableBytes() > bytes)
+    {
+      waitWritable(fds[0]);
+      ssize_t m = output.writeFd(fds[0], &savedErrno);
+      if (m > 0)
+        output.retrieve(m);
+    }
+  }
+  int savedErrno = 0;
+  while (output.readableBytes() > 0)
+  {
+    waitWritable(fds[0]);
+    ssize_t m = output.writeFd(fds[0], &savedErrno);
+    if (m > 0)
+      output.retrieve(m);
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  ::close(fds[0]);
+  peer.join();
+  ::close(fds[1]);
+
+  double sent = static_cast<double>(bytes) * responses;
+  printf("%-6s responses=%d size=%zu: %.2f bytes copied per byte sent, %.0f MiB/s\n",
+         mode, responses, bytes, copied / sent, sent / seconds / 1024 / 1024);
+}
+
+int main(int argc, char *argv[])
+{
+  int responses = argc > 1 ? atoi(argv[1]) : 500;
+  size_t bytes = argc > 2 ? atoi(argv[2]) : 1024 * 1024;
+
+  {
+    zfwmuduo::Buffer buffer;
+    run("buffer", buffer, [](zfwmuduo::Buffer &output, const std::shared_ptr<const char> &block, size_t offset, size_t len) -> size_t
+        {
+          // Buffer扩容时vector重新分配或者makeSpace挪动数据, 都要把已有的可读数据再拷贝一遍
+          const char *before = output.peek();
+          size_t readable = output.readableBytes();
+          output.append(block.get() + offset, len);
+          return len + (output.peek() != before ? readable : 0); },
+        responses, bytes);
+  }
+  {
+    zfwmuduo::BufferChain chain;
+    run("chain", chain, [](zfwmuduo::BufferChain &output, const std::shared_ptr<const char> &block, size_t offset, size_t len) -> size_t
+        {
+          size_t before = output.bytesCopied();
+          output.append(std::shared_ptr<const char>(block, block.get() + offset), len);
+          return output.bytesCopied() - before; },
+        responses, bytes);
+  }
+  return 0;
+}
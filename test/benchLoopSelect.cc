@@ -0,0 +1,162 @@
+// subloop选择策略基准测试: 倾斜负载下轻量连接的尾延迟
+// 用法: ./benchLoopSelect rr|leastconn|latency|p2c|hash [threads] [seconds]
+// 1. 先按 重,轻,轻,轻,重,轻... 的顺序建立一批连接, 轮询时所有重连接都落在同一个loop上;
+//    重连接持续发请求, 服务端每个请求空转200us; 这一批轻连接在全部建立之后关闭
+// 2. 再建立一批轻连接持续做pingpong, 统计它们的往返延迟
+#include <stdio.h>
+#include <stdlib.h> // atoi()
+#include <string.h> // strcmp()
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <algorithm> // sort()
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../net/TcpServer.h"
+
+static const uint16_t kPort = 9983;
+static const int kHeavyMicroSeconds = 200;
+
+static std::mutex g_mutex;
+static std::vector<int64_t> g_latencies; // 第二批轻连接每次请求的往返耗时(us)
+
+static int64_t nowMicroSeconds()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static int connectServer()
+{
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(kPort);
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  if (::connect(fd, (sockaddr *)&addr, sizeof addr) < 0)
+  {
+    perror("connect");
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// 发送一个字节的请求并等待一个字节的回显
+static bool request(int fd, char type)
+{
+  return ::write(fd, &type, 1) == 1 && ::read(fd, &type, 1) == 1;
+}
+
+static void runHeavy(int fd, std::atomic_bool *stop)
+{
+  while (!*stop && request(fd, 'H'))
+  {
+  }
+  ::close(fd);
+}
+
+static void runLight(int fd, std::atomic_bool *stop)
+{
+  std::vector<int64_t> latencies;
+  while (!*stop)
+  {
+    int64_t start = nowMicroSeconds();
+    if (!request(fd, 'L'))
+      break;
+    latencies.push_back(nowMicroSeconds() - start);
+    ::usleep(1000);
+  }
+  ::close(fd);
+  std::lock_guard<std::mutex> lock(g_mutex);
+  g_latencies.insert(g_latencies.end(), latencies.begin(), latencies.end());
+}
+
+int main(int argc, char *argv[])
+{
+  const char *policyName = argc > 1 ? argv[1] : "rr";
+  int numThreads = argc > 2 ? atoi(argv[2]) : 4;
+  double seconds = argc > 3 ? atof(argv[3]) : 5.0;
+
+  zfwmuduo::EventLoopThreadPool::SelectPolicy policy = zfwmuduo::EventLoopThreadPool::kRoundRobin;
+  if (strcmp(policyName, "leastconn") == 0)
+    policy = zfwmuduo::EventLoopThreadPool::kLeastConnections;
+  else if (strcmp(policyName, "latency") == 0)
+    policy = zfwmuduo::EventLoopThreadPool::kLeastLatency;
+  else if (strcmp(policyName, "p2c") == 0)
+    policy = zfwmuduo::EventLoopThreadPool::kPowerOfTwoChoices;
+  else if (strcmp(policyName, "hash") == 0)
+    policy = zfwmuduo::EventLoopThreadPool::kPeerHash;
+
+  zfwmuduo::EventLoop loop;
+  zfwmuduo::TcpServer server(&loop, "select", zfwmuduo::InetAddress(kPort));
+  server.setThreadNum(numThreads);
+  server.setLoopSelectPolicy(policy);
+  server.setConnectionCallback([](const zfwmuduo::TcpConnectionPtr &) {});
+  server.setMessageCallback([](const zfwmuduo::TcpConnectionPtr &conn, zfwmuduo::Buffer *buf, zfwmuduo::Timestamp)
+                            {
+                              std::string msg = buf->retrieveAllAsString();
+                              if (msg.find('H') != std::string::npos)
+                              { // 模拟重请求: 在loop线程中空转
+                                int64_t end = nowMicroSeconds() + kHeavyMicroSeconds;
+                                while (nowMicroSeconds() < end)
+                                {
+                                }
+                              }
+                              conn->send(msg); });
+  server.start();
+
+  std::atomic_bool stop(false);
+  std::vector<std::thread> clients;
+  std::thread driver([&]()
+                     {
+                       // 第一批: 重连接长期存在, 轻连接短暂存在
+                       std::vector<int> shortLived;
+                       for (int i = 0; i < numThreads * 4; ++i)
+                       {
+                         int fd = connectServer();
+                         if (fd < 0)
+                           continue;
+                         if (i % numThreads == 0)
+                           clients.push_back(std::thread(runHeavy, fd, &stop));
+                         else
+                           shortLived.push_back(fd);
+                         ::usleep(10 * 1000);
+                       }
+                       for (size_t i = 0; i < shortLived.size(); ++i)
+                         ::close(shortLived[i]);
+                       ::usleep(100 * 1000); // 等短连接全部在服务端析构掉
+
+                       // 第二批: 持续pingpong的轻连接, 统计它们的延迟
+                       for (int i = 0; i < numThreads * 3; ++i)
+                       {
+                         int fd = connectServer();
+                         if (fd >= 0)
+                           clients.push_back(std::thread(runLight, fd, &stop));
+                         ::usleep(10 * 1000);
+                       }
+                       ::usleep(static_cast<useconds_t>(seconds * 1000 * 1000));
+                       stop = true;
+                       loop.quit(); });
+  loop.loop();
+  driver.join();
+  for (size_t i = 0; i < clients.size(); ++i)
+  {
+    clients[i].join();
+  }
+
+  std::sort(g_latencies.begin(), g_latencies.end());
+  size_t n = g_latencies.size();
+  printf("%-9s threads=%d: light requests=%zu p50=%lldus p99=%lldus p999=%lldus\n",
+         policyName, numThreads, n,
+         n ? (long long)g_latencies[n / 2] : 0LL,
+         n ? (long long)g_latencies[n * 99 / 100] : 0LL,
+         n ? (long long)g_latencies[n * 999 / 1000] : 0LL);
+  return 0;
+}
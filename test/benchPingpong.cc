@@ -0,0 +1,91 @@
+// pingpong基准测试: 比较LT和ET两种模式的吞吐量
+// 用法: ./benchPingpong lt|et [sessions] [blockSize] [seconds]
+// 系统调用次数可以用 strace -c -f ./benchPingpong et 统计
+#include <stdio.h>
+#include <stdlib.h> // atoi()
+#include <string.h> // strcmp()
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../net/TcpServer.h"
+
+static const uint16_t kPort = 9981;
+
+// 客户端使用阻塞socket: 发送一块数据, 等待完整的回显, 再发下一块
+static void runClient(int blockSize, std::atomic_bool *stop, std::atomic<int64_t> *totalBytes)
+{
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(kPort);
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  if (::connect(fd, (sockaddr *)&addr, sizeof addr) < 0)
+  {
+    perror("connect");
+    return;
+  }
+
+  std::string block(blockSize, 'x');
+  std::vector<char> echo(blockSize);
+  while (!*stop)
+  {
+    if (::write(fd, block.data(), block.size()) != blockSize)
+      break;
+    int received = 0;
+    while (received < blockSize)
+    {
+      ssize_t n = ::read(fd, &echo[received], blockSize - received);
+      if (n <= 0)
+        break;
+      received += n;
+    }
+    *totalBytes += received;
+  }
+  ::close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+  bool edgeTriggered = argc > 1 && strcmp(argv[1], "et") == 0;
+  int sessions = argc > 2 ? atoi(argv[2]) : 4;
+  int blockSize = argc > 3 ? atoi(argv[3]) : 16384;
+  double seconds = argc > 4 ? atof(argv[4]) : 5.0;
+
+  zfwmuduo::EventLoop loop;
+  zfwmuduo::TcpServer server(&loop, "pingpong", zfwmuduo::InetAddress(kPort));
+  server.setEdgeTriggered(edgeTriggered);
+  server.setThreadNum(1);
+  server.setConnectionCallback([](const zfwmuduo::TcpConnectionPtr &) {});
+  server.setMessageCallback([](const zfwmuduo::TcpConnectionPtr &conn, zfwmuduo::Buffer *buf, zfwmuduo::Timestamp)
+                            { conn->send(buf->retrieveAllAsString()); });
+  server.start();
+
+  std::atomic_bool stop(false);
+  std::atomic<int64_t> totalBytes(0);
+  std::vector<std::thread> clients;
+  for (int i = 0; i < sessions; ++i)
+  {
+    clients.push_back(std::thread(runClient, blockSize, &stop, &totalBytes));
+  }
+
+  loop.runAfter(seconds, [&]()
+                {
+                  stop = true;
+                  loop.quit(); });
+  loop.loop();
+  for (size_t i = 0; i < clients.size(); ++i)
+  {
+    clients[i].join();
+  }
+
+  printf("%s sessions=%d block=%d: %.2f MiB/s\n",
+         edgeTriggered ? "ET" : "LT", sessions, blockSize,
+         static_cast<double>(totalBytes) / seconds / 1024 / 1024);
+  return 0;
+}
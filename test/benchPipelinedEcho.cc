@@ -0,0 +1,149 @@
+// 流水线echo: 客户端一次写depth个请求(每行一个), 服务端对每个请求先发一个头再发请求本身, 统计每个请求的写系统调用次数
+// 用法: ./benchPipelinedEcho plain|sendv|cork [connections] [depth] [seconds]
+// plain: 每个请求send两次(头 + 体)
+// sendv: 每个请求sendv一次(头和体两个片段)
+// cork:  和plain一样send两次, 但开启自动cork, 一轮循环里所有的响应合并成一次写
+// 写系统调用次数: 本程序替换了write/writev, 按线程计数, 只统计服务端loop线程(日志走stdio, 不计入)
+#include <dlfcn.h> // dlsym()
+#include <stdio.h>
+#include <stdlib.h> // atoi()
+#include <string.h> // strcmp()
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/time.h> // struct timeval
+#include <sys/uio.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../net/TcpServer.h"
+
+static const uint16_t kPort = 9989;
+
+static thread_local long t_writes = 0;
+
+extern "C" ssize_t write(int fd, const void *buf, size_t count)
+{
+  typedef ssize_t (*WriteFunc)(int, const void *, size_t);
+  static WriteFunc real = reinterpret_cast<WriteFunc>(::dlsym(RTLD_NEXT, "write"));
+  ++t_writes;
+  return real(fd, buf, count);
+}
+
+extern "C" ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
+{
+  typedef ssize_t (*WritevFunc)(int, const struct iovec *, int);
+  static WritevFunc real = reinterpret_cast<WritevFunc>(::dlsym(RTLD_NEXT, "writev"));
+  ++t_writes;
+  return real(fd, iov, iovcnt);
+}
+
+static void runClient(int depth, std::atomic_bool *stop)
+{
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(kPort);
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  if (::connect(fd, (sockaddr *)&addr, sizeof addr) < 0)
+  {
+    perror("connect");
+    return;
+  }
+  struct timeval timeout = {1, 0}; // 服务端loop退出后不再回应, 读超时返回
+  ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+
+  std::string batch;
+  for (int i = 0; i < depth; ++i)
+  {
+    batch += "GET /item/" + std::to_string(i) + "\n";
+  }
+  std::vector<char> buf(64 * 1024);
+  while (!*stop)
+  {
+    if (::write(fd, batch.data(), batch.size()) != static_cast<ssize_t>(batch.size()))
+      break;
+    int responses = 0; // 每个响应两行: 头和体
+    while (responses < 2 * depth)
+    {
+      ssize_t n = ::read(fd, &buf[0], buf.size());
+      if (n <= 0)
+      {
+        ::close(fd);
+        return;
+      }
+      for (ssize_t i = 0; i < n; ++i)
+      {
+        if (buf[i] == '\n')
+          ++responses;
+      }
+    }
+  }
+  ::close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+  const char *mode = argc > 1 ? argv[1] : "plain";
+  int connections = argc > 2 ? atoi(argv[2]) : 4;
+  int depth = argc > 3 ? atoi(argv[3]) : 16;
+  double seconds = argc > 4 ? atof(argv[4]) : 3.0;
+  bool useSendv = strcmp(mode, "sendv") == 0;
+
+  zfwmuduo::EventLoop loop;
+  zfwmuduo::TcpServer server(&loop, "pipeline", zfwmuduo::InetAddress(kPort));
+  server.setAutoCork(strcmp(mode, "cork") == 0);
+  std::atomic<int64_t> requests(0);
+  server.setConnectionCallback([](const zfwmuduo::TcpConnectionPtr &) {});
+  server.setMessageCallback([&](const zfwmuduo::TcpConnectionPtr &conn, zfwmuduo::Buffer *buf, zfwmuduo::Timestamp)
+                            {
+                              while (true)
+                              {
+                                const char *begin = buf->peek();
+                                const char *eol = static_cast<const char *>(memchr(begin, '\n', buf->readableBytes()));
+                                if (!eol)
+                                  break;
+                                size_t len = eol - begin + 1;
+                                char header[32];
+                                int headerLen = snprintf(header, sizeof header, "OK %zu\n", len);
+                                if (useSendv)
+                                {
+                                  struct iovec iov[2] = {{header, static_cast<size_t>(headerLen)}, {const_cast<char *>(begin), len}};
+                                  conn->sendv(iov, 2);
+                                }
+                                else
+                                {
+                                  conn->send(header, headerLen);
+                                  conn->send(begin, len);
+                                }
+                                buf->retrieve(len);
+                                ++requests;
+                              } });
+  server.start();
+
+  std::atomic_bool stop(false);
+  std::vector<std::thread> clients;
+  for (int i = 0; i < connections; ++i)
+  {
+    clients.push_back(std::thread(runClient, depth, &stop));
+  }
+
+  long writesBefore = t_writes;
+  loop.runAfter(seconds, [&]()
+                {
+                  stop = true;
+                  loop.quit(); });
+  loop.loop();
+  long writes = t_writes - writesBefore;
+  for (size_t i = 0; i < clients.size(); ++i)
+  {
+    clients[i].join();
+  }
+
+  printf("%-5s connections=%d depth=%d: %.0f requests/s, %.3f write syscalls/request\n",
+         mode, connections, depth, requests / seconds, static_cast<double>(writes) / requests);
+  return 0;
+}
@@ -0,0 +1,157 @@
+// 代理吞吐量: 客户端 -> 代理 -> 后端(本程序内的sink), 比较tcpRelayProxy的splice和copy两种模式
+// 用法: ./tcpRelayProxy 9990 127.0.0.1 9991 splice|copy &
+//       ./benchRelay 9990 9991 [megabytes] [connections] [proxyPid]
+// 每个连接发送megabytes/connections的数据, 后端收齐后回一个确认; 给出proxyPid时统计代理进程每GB消耗的CPU时间
+#include <stdio.h>
+#include <stdlib.h> // atoi()
+#include <string.h> // memset()
+#include <time.h>   // clock_gettime()
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+static double processCpuSeconds(int pid)
+{
+  char path[64];
+  snprintf(path, sizeof path, "/proc/%d/stat", pid);
+  FILE *fp = ::fopen(path, "r");
+  if (!fp)
+    return 0;
+  char buf[1024];
+  size_t n = ::fread(buf, 1, sizeof buf - 1, fp);
+  ::fclose(fp);
+  buf[n] = '\0';
+  // 第二列是用括号括起来的进程名, 从右括号之后开始数, utime/stime是第14/15列
+  const char *p = strrchr(buf, ')');
+  unsigned long utime = 0, stime = 0;
+  if (p)
+    sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime);
+  return static_cast<double>(utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+static double now()
+{
+  struct timespec ts;
+  ::clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 后端: 每个连接收齐bytesPerConn字节后回一个确认
+static void serveSink(int fd, size_t bytesPerConn, std::atomic<uint64_t> *received)
+{
+  std::vector<char> buf(256 * 1024);
+  size_t total = 0;
+  while (total < bytesPerConn)
+  {
+    ssize_t n = ::read(fd, &buf[0], buf.size());
+    if (n <= 0)
+      break;
+    total += n;
+  }
+  *received += total;
+  ::write(fd, "ok", 2);
+  while (::read(fd, &buf[0], buf.size()) > 0) // 等客户端关闭
+    ;
+  ::close(fd);
+}
+
+static bool runClient(uint16_t proxyPort, size_t bytesPerConn)
+{
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(proxyPort);
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  if (::connect(fd, (sockaddr *)&addr, sizeof addr) < 0)
+  {
+    perror("connect proxy");
+    ::close(fd);
+    return false;
+  }
+  std::string block(256 * 1024, 'r');
+  for (size_t sent = 0; sent < bytesPerConn;)
+  {
+    ssize_t n = ::write(fd, block.data(), std::min(block.size(), bytesPerConn - sent));
+    if (n <= 0)
+      break;
+    sent += n;
+  }
+  char ack[2];
+  bool ok = ::read(fd, ack, sizeof ack) == 2 && memcmp(ack, "ok", 2) == 0;
+  ::close(fd);
+  return ok;
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc < 3)
+  {
+    printf("usage: %s proxyPort sinkPort [megabytes] [connections] [proxyPid]\n", argv[0]);
+    return 1;
+  }
+  uint16_t proxyPort = static_cast<uint16_t>(atoi(argv[1]));
+  uint16_t sinkPort = static_cast<uint16_t>(atoi(argv[2]));
+  size_t megabytes = argc > 3 ? atoi(argv[3]) : 4096;
+  int connections = argc > 4 ? atoi(argv[4]) : 4;
+  int proxyPid = argc > 5 ? atoi(argv[5]) : 0;
+  size_t bytesPerConn = megabytes * 1024 * 1024 / connections;
+
+  int listenFd = ::socket(AF_INET, SOCK_STREAM, 0);
+  int on = 1;
+  ::setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(sinkPort);
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  if (::bind(listenFd, (sockaddr *)&addr, sizeof addr) < 0 || ::listen(listenFd, 128) < 0)
+  {
+    perror("sink listen");
+    return 1;
+  }
+
+  std::atomic<uint64_t> received(0);
+  std::vector<std::thread> sinks;
+  std::thread acceptor([&]()
+                       {
+                         for (int i = 0; i < connections; ++i)
+                         {
+                           int fd = ::accept(listenFd, NULL, NULL);
+                           if (fd < 0)
+                             break;
+                           sinks.push_back(std::thread(serveSink, fd, bytesPerConn, &received));
+                         } });
+
+  double cpuBegin = proxyPid ? processCpuSeconds(proxyPid) : 0;
+  double begin = now();
+  std::atomic_int acked(0);
+  std::vector<std::thread> clients;
+  for (int i = 0; i < connections; ++i)
+  {
+    clients.push_back(std::thread([&]()
+                                  {
+                                    if (runClient(proxyPort, bytesPerConn))
+                                      ++acked; }));
+  }
+  for (size_t i = 0; i < clients.size(); ++i)
+    clients[i].join();
+  double elapsed = now() - begin;
+  double cpu = proxyPid ? processCpuSeconds(proxyPid) - cpuBegin : 0;
+  acceptor.join();
+  for (size_t i = 0; i < sinks.size(); ++i)
+    sinks[i].join();
+  ::close(listenFd);
+
+  double gb = received / (1024.0 * 1024 * 1024);
+  printf("connections=%d received=%.0fMB acked=%d: %.0f MiB/s", connections, received / 1048576.0,
+         acked.load(), received / elapsed / 1048576.0);
+  if (proxyPid)
+    printf(", proxy cpu=%.2fs (%.3f s/GB)", cpu, gb > 0 ? cpu / gb : 0);
+  printf("\n");
+  return acked == connections ? 0 : 1;
+}
@@ -0,0 +1,50 @@
+// 跨线程runInLoop吞吐量的基准测试: 1到32个生产者线程同时向同一个loop投递回调
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "../net/EventLoop.h"
+#include "../net/EventLoopThread.h"
+
+int main()
+{
+  const int kTotal = 2000000; // 每一轮投递的回调总数
+
+  zfwmuduo::EventLoopThread loopThread;
+  zfwmuduo::EventLoop *loop = loopThread.startLoop();
+
+  for (int producers = 1; producers <= 32; producers *= 2)
+  {
+    const int perProducer = kTotal / producers;
+    int64_t executed = 0; // 只在loop线程中访问
+    std::atomic_bool done(false);
+
+    zfwmuduo::Timestamp start(zfwmuduo::Timestamp::now());
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p)
+    {
+      threads.push_back(std::thread([&]() {
+        for (int i = 0; i < perProducer; ++i)
+        {
+          loop->runInLoop([&]() {
+            if (++executed == static_cast<int64_t>(perProducer) * producers)
+              done = true;
+          });
+        }
+      }));
+    }
+    for (size_t i = 0; i < threads.size(); ++i)
+    {
+      threads[i].join();
+    }
+    while (!done)
+    {
+      std::this_thread::yield();
+    }
+    double seconds = zfwmuduo::timeDifference(zfwmuduo::Timestamp::now(), start);
+
+    printf("producers %2d  %8.2f M functors/s\n", producers, executed / seconds / 1e6);
+  }
+  return 0;
+}
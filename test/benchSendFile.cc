@@ -0,0 +1,145 @@
+// 文件发送: 比较sendFile(sendfile(2))和read+send两种方式发送同一个文件时, 服务端loop线程每GB消耗的CPU时间
+// 用法: ./benchSendFile sendfile|read [megabytes] [path]
+// 文件先写好并读一遍, 保证在page cache中; 服务端先send一个头, 再发文件, 再send一个尾, 客户端检查头尾的顺序
+#include <stdio.h>
+#include <stdlib.h> // atoi()
+#include <string.h> // strcmp()
+#include <time.h>   // clock_gettime()
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../net/TcpServer.h"
+
+static const uint16_t kPort = 9987;
+static const std::string kHeader = "HEADER-BEFORE-FILE\n";
+static const std::string kTrailer = "TRAILER-AFTER-FILE\n";
+static const size_t kChunkSize = 256 * 1024; // read+send方式每次读的大小
+
+static double threadCpuSeconds()
+{
+  struct timespec ts;
+  ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void prepareFile(const char *path, size_t size)
+{
+  int fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  std::vector<char> block(1024 * 1024, 'f');
+  for (size_t written = 0; written < size; written += block.size())
+  {
+    ::write(fd, &block[0], std::min(block.size(), size - written));
+  }
+  ::lseek(fd, 0, SEEK_SET);
+  while (::read(fd, &block[0], block.size()) > 0) // 读一遍, 放进page cache
+    ;
+  ::close(fd);
+}
+
+// 读完整个响应, 检查头和尾是否在正确的位置上
+static bool receiveAll(size_t fileSize)
+{
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(kPort);
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  if (::connect(fd, (sockaddr *)&addr, sizeof addr) < 0)
+  {
+    perror("connect");
+    return false;
+  }
+
+  size_t expected = kHeader.size() + fileSize + kTrailer.size();
+  std::vector<char> buf(1024 * 1024);
+  std::string head, tail;
+  size_t received = 0;
+  while (received < expected)
+  {
+    ssize_t n = ::read(fd, &buf[0], buf.size());
+    if (n <= 0)
+      break;
+    if (head.size() < kHeader.size())
+      head.append(&buf[0], std::min(static_cast<size_t>(n), kHeader.size() - head.size()));
+    tail.append(&buf[0], n);
+    if (tail.size() > kTrailer.size())
+      tail.erase(0, tail.size() - kTrailer.size());
+    received += n;
+  }
+  ::close(fd);
+  return received == expected && head == kHeader && tail == kTrailer;
+}
+
+int main(int argc, char *argv[])
+{
+  bool useSendFile = argc < 2 || strcmp(argv[1], "read") != 0;
+  size_t fileSize = (argc > 2 ? atoi(argv[2]) : 1024) * 1024UL * 1024;
+  const char *path = argc > 3 ? argv[3] : "/tmp/benchSendFile.dat";
+  prepareFile(path, fileSize);
+
+  zfwmuduo::EventLoop loop;
+  zfwmuduo::TcpServer server(&loop, "sendfile", zfwmuduo::InetAddress(kPort));
+  int fileFd = ::open(path, O_RDONLY);
+  size_t offset = 0; // read+send方式已经读到的位置
+  bool trailerSent = false;
+  std::string chunk;
+  server.setConnectionCallback([&](const zfwmuduo::TcpConnectionPtr &conn)
+                               {
+                                 if (!conn->connected())
+                                   return;
+                                 conn->send(kHeader);
+                                 if (useSendFile)
+                                 {
+                                   conn->sendFile(fileFd, 0, fileSize);
+                                   conn->send(kTrailer);
+                                   trailerSent = true;
+                                 } });
+  server.setWriteCallback([&](const zfwmuduo::TcpConnectionPtr &conn)
+                          { // read+send: 上一块发完了再读下一块, 避免整个文件堆在发送缓冲区里
+                            if (useSendFile)
+                              return;
+                            if (offset < fileSize)
+                            {
+                              chunk.resize(std::min(kChunkSize, fileSize - offset));
+                              ssize_t n = ::pread(fileFd, &chunk[0], chunk.size(), offset);
+                              if (n <= 0)
+                                return;
+                              chunk.resize(n);
+                              offset += n;
+                              conn->send(chunk);
+                            }
+                            else if (!trailerSent)
+                            {
+                              trailerSent = true;
+                              conn->send(kTrailer);
+                            } });
+  server.start();
+
+  bool ok = false;
+  double cpuBegin = threadCpuSeconds();
+  timespec wallBegin, wallEnd;
+  ::clock_gettime(CLOCK_MONOTONIC, &wallBegin);
+  std::thread client([&]()
+                     {
+                       ok = receiveAll(fileSize);
+                       loop.quit(); });
+  loop.loop();
+  double cpu = threadCpuSeconds() - cpuBegin;
+  ::clock_gettime(CLOCK_MONOTONIC, &wallEnd);
+  client.join();
+  ::close(fileFd);
+  ::unlink(path);
+
+  double gb = static_cast<double>(fileSize) / (1024.0 * 1024 * 1024);
+  double wall = (wallEnd.tv_sec - wallBegin.tv_sec) + (wallEnd.tv_nsec - wallBegin.tv_nsec) / 1e9;
+  printf("%-8s file=%zuMB %s: server loop cpu=%.3fs (%.3f s/GB) wall=%.3fs (%.0f MiB/s)\n",
+         useSendFile ? "sendfile" : "read", fileSize >> 20, ok ? "ok" : "MISMATCH",
+         cpu, cpu / gb, wall, fileSize / wall / 1024 / 1024);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,62 @@
+// 小消息读取微基准: 比较原来的 栈上64K extrabuf = {0} + readv 和现在的Buffer::readFd, 每次读消耗的cycles
+// 用法: ./benchSmallRead [iterations] [messageBytes]
+#include <stdio.h>
+#include <stdlib.h> // atoi()
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h> // readv()
+#include <x86intrin.h> // __rdtsc()
+#include <string>
+
+#include "../net/Buffer.h"
+
+// 原来的实现: 每次读都在栈上清零64K
+static ssize_t legacyRead(int fd, char *buf, size_t writable)
+{
+  char extrabuf[65536] = {0};
+  struct iovec vec[2];
+  vec[0].iov_base = buf;
+  vec[0].iov_len = writable;
+  vec[1].iov_base = extrabuf;
+  vec[1].iov_len = sizeof extrabuf;
+  return ::readv(fd, vec, 2);
+}
+
+int main(int argc, char *argv[])
+{
+  int iterations = argc > 1 ? atoi(argv[1]) : 200000;
+  int messageBytes = argc > 2 ? atoi(argv[2]) : 64;
+
+  int fds[2];
+  ::socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+  std::string message(messageBytes, 'x');
+
+  char legacyBuf[zfwmuduo::Buffer::kInitialSize];
+  unsigned long long legacyCycles = 0;
+  for (int i = 0; i < iterations; ++i)
+  {
+    ::write(fds[1], message.data(), message.size());
+    unsigned long long start = __rdtsc();
+    legacyRead(fds[0], legacyBuf, sizeof legacyBuf);
+    legacyCycles += __rdtsc() - start;
+  }
+
+  zfwmuduo::Buffer buffer;
+  unsigned long long cycles = 0;
+  int savedErrno = 0;
+  for (int i = 0; i < iterations; ++i)
+  {
+    ::write(fds[1], message.data(), message.size());
+    unsigned long long start = __rdtsc();
+    buffer.readFd(fds[0], &savedErrno);
+    cycles += __rdtsc() - start;
+    buffer.retrieveAll();
+  }
+
+  printf("message=%d: legacy %.0f cycles/read, readFd %.0f cycles/read, saved %.0f cycles/read\n",
+         messageBytes,
+         static_cast<double>(legacyCycles) / iterations,
+         static_cast<double>(cycles) / iterations,
+         static_cast<double>(legacyCycles - cycles) / iterations);
+  return 0;
+}
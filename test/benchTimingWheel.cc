@@ -0,0 +1,46 @@
+// 时间轮刷新开销的基准测试: 连接数从1千增长到1百万, 单次refresh的耗时应当基本不变
+#include <stdio.h>
+#include <stdlib.h> // rand()
+#include <vector>
+
+#include "../net/EventLoop.h"
+#include "../net/TimingWheel.h"
+
+int main()
+{
+  zfwmuduo::EventLoop loop;
+  const int kRefreshes = 2000000;
+
+  for (int numConns = 1000; numConns <= 1000000; numConns *= 10)
+  {
+    zfwmuduo::TimingWheel wheel(&loop, 1.0, 60);
+    std::vector<zfwmuduo::TimingWheel::Handle> handles;
+    handles.reserve(numConns);
+    for (int i = 0; i < numConns; ++i)
+    {
+      handles.push_back(wheel.add(30.0 + i % 90, []() {}));
+    }
+
+    // 预先生成随机下标, 避免把rand()的开销算进去
+    std::vector<int> picks(kRefreshes);
+    for (int i = 0; i < kRefreshes; ++i)
+    {
+      picks[i] = rand() % numConns;
+    }
+
+    zfwmuduo::Timestamp start(zfwmuduo::Timestamp::now());
+    for (int i = 0; i < kRefreshes; ++i)
+    {
+      wheel.refresh(handles[picks[i]], 30.0 + i % 90);
+    }
+    double seconds = zfwmuduo::timeDifference(zfwmuduo::Timestamp::now(), start);
+
+    printf("connections %8d  refresh %6.1f ns/op\n", numConns, seconds * 1e9 / kRefreshes);
+
+    for (size_t i = 0; i < handles.size(); ++i)
+    {
+      wheel.remove(handles[i]);
+    }
+  }
+  return 0;
+}
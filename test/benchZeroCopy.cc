@@ -0,0 +1,129 @@
+// 大消息发送: 服务端向一个连接连续发送固定大小的消息, 比较普通发送和MSG_ZEROCOPY发送时loop线程每GB消耗的CPU时间
+// 用法: ./benchZeroCopy copy|zerocopy [megabytes] [messageKB...]
+// 两种模式都用send(shared_ptr)和分段输出, 区别只在于是否设置了零拷贝阈值(zerocopy模式下阈值取消息大小)
+// NOTE: 发往本机回环的数据内核总是会拷贝一次(通知里带SO_EE_CODE_ZEROCOPY_COPIED), 要在真实网卡上才能看到收益
+#include <stdio.h>
+#include <stdlib.h> // atoi()
+#include <string.h> // strcmp()
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/resource.h> // getrusage()
+#include <algorithm> // min()
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../net/TcpServer.h"
+#include "../net/EventLoop.h"
+
+static const uint16_t kPort = 9990;
+
+static double threadCpuSeconds()
+{
+  struct rusage usage;
+  ::getrusage(RUSAGE_THREAD, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+static void runClient(size_t total)
+{
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(kPort);
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  if (::connect(fd, (sockaddr *)&addr, sizeof addr) < 0)
+  {
+    perror("connect");
+    return;
+  }
+  std::vector<char> buf(1024 * 1024);
+  size_t received = 0;
+  while (received < total)
+  {
+    ssize_t n = ::read(fd, &buf[0], buf.size());
+    if (n <= 0)
+      break;
+    received += n;
+  }
+  ::close(fd);
+}
+
+// 发送total字节, 每条消息messageSize字节; 返回loop线程的CPU时间
+static double runOnce(bool zeroCopy, size_t total, size_t messageSize, zfwmuduo::TcpConnection::ZeroCopyStats *stats)
+{
+  zfwmuduo::EventLoop loop;
+  zfwmuduo::TcpServer server(&loop, "zerocopy", zfwmuduo::InetAddress(kPort));
+  server.setChainedOutput(true);
+  server.setZeroCopyThreshold(zeroCopy ? messageSize : 0);
+
+  // 所有消息共用同一块内存, 零拷贝模式下由还没确认的发送引用着
+  std::shared_ptr<char> payload(new char[messageSize], std::default_delete<char[]>());
+  memset(payload.get(), 'z', messageSize);
+  std::shared_ptr<const char> message(payload);
+  size_t queued = 0;
+  double cpuBegin = 0;
+
+  std::function<void(const zfwmuduo::TcpConnectionPtr &)> sendMore = [&](const zfwmuduo::TcpConnectionPtr &conn)
+  {
+    if (queued < total)
+    {
+      size_t len = std::min(messageSize, total - queued);
+      queued += len;
+      conn->send(message, len);
+    }
+  };
+  server.setConnectionCallback([&](const zfwmuduo::TcpConnectionPtr &conn)
+                               {
+                                 if (conn->connected())
+                                 {
+                                   cpuBegin = threadCpuSeconds();
+                                   sendMore(conn);
+                                 }
+                                 else
+                                 {
+                                   *stats = conn->zeroCopyStats();
+                                   loop.quit();
+                                 } });
+  server.setWriteCallback(sendMore);
+  server.start();
+
+  std::thread client(runClient, total);
+  loop.loop(); // 客户端读完后关闭连接, 服务端随之退出
+  double cpu = threadCpuSeconds() - cpuBegin;
+  client.join();
+  return cpu;
+}
+
+int main(int argc, char *argv[])
+{
+  const char *mode = argc > 1 ? argv[1] : "zerocopy";
+  size_t megabytes = argc > 2 ? atoi(argv[2]) : 2048;
+  std::vector<size_t> sizesKB;
+  for (int i = 3; i < argc; ++i)
+    sizesKB.push_back(atoi(argv[i]));
+  if (sizesKB.empty())
+    sizesKB = {16, 64, 256, 1024, 4096};
+  bool zeroCopy = strcmp(mode, "zerocopy") == 0;
+
+  size_t total = megabytes * 1024 * 1024;
+  std::vector<std::string> results;
+  for (size_t i = 0; i < sizesKB.size(); ++i)
+  {
+    zfwmuduo::TcpConnection::ZeroCopyStats stats = {0, 0, 0, 0};
+    double cpu = runOnce(zeroCopy, total, sizesKB[i] * 1024, &stats);
+    char line[256];
+    snprintf(line, sizeof line, "%-8s message=%5zuKB: %.3f s/GB (loop thread), zerocopy sends=%llu completions=%llu copied=%llu\n",
+             mode, sizesKB[i], cpu / (total / (1024.0 * 1024 * 1024)),
+             static_cast<unsigned long long>(stats.sends), static_cast<unsigned long long>(stats.completions),
+             static_cast<unsigned long long>(stats.copied));
+    results.push_back(line);
+  }
+  for (size_t i = 0; i < results.size(); ++i)
+    printf("%s", results[i].c_str());
+  return 0;
+}
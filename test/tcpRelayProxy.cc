@@ -0,0 +1,162 @@
+// 四层(TCP)代理示例: 每个客户端连接对应一个到后端的连接, 双向转发
+// 用法: ./tcpRelayProxy listenPort backendIp backendPort [splice|copy] [threads]
+// splice: TcpRelay, 数据经管道在内核中转发
+// copy:   传统做法, onMessage里retrieveAllAsString再send给另一端; 两个方向都开了背压, 一端写不动时暂停读另一端
+// 退出时(Ctrl-C)打印本进程消耗的CPU时间和转发的字节数
+#include <stdio.h>
+#include <stdlib.h> // atoi()
+#include <string.h> // strcmp()
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/resource.h> // getrusage()
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "../net/TcpServer.h"
+#include "../net/TcpRelay.h"
+
+using namespace zfwmuduo;
+
+static EventLoop *g_loop = nullptr;
+static std::atomic<uint64_t> g_bytes(0);
+static std::atomic<uint64_t> g_stalls(0); // 因为目的端写不动而暂停读的次数
+
+// 示例里在io线程中直接阻塞connect(后端一般在本机或同机房, 很快); 需要非阻塞连接和自动重连时用TcpClient
+static TcpConnectionPtr connectBackend(EventLoop *loop, const InetAddress &backendAddr, const std::string &name)
+{
+  int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (::connect(fd, (const sockaddr *)backendAddr.getSockAddr(), sizeof(sockaddr_in)) < 0)
+  {
+    perror("connect backend");
+    ::close(fd);
+    return TcpConnectionPtr();
+  }
+  ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+  sockaddr_in local;
+  socklen_t len = sizeof local;
+  ::getsockname(fd, (sockaddr *)&local, &len);
+
+  TcpConnectionPtr conn = std::make_shared<TcpConnection>(loop, name, fd, InetAddress(local), backendAddr);
+  conn->setConnectionCallback([](const TcpConnectionPtr &) {});
+  conn->setMessageCallback([](const TcpConnectionPtr &, Buffer *buf, Timestamp)
+                           { buf->retrieveAll(); });
+  conn->setCloseCallback([](const TcpConnectionPtr &c)
+                         { c->getLoop()->queueInLoop(std::bind(&TcpConnection::connectDestroyed, c)); });
+  conn->connectEstablished();
+  return conn;
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc < 4)
+  {
+    printf("usage: %s listenPort backendIp backendPort [splice|copy] [threads]\n", argv[0]);
+    return 1;
+  }
+  uint16_t listenPort = static_cast<uint16_t>(atoi(argv[1]));
+  InetAddress backendAddr(static_cast<uint16_t>(atoi(argv[3])), argv[2]);
+  bool useSplice = argc < 5 || strcmp(argv[4], "copy") != 0;
+  int threads = argc > 5 ? atoi(argv[5]) : 0;
+
+  EventLoop loop;
+  g_loop = &loop;
+  ::signal(SIGINT, [](int)
+           { g_loop->quit(); });
+  TcpServer server(&loop, "proxy", InetAddress(listenPort, "0.0.0.0"));
+  server.setThreadNum(threads);
+
+  // copy模式: 客户端连接名 -> 后端连接
+  std::mutex mutex;
+  std::map<std::string, TcpConnectionPtr> backends;
+
+  server.setConnectionCallback([&](const TcpConnectionPtr &conn)
+                               {
+                                 if (!conn->connected())
+                                 {
+                                   std::lock_guard<std::mutex> lock(mutex);
+                                   std::map<std::string, TcpConnectionPtr>::iterator it = backends.find(conn->name());
+                                   if (it != backends.end())
+                                   {
+                                     it->second->shutdown();
+                                     backends.erase(it);
+                                   }
+                                   return;
+                                 }
+
+                                 TcpConnectionPtr backend = connectBackend(conn->getLoop(), backendAddr, conn->name() + "-backend");
+                                 if (!backend)
+                                 {
+                                   conn->shutdown();
+                                   return;
+                                 }
+                                 if (useSplice)
+                                 { // relay引用两个连接, 两个连接也引用relay, 直到任意一端关闭
+                                   TcpRelayPtr relay = std::make_shared<TcpRelay>(conn, backend);
+                                   relay->start();
+                                   // NOTE: 回调持有relay, 连接关闭时还能读到统计; relay结束时已经不再引用连接, 不会循环引用
+                                   backend->setConnectionCallback([relay](const TcpConnectionPtr &c)
+                                                                  {
+                                                                    if (!c->connected())
+                                                                    {
+                                                                      TcpRelay::Stats stats = relay->stats();
+                                                                      g_bytes += stats.bytesForward + stats.bytesBackward;
+                                                                      g_stalls += stats.stalls;
+                                                                    } });
+                                   return;
+                                 }
+
+                                 // 发往客户端的数据积压时暂停读后端, 反之亦然, 代理占用的内存有上限
+                                 conn->setBackpressure(backend, 1024 * 1024, 256 * 1024);
+                                 backend->setBackpressure(conn, 1024 * 1024, 256 * 1024);
+                                 std::weak_ptr<TcpConnection> weakClient(conn);
+                                 backend->setMessageCallback([weakClient](const TcpConnectionPtr &, Buffer *buf, Timestamp)
+                                                             {
+                                                               TcpConnectionPtr client = weakClient.lock();
+                                                               g_bytes += buf->readableBytes();
+                                                               if (client)
+                                                                 client->send(buf->retrieveAllAsString());
+                                                               else
+                                                                 buf->retrieveAll(); });
+                                 backend->setConnectionCallback([weakClient](const TcpConnectionPtr &c)
+                                                                {
+                                                                  TcpConnectionPtr client = weakClient.lock();
+                                                                  if (c->connected())
+                                                                    return;
+                                                                  g_stalls += c->backpressurePauses();
+                                                                  if (client)
+                                                                  {
+                                                                    g_stalls += client->backpressurePauses();
+                                                                    client->shutdown();
+                                                                  } });
+                                 std::lock_guard<std::mutex> lock(mutex);
+                                 backends[conn->name()] = backend; });
+
+  server.setMessageCallback([&](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+                            { // splice模式下转发开始后不会再走到这里
+                              TcpConnectionPtr backend;
+                              {
+                                std::lock_guard<std::mutex> lock(mutex);
+                                std::map<std::string, TcpConnectionPtr>::iterator it = backends.find(conn->name());
+                                if (it != backends.end())
+                                  backend = it->second;
+                              }
+                              g_bytes += buf->readableBytes();
+                              if (backend)
+                                backend->send(buf->retrieveAllAsString());
+                              else
+                                buf->retrieveAll(); });
+
+  server.start();
+  loop.loop();
+
+  struct rusage usage;
+  ::getrusage(RUSAGE_SELF, &usage);
+  double cpu = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+  printf("%s proxy: relayed %.1f MB, stalls %llu, cpu %.3fs (user %.3fs)\n", useSplice ? "splice" : "copy",
+         g_bytes / 1e6, static_cast<unsigned long long>(g_stalls.load()), cpu, usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6);
+  return 0;
+}
@@ -0,0 +1,80 @@
+// MpscQueue压力测试: 多个生产者并发push, 一个消费者边生产边drain
+// 用法: ./testMpscQueue [rounds] [producers] [perProducer]
+// 生产者全部结束后, 一次drain必须能取出剩下的所有元素(和EventLoop一样: 最后一次wakeup之后只drain一次);
+// 同时检查每个生产者的元素按push的顺序被取出
+#include <stdio.h>
+#include <stdlib.h> // atoi() abort()
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "../base/MpscQueue.h"
+
+using namespace zfwmuduo;
+
+#define CHECK(cond)                                                      \
+  do                                                                     \
+  {                                                                      \
+    if (!(cond))                                                         \
+    {                                                                    \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+      abort();                                                           \
+    }                                                                    \
+  } while (0)
+
+int main(int argc, char *argv[])
+{
+  int rounds = argc > 1 ? atoi(argv[1]) : 50;
+  int producers = argc > 2 ? atoi(argv[2]) : 4;
+  int perProducer = argc > 3 ? atoi(argv[3]) : 10000;
+
+  for (int round = 0; round < rounds; ++round)
+  {
+    MpscQueue<uint64_t> queue;
+    std::vector<int64_t> nextSeq(producers, 0);
+    int64_t drained = 0;
+    auto check = [&](const uint64_t &value)
+    {
+      int producer = static_cast<int>(value >> 32);
+      int64_t seq = static_cast<int64_t>(value & 0xffffffff);
+      CHECK(producer < producers);
+      CHECK(seq == nextSeq[producer]); // 同一个生产者的元素保持FIFO
+      ++nextSeq[producer];
+      ++drained;
+    };
+
+    std::atomic_int running(producers);
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p)
+    {
+      threads.push_back(std::thread([&, p]()
+                                    {
+                                      for (int i = 0; i < perProducer; ++i)
+                                      {
+                                        queue.push((static_cast<uint64_t>(p) << 32) | i);
+                                        if (i % 64 == 0)
+                                          std::this_thread::yield(); // 让消费者经常追上生产者, 走到重新放入stub的路径
+                                      }
+                                      --running; }));
+    }
+    std::thread consumer([&]()
+                         {
+                           while (running > 0)
+                             queue.drain(check); });
+    for (size_t i = 0; i < threads.size(); ++i)
+      threads[i].join();
+    consumer.join();
+
+    queue.drain(check); // 所有push都已经完成, 一次drain就要取空
+    if (drained != static_cast<int64_t>(producers) * perProducer)
+    {
+      fprintf(stderr, "round %d: drained %lld of %lld items\n", round, static_cast<long long>(drained),
+              static_cast<long long>(producers) * perProducer);
+      abort();
+    }
+    CHECK(queue.drain(check) == 0);
+  }
+  printf("%d rounds x %d producers x %d items: ok\n", rounds, producers, perProducer);
+  return 0;
+}